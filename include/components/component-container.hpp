@@ -93,7 +93,7 @@ std::shared_ptr<const T> Get(const std::shared_ptr<const Container>& ct) {
  */
 template<Component C, class T=typename type_trait<C>::value_type>
 std::shared_ptr<Container> Create(T&& comp) {
-    return std::static_pointer_cast<Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>>(), std::forward<T>(comp)));
+    return std::static_pointer_cast<Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>,std::allocator<ContainerObject<C,T>>,memory::AllocationTag::COMPONENT>(), std::forward<T>(comp)));
 }
 
 /** \brief Put a component data in a component container
@@ -108,7 +108,7 @@ std::shared_ptr<Container> Create(T&& comp) {
  */
 template<Component C, class T=typename type_trait<C>::value_type>
 std::shared_ptr<const Container> CreateConst(T&& comp) {
-    return std::static_pointer_cast<const Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>>(), std::forward<T>(comp)));
+    return std::static_pointer_cast<const Container>(std::allocate_shared<ContainerObject<C,T>>(TrillekAllocator<ContainerObject<C,T>,std::allocator<ContainerObject<C,T>>,memory::AllocationTag::COMPONENT>(), std::forward<T>(comp)));
 }
 
 } // namespace component
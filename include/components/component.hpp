@@ -7,6 +7,7 @@
 #include "components/component-enum.hpp"
 #include "components/component-container.hpp"
 #include "components/shared-component.hpp"
+#include "systems/commit-group.hpp"
 #include "components/system-component.hpp"
 #include "components/system-component-value.hpp"
 
@@ -262,6 +263,17 @@ static void Commit(frame_tp frame) {
     GetRawContainer<C>().Commit(frame);
 }
 
+/** \brief Create a group committing several Shared components at once
+ *
+ * Readers pulling the group get the same frame for all the components.
+ *
+ * \return std::unique_ptr<CommitGroup<Shared<C>...>> the group
+ */
+template<Component... C>
+static std::unique_ptr<CommitGroup<Shared<C>...>> MakeCommitGroup() {
+    return make_unique<CommitGroup<Shared<C>...>>(GetRawContainer<C>()...);
+}
+
 /** \brief Get the updates from the last frame
  *
  * For shared component, this actually gets the component updates.
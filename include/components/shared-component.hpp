@@ -2,17 +2,31 @@
 #define SHARED_COMPONENT_HPP_INCLUDED
 
 #include "systems/rewindable-map.hpp"
+#include "systems/delta-history.hpp"
 
 namespace trillek { namespace component {
 
+/** \brief Number of frames of containers kept by the Shared maps
+ *
+ * These are a few checkpoints in which other threads can pull the modifications.
+ * The authoritative history of the component is its delta history, bounded by a
+ * budget in bytes: a thread that stays further behind rebuilds its state with
+ * Shared::Snapshot().
+ */
+const int SHARED_PULL_HISTORY = 8;
+
 template<Component C,class T>
 class SharedContainer {
 public:
-    static RewindableMap<id_t, std::shared_ptr<const Container>,frame_tp,30> container;
+    static RewindableMap<id_t, std::shared_ptr<const Container>,frame_tp,SHARED_PULL_HISTORY> container;
+    static DeltaHistory<id_t,T> history;
 };
 
 template<Component C,class T>
-RewindableMap<id_t, std::shared_ptr<const Container>,frame_tp,30> SharedContainer<C,T>::container;
+RewindableMap<id_t, std::shared_ptr<const Container>,frame_tp,SHARED_PULL_HISTORY> SharedContainer<C,T>::container;
+
+template<Component C,class T>
+DeltaHistory<id_t,T> SharedContainer<C,T>::history;
 
 template<Component C>
 class SharedContainer<C,bool> {
@@ -72,8 +86,100 @@ public:
     }
 
 
-    void Commit(frame_tp frame) {
-        Map().Commit(frame);
+    /** \brief Commit the modifications and record them in the delta history
+     *
+     * \param frame frame_tp the timepoint of the commit
+     * \return frame_tp the head of the map, not equal to frame if the commit failed
+     *
+     */
+    frame_tp Commit(frame_tp frame) {
+        auto head = Map().Commit(frame);
+        if (head == frame) {
+            History().Record(frame, Map().GetLastNegativeCommit(), Map().GetLastPositiveCommit(), &Value);
+        }
+        return head;
+    }
+
+    /** \brief Import the history of another map. See RewindableMap::Push()
+     *
+     * The delta history is rewritten from the first frame imported. If the frames
+     * imported are not all retained by the map, it restarts from the current state.
+     *
+     * \param removals T&& the removal set
+     * \param additions T&& the addition set
+     * \return frame_tp the head of the map
+     *
+     */
+    template<class T>
+    frame_tp Push(T&& removals, T&& additions) {
+        if (removals.cbegin() == removals.cend()) {
+            return Map().Push(std::forward<T>(removals), std::forward<T>(additions));
+        }
+        auto first = removals.cbegin()->first;
+        auto head = Map().Push(std::forward<T>(removals), std::forward<T>(additions));
+        auto last_received = first - 1;
+        auto imported = Map().Pull(head, last_received);
+        auto rem_it = imported.first.cbegin();
+        auto add_it = imported.second.cbegin();
+        if (rem_it == imported.first.cend() || rem_it->first != first || ! History().Truncate(first - 1)) {
+            History().Reset(Map().Map(), &Value);
+            return head;
+        }
+        for (; rem_it != imported.first.cend() && add_it != imported.second.cend(); ++rem_it, ++add_it) {
+            History().Record(rem_it->first, rem_it->second, add_it->second, &Value);
+        }
+        return head;
+    }
+
+    /** \brief Pull the most recent history since last visit. Thread-safe.
+     *
+     * See RewindableMap::Pull()
+     *
+     * \param frame_requested const frame_tp& the last frame to return
+     * \param last_received frame_tp& last visit the before-first frame to retrieve
+     * \return History<id_t,std::shared_ptr<const Container>> the removals and the additions
+     *
+     */
+    trillek::History<id_t,std::shared_ptr<const Container>> Pull(const frame_tp& frame_requested, frame_tp& last_received) const {
+        return SharedContainer<C,typename type_trait<C>::value_type>::container.Pull(frame_requested, last_received);
+    }
+
+    /** \brief Pull the most recent history since last visit, and the rebase point. Thread-safe.
+     *
+     * See RewindableMap::Pull()
+     *
+     * \param frame_requested const frame_tp& the last frame to return
+     * \param last_received frame_tp& last visit the before-first frame to retrieve
+     * \param rebase std::shared_ptr<frame_tp>& set to the rebase point, or empty
+     * \return History<id_t,std::shared_ptr<const Container>> the removals and the additions
+     *
+     */
+    trillek::History<id_t,std::shared_ptr<const Container>> Pull(const frame_tp& frame_requested, frame_tp& last_received,
+            std::shared_ptr<frame_tp>& rebase) const {
+        return SharedContainer<C,typename type_trait<C>::value_type>::container.Pull(frame_requested, last_received, rebase);
+    }
+
+    /** \brief Get the state of the component at a past frame
+     *
+     * The state is rebuilt from the delta history, the uncommitted modifications are
+     * not included.
+     *
+     * \param frame frame_tp the frame requested
+     * \param state std::map<id_t,value_type>& receives the values at frame
+     * \return bool false if the frame is older than the history
+     *
+     */
+    bool Snapshot(frame_tp frame, std::map<id_t,typename type_trait<C>::value_type>& state) {
+        return History().Snapshot(frame, state);
+    }
+
+    /** \brief Set the maximal size of the delta history of this component
+     *
+     * \param bytes size_t the budget in bytes
+     *
+     */
+    void SetHistoryBudget(size_t bytes) {
+        History().SetBudget(bytes);
     }
 
     const SharedContainerConst<id_t,typename type_trait<C>::value_type>& GetLastPositiveCommit() {
@@ -88,9 +194,18 @@ public:
         return Map().Bitmap();
     }
 
-    RewindableMap<id_t, std::shared_ptr<const Container>,frame_tp,30>& Map() {
+    RewindableMap<id_t, std::shared_ptr<const Container>,frame_tp,SHARED_PULL_HISTORY>& Map() {
         return SharedContainer<C,typename type_trait<C>::value_type>::container;
     }
+
+    DeltaHistory<id_t,typename type_trait<C>::value_type>& History() {
+        return SharedContainer<C,typename type_trait<C>::value_type>::history;
+    }
+
+private:
+    static const typename type_trait<C>::value_type& Value(const std::shared_ptr<const Container>& ct) {
+        return *component::Get<C>(ct);
+    }
 };
 
 } // namespace component
@@ -0,0 +1,282 @@
+#ifndef DATAGRAM_BATCH_HPP_INCLUDED
+#define DATAGRAM_BATCH_HPP_INCLUDED
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "controllers/network/message.hpp"
+#include "controllers/network/network-metrics.hpp"
+
+namespace trillek {
+namespace network {
+
+// the maximal size of a datagram received
+#define UDP_DATAGRAM_SIZE   1500
+
+/** \brief Batched I/O of UDP datagrams
+ *
+ * Receive() reads all the datagrams available on a socket, up to Capacity(), with
+ * one recvmmsg() call. Each datagram is written directly in its own message buffer. Received
+ * datagrams are taken with Take() or TakeMessage(), and are then dispatched one by one as before.
+ *
+ * Queue() adds a datagram to send without copying it, and Flush() sends all the queued
+ * datagrams with sendmmsg() calls. The queued data must remain valid until it is sent.
+ *
+ * Without recvmmsg()/sendmmsg() (other systems than Linux), a loop of recvfrom()/sendto()
+ * is used instead.
+ *
+ * The datagrams received and sent are counted in the metrics set, those of the connection
+ * for a client socket.
+ *
+ * The socket must be non-blocking. Not thread-safe: a batch is used by a single network thread.
+ */
+class DatagramBatch final {
+public:
+    typedef Message::vector_type vector_type;
+
+    /** \brief Constructor
+     *
+     * \param capacity size_t the maximal number of datagrams per batch
+     * \param datagram_size size_t the size of the receive buffers
+     *
+     */
+    DatagramBatch(size_t capacity = 64, size_t datagram_size = UDP_DATAGRAM_SIZE) :
+        datagram_size(datagram_size),
+        received(0),
+        buffers(capacity, vector_type(Message::GetAllocator())),
+        addresses(capacity),
+        receive_iov(capacity),
+        receive_headers(capacity),
+        metrics(nullptr) {}
+
+    // the headers point on the buffers
+    DatagramBatch(const DatagramBatch&) = delete;
+    DatagramBatch& operator=(const DatagramBatch&) = delete;
+
+    /** \brief Set the metrics to update
+     *
+     * \param metrics ConnectionMetrics* the metrics of the connection, nullptr to update none
+     *
+     */
+    void SetMetrics(ConnectionMetrics* metrics) {
+        this->metrics = metrics;
+    }
+
+    /** \brief Read the datagrams available
+     *
+     * The datagrams of the previous batch that were not taken are discarded.
+     *
+     * \param fd socket_t the socket
+     * \return int the number of datagrams received, -1 on error
+     *
+     */
+    int Receive(socket_t fd) {
+        received = 0;
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            if (buffers[i].capacity() < datagram_size) {
+                buffers[i] = vector_type(Message::GetAllocator());
+                buffers[i].reserve(datagram_size);
+            }
+            receive_iov[i].iov_base = buffers[i].data();
+            receive_iov[i].iov_len = datagram_size;
+            std::memset(&receive_headers[i], 0, sizeof(receive_headers[i]));
+            receive_headers[i].msg_hdr.msg_iov = &receive_iov[i];
+            receive_headers[i].msg_hdr.msg_iovlen = 1;
+            receive_headers[i].msg_hdr.msg_name = &addresses[i];
+            receive_headers[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+        }
+#if defined(__linux__)
+        auto ret = recvmmsg(fd, receive_headers.data(), static_cast<unsigned int>(receive_headers.size()), MSG_DONTWAIT, nullptr);
+#else
+        int ret = 0;
+        for (; ret < static_cast<int>(receive_headers.size()); ++ret) {
+            auto& header = receive_headers[ret];
+            auto size = recvfrom(fd, receive_iov[ret].iov_base, receive_iov[ret].iov_len, MSG_DONTWAIT,
+                                 static_cast<sockaddr*>(header.msg_hdr.msg_name), &header.msg_hdr.msg_namelen);
+            if (size < 0) {
+                break;
+            }
+            header.msg_len = static_cast<unsigned int>(size);
+        }
+        if (! ret && errno != EAGAIN && errno != EWOULDBLOCK) {
+            ret = -1;
+        }
+#endif
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            LOGMSG(ERROR) << "DatagramBatch: receive error on fd = " << fd << ": " << std::strerror(errno);
+            return -1;
+        }
+        received = static_cast<size_t>(ret);
+        if (metrics) {
+            for (size_t i = 0; i < received; ++i) {
+                metrics->Received(receive_headers[i].msg_len);
+            }
+        }
+        return ret;
+    }
+
+    /// Get the number of datagrams of the last batch received
+    size_t Received() const {
+        return received;
+    }
+
+    /// Get the size of the datagram i
+    size_t Size(size_t i) const {
+        return receive_headers[i].msg_len;
+    }
+
+    /// Get the data of the datagram i
+    const char* Data(size_t i) const {
+        return buffers[i].data();
+    }
+
+    /// Get the address of the sender of the datagram i
+    const sockaddr* Source(size_t i) const {
+        return reinterpret_cast<const sockaddr*>(&addresses[i]);
+    }
+
+    /// Get the length of the address of the sender of the datagram i
+    socklen_t SourceLength(size_t i) const {
+        return receive_headers[i].msg_hdr.msg_namelen;
+    }
+
+    /** \brief Take the buffer of the datagram i
+     *
+     * The buffer is moved out of the batch, a new buffer is allocated at the next Receive().
+     *
+     * \param i size_t the index of the datagram
+     * \return vector_type the buffer, with a capacity of datagram_size bytes
+     *
+     */
+    vector_type Take(size_t i) {
+        return std::move(buffers[i]);
+    }
+
+    /** \brief Build a message with the datagram i
+     *
+     * The buffer is moved in the message, without copy.
+     *
+     * \param i size_t the index of the datagram
+     * \param cnxd const ConnectionData* the connection data
+     * \return std::shared_ptr<T> the message
+     *
+     */
+    template<class T>
+    std::shared_ptr<T> TakeMessage(size_t i, const ConnectionData* cnxd = nullptr) {
+        auto size = Size(i);
+        auto ret = std::allocate_shared<T>(Message::ObjectAllocator<T>(), Take(i), datagram_size, cnxd);
+        ret->SetIndexPosition(size);
+        return ret;
+    }
+
+    /** \brief Add a datagram to send
+     *
+     * The data is not copied and must remain valid until Flush() sends it.
+     *
+     * \param data const char* the datagram
+     * \param size size_t the size of the datagram
+     * \param dest const sockaddr* the destination
+     * \param dest_len socklen_t the length of the destination address
+     *
+     */
+    void Queue(const char* data, size_t size, const sockaddr* dest, socklen_t dest_len) {
+        Outgoing out;
+        out.iov.iov_base = const_cast<char*>(data);
+        out.iov.iov_len = size;
+        std::memcpy(&out.address, dest, dest_len);
+        out.address_len = dest_len;
+        outgoing.push_back(out);
+    }
+
+    /// Get the number of datagrams waiting to be sent
+    size_t Queued() const {
+        return outgoing.size();
+    }
+
+    /** \brief Send the queued datagrams
+     *
+     * The datagrams that could not be sent because the socket buffer is full remain queued.
+     *
+     * \param fd socket_t the socket
+     * \return int the number of datagrams sent, -1 on error
+     *
+     */
+    int Flush(socket_t fd) {
+        size_t sent = 0;
+#if defined(__linux__)
+        send_headers.resize(outgoing.size());
+        for (size_t i = 0; i < outgoing.size(); ++i) {
+            std::memset(&send_headers[i], 0, sizeof(send_headers[i]));
+            send_headers[i].msg_hdr.msg_iov = &outgoing[i].iov;
+            send_headers[i].msg_hdr.msg_iovlen = 1;
+            send_headers[i].msg_hdr.msg_name = &outgoing[i].address;
+            send_headers[i].msg_hdr.msg_namelen = outgoing[i].address_len;
+        }
+        while (sent < outgoing.size()) {
+            auto ret = sendmmsg(fd, send_headers.data() + sent, static_cast<unsigned int>(outgoing.size() - sent), MSG_DONTWAIT);
+            if (ret <= 0) {
+                break;
+            }
+            sent += ret;
+        }
+#else
+        for (; sent < outgoing.size(); ++sent) {
+            auto& out = outgoing[sent];
+            if (sendto(fd, static_cast<const char*>(out.iov.iov_base), out.iov.iov_len, 0,
+                       reinterpret_cast<const sockaddr*>(&out.address), out.address_len) < 0) {
+                break;
+            }
+        }
+#endif
+        if (metrics) {
+            for (size_t i = 0; i < sent; ++i) {
+                metrics->Sent(outgoing[i].iov.iov_len);
+            }
+        }
+        outgoing.erase(outgoing.begin(), outgoing.begin() + sent);
+        if (! sent && ! outgoing.empty() && errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOGMSG(ERROR) << "DatagramBatch: send error on fd = " << fd << ": " << std::strerror(errno);
+            return -1;
+        }
+        return static_cast<int>(sent);
+    }
+
+    /// Get the maximal number of datagrams per batch
+    size_t Capacity() const {
+        return buffers.size();
+    }
+
+private:
+#if ! defined(__linux__)
+    struct mmsghdr {
+        struct msghdr msg_hdr;
+        unsigned int msg_len;
+    };
+#endif
+
+    struct Outgoing {
+        iovec iov;
+        sockaddr_storage address;
+        socklen_t address_len;
+    };
+
+    const size_t datagram_size;
+    size_t received;
+    std::vector<vector_type> buffers;
+    std::vector<sockaddr_storage> addresses;
+    std::vector<iovec> receive_iov;
+    std::vector<mmsghdr> receive_headers;
+    std::vector<Outgoing> outgoing;
+    std::vector<mmsghdr> send_headers;
+    ConnectionMetrics* metrics;
+};
+
+} // network
+} // trillek
+
+#endif // DATAGRAM_BATCH_HPP_INCLUDED
@@ -58,7 +58,7 @@ public:
     bool HasExpired() const;
 
     // the list is guarded by _cx_mutex in ConnectionData
-    mutable std::list<std::shared_ptr<Message>,TrillekAllocator<std::shared_ptr<Message>>> reassembled_frames_list;
+    mutable std::list<std::shared_ptr<Message>,TrillekAllocator<std::shared_ptr<Message>,std::allocator<std::shared_ptr<Message>>,memory::AllocationTag::NETWORK>> reassembled_frames_list;
     uint32_t length_requested;
     uint32_t length_got;
     size_t length_total;
@@ -0,0 +1,202 @@
+#ifndef IO_POLLER_EPOLL_HPP_INCLUDED
+#define IO_POLLER_EPOLL_HPP_INCLUDED
+
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <network>
+
+namespace trillek {
+namespace network {
+
+using net::socket_t;
+
+/** \brief Native epoll implementation of IOPoller for Linux
+ *
+ * The interface is the one of the kqueue implementation. The sockets are watched
+ * in edge-triggered mode: a socket added with CreatePermanent() is reported once each time
+ * new data arrives, so the caller must read the socket until it would block.
+ *
+ * Sockets added with Create() are disabled after each event (EPOLLONESHOT, the equivalent of
+ * EV_DISPATCH) and are enabled again by Watch(). The data pending at this time triggers a new event.
+ *
+ * Poll() retrieves up to v.size() events with a single system call. The events must be
+ * handled before Delete() is called on their socket.
+ */
+class IOPoller final {
+public:
+    typedef struct epoll_event event_type;
+
+    IOPoller() : epollhandle(-1) {}
+    ~IOPoller() {
+        if (epollhandle != -1) {
+            close(epollhandle);
+        }
+    }
+
+    /** \brief Initialize epoll
+     *
+     * \return bool true if no error was triggered
+     *
+     */
+    bool Initialize() const {
+        std::call_once(only_one,[&]() {
+            epollhandle = epoll_create1(EPOLL_CLOEXEC);
+        });
+        return epollhandle != -1;
+    }
+
+    // copy functions are deleted
+    IOPoller(IOPoller&) = delete;
+    IOPoller& operator=(IOPoller&) = delete;
+
+    /** \brief Add a socket to watch.
+     *
+     * The socket is disabled after each event and must be activated again with Watch().
+     *
+     * \param fd const int the file descriptor to watch
+     *
+     */
+    void Create(const socket_t fd) const {
+        Add(fd, nullptr, DISPATCH_EVENTS, "Create()");
+    }
+
+   /** \brief Add a socket to watch and attach a user pointer.
+     *
+     * The socket is disabled after each event and must be activated again with Watch().
+     *
+     * The pointer provided is returned by UserData().
+     *
+     * \param fd const int the file descriptor to watch
+     * \param udata void* the pointer to attach to the events
+     *
+     */
+    void Create(const socket_t fd, void* udata) const {
+        Add(fd, udata, DISPATCH_EVENTS, "Create()");
+    }
+
+    /** \brief Add a socket to watch without disabling it after each event.
+     *
+     * \param fd const int the file descriptor
+     *
+     */
+    void CreatePermanent(socket_t fd) const {
+        Add(fd, nullptr, PERMANENT_EVENTS, "CreatePermanent()");
+    }
+
+    /** \brief Enable an event.
+     *
+     * Must be called after Poll().
+     *
+     * \param fd const int the file descriptor
+     *
+     */
+    void Watch(const socket_t fd) const {
+        Modify(fd, true, "Watch()");
+    }
+
+    /** \brief Disable an event
+     *
+     * \param fd const int the file descriptor
+     *
+     */
+    void Unwatch(const socket_t fd) const {
+        Modify(fd, false, "Unwatch()");
+    }
+
+    /** \brief Remove a socket to watch
+     *
+     * \param fd const int the file descriptor
+     *
+     */
+    void Delete(const socket_t fd) const {
+        std::lock_guard<std::mutex> lock(entries_m);
+        epoll_ctl(epollhandle, EPOLL_CTL_DEL, fd, nullptr);
+        entries.erase(fd);
+    }
+
+    /** \brief Extract the list of event
+     *
+     * \param v std::vector<event_type>& the vector to fill
+     * \return int the number of events
+     *
+     */
+    int Poll(std::vector<event_type>& v) const {
+        return epoll_wait(epollhandle, v.data(), static_cast<int>(v.size()), 0);
+    }
+
+    /** \brief Get the socket of an event
+     *
+     */
+    static socket_t Socket(const event_type& e) {
+        return static_cast<const Entry*>(e.data.ptr)->fd;
+    }
+
+    /** \brief Get the pointer attached to the socket of an event
+     *
+     */
+    static void* UserData(const event_type& e) {
+        return static_cast<const Entry*>(e.data.ptr)->udata;
+    }
+
+    /** \brief Tell if the peer closed the connection
+     *
+     */
+    static bool IsEof(const event_type& e) {
+        return (e.events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+    }
+
+private:
+    static const uint32_t PERMANENT_EVENTS = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    static const uint32_t DISPATCH_EVENTS = PERMANENT_EVENTS | EPOLLONESHOT;
+
+    // the data attached to the epoll events
+    struct Entry {
+        socket_t fd;
+        void* udata;
+        uint32_t events;
+    };
+
+    void Add(socket_t fd, void* udata, uint32_t events, const char* caller) const {
+        std::lock_guard<std::mutex> lock(entries_m);
+        auto& entry = entries[fd];
+        entry.reset(new Entry{ fd, udata, events });
+        event_type e{};
+        e.events = events;
+        e.data.ptr = entry.get();
+        if (epoll_ctl(epollhandle, EPOLL_CTL_ADD, fd, &e) == -1) {
+            std::fprintf(stderr, "The following error occurred in %s: ", caller);
+            perror(nullptr);
+            entries.erase(fd);
+        }
+    }
+
+    void Modify(socket_t fd, bool enable, const char* caller) const {
+        std::lock_guard<std::mutex> lock(entries_m);
+        auto it = entries.find(fd);
+        if (it == entries.end()) {
+            return;
+        }
+        event_type e{};
+        e.events = enable ? it->second->events : 0;
+        e.data.ptr = it->second.get();
+        if (epoll_ctl(epollhandle, EPOLL_CTL_MOD, fd, &e) == -1 && enable) {
+            std::fprintf(stderr, "The following error occurred in %s: ", caller);
+            perror(nullptr);
+        }
+    }
+
+    mutable int epollhandle;    // the handle of epoll
+    mutable std::once_flag only_one;
+    mutable std::mutex entries_m;
+    mutable std::unordered_map<socket_t,std::unique_ptr<Entry>> entries;
+};
+
+} // network
+} // trillek
+#endif // IO_POLLER_EPOLL_HPP_INCLUDED
@@ -1,6 +1,11 @@
 #ifndef IO_POLLER_HPP_INCLUDED
 #define IO_POLLER_HPP_INCLUDED
 
+// On Linux, the native epoll implementation is used unless TRILLEK_NETWORK_KQUEUE is defined
+#if defined(__linux__) && ! defined(TRILLEK_NETWORK_KQUEUE)
+#include "controllers/network/io-poller-epoll.hpp"
+#else
+
 #include <vector>
 #include <cstddef>
 #include <cstdio>
@@ -19,6 +24,8 @@ using net::socket_t;
  */
 class IOPoller final {
 public:
+    typedef struct kevent event_type;
+
     IOPoller() : kqhandle(-1) {}
     ~IOPoller() {}
 
@@ -100,6 +107,27 @@ public:
      *
      */
     int Poll(std::vector<struct kevent>& v) const;
+
+    /** \brief Get the socket of an event
+     *
+     */
+    static socket_t Socket(const event_type& e) {
+        return static_cast<socket_t>(e.ident);
+    }
+
+    /** \brief Get the pointer attached to the socket of an event
+     *
+     */
+    static void* UserData(const event_type& e) {
+        return e.udata;
+    }
+
+    /** \brief Tell if the peer closed the connection
+     *
+     */
+    static bool IsEof(const event_type& e) {
+        return (e.flags & EV_EOF) != 0;
+    }
 private:
     class IOEvent;          // An IO event
     mutable int kqhandle;   // the handle of the kqueue
@@ -171,4 +199,5 @@ inline int IOPoller::Poll(std::vector<struct kevent>& v) const {
 
 } // network
 } // trillek
+#endif // TRILLEK_NETWORK_KQUEUE
 #endif // IO_POLLER_HPP_INCLUDED
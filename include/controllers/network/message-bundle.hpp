@@ -0,0 +1,214 @@
+#ifndef MESSAGE_BUNDLE_HPP_INCLUDED
+#define MESSAGE_BUNDLE_HPP_INCLUDED
+
+#include <cstring>
+#include <vector>
+#include "controllers/network/message.hpp"
+
+namespace trillek {
+namespace network {
+
+// the default maximal size of a bundle, including the frame header and the tag
+#define BUNDLE_MTU   1400
+
+/** \brief The header of a message in a bundle
+ */
+// Prevent insertion of padding bytes
+#pragma pack(push)
+#pragma pack(1)
+struct BundleRecord {
+    uint16_t length;        // size of the body following the record header
+    uint8_t type_major;
+    uint8_t type_minor;
+};
+#pragma pack(pop)
+
+/** \brief Coalesce the outbound messages of a connection
+ *
+ * The messages queued during a frame are packed into bundles of at most mtu bytes,
+ * each sent as a single frame with one header and one authentication tag:
+ *
+ * Frame_hdr | msg_hdr (flags = MSG_FLAG_BUNDLE) | BundleRecord | body | BundleRecord | body | ... | tag
+ *
+ * The bodies are copied when they are queued, so the messages can be released at once.
+ * Flush() is called once per tick and hands the bundles to the sending path of the connection.
+ * On the receiving side, Unpack() splits the bundle back into messages, which are dispatched
+ * to the slots of the DispatchTable as if they were received separately.
+ *
+ * Not thread-safe: each connection has its own bundler.
+ */
+class MessageBundler final {
+public:
+    typedef Message::vector_type vector_type;
+    typedef std::shared_ptr<vector_type> bundle_type;
+
+    /** \brief Constructor
+     *
+     * \param tag_size size_t the size of the authentication tag of the connection
+     * \param mtu size_t the maximal size of a bundle
+     *
+     */
+    MessageBundler(size_t tag_size, size_t mtu = BUNDLE_MTU) : tag_size(tag_size), mtu(mtu), records(0) {
+        assert(mtu > sizeof(Frame) + sizeof(BundleRecord) + tag_size);
+    }
+
+    /** \brief Get the biggest body that can be bundled
+     *
+     */
+    size_t MaxBodySize() const {
+        auto max_size = mtu - sizeof(Frame) - sizeof(BundleRecord) - tag_size;
+        return max_size < UINT16_MAX ? max_size : UINT16_MAX;
+    }
+
+    /** \brief Queue a message
+     *
+     * \param major uint8_t the major code
+     * \param minor uint8_t the minor code
+     * \param body const void* the body of the message, copied
+     * \param size size_t the size of the body
+     * \return bool false if the body is bigger than MaxBodySize(): it must be sent alone
+     *
+     */
+    bool Queue(uint8_t major, uint8_t minor, const void* body, size_t size) {
+        if (size > MaxBodySize()) {
+            return false;
+        }
+        if (bundles.empty() || bundles.back()->size() + sizeof(BundleRecord) + size + tag_size > mtu) {
+            auto bundle = std::allocate_shared<vector_type>(Message::ObjectAllocator<vector_type>(), Message::GetAllocator());
+            bundle->reserve(mtu);
+            bundle->resize(sizeof(Frame));
+            bundles.push_back(std::move(bundle));
+        }
+        auto& bundle = *bundles.back();
+        auto offset = bundle.size();
+        bundle.resize(offset + sizeof(BundleRecord) + size);
+        BundleRecord record;
+        record.length = static_cast<uint16_t>(size);
+        record.type_major = major;
+        record.type_minor = minor;
+        std::memcpy(&bundle[offset], &record, sizeof(record));
+        if (size) {
+            std::memcpy(&bundle[offset + sizeof(record)], body, size);
+        }
+        ++records;
+        return true;
+    }
+
+    /** \brief Close the bundles and pass them to the sending path
+     *
+     * The tag of each bundle is computed by hasher(tag, data, size) over the message header and the
+     * records, and is written at the end of the bundle. sink(bundle_type) is called for each bundle
+     * in the order of the messages.
+     *
+     * \param timestamp uint64_t the timestamp of the bundles
+     * \param hasher the tag generator
+     * \param sink the function sending a bundle
+     * \return size_t the number of bundles
+     *
+     */
+    template<class Hasher, class Sink>
+    size_t Flush(uint64_t timestamp, Hasher&& hasher, Sink&& sink) {
+        auto count = bundles.size();
+        for (auto& bundle : bundles) {
+            auto size = bundle->size();
+            Frame frame;
+            frame.fheader.length = static_cast<uint32_t>(size + tag_size - sizeof(Frame_hdr));
+            frame.mheader.flags = MSG_FLAG_BUNDLE;
+            frame.mheader.type_major = 0;
+            frame.mheader.type_minor = 0;
+            frame.mheader.timestamp = timestamp;
+            std::memcpy(bundle->data(), &frame, sizeof(frame));
+            bundle->resize(size + tag_size);
+            hasher(reinterpret_cast<uint8_t*>(bundle->data() + size),
+                   reinterpret_cast<const uint8_t*>(bundle->data() + sizeof(Frame_hdr)), size - sizeof(Frame_hdr));
+            sink(std::move(bundle));
+        }
+        bundles.clear();
+        records = 0;
+        return count;
+    }
+
+    /// Get the number of messages queued
+    size_t Queued() const {
+        return records;
+    }
+
+    /// Get the number of bundles that Flush() would send
+    size_t Bundles() const {
+        return bundles.size();
+    }
+
+    /** \brief Tell if a message is a bundle
+     *
+     */
+    static bool IsBundle(const msg_hdr* header) {
+        return (header->flags & MSG_FLAG_BUNDLE) != 0;
+    }
+
+    /** \brief Split a bundle into its messages
+     *
+     * The integrity of the bundle must have been checked before.
+     *
+     * \param body const char* the records, i.e the bytes following the header of the bundle
+     * \param size size_t the size of the records, without the tag
+     * \param fn the function called as fn(major, minor, const char* body, size_t size) for each message
+     * \return bool false if the bundle is malformed, fn may have been called for the first records
+     *
+     */
+    template<class Function>
+    static bool Unpack(const char* body, size_t size, Function&& fn) {
+        while (size) {
+            if (size < sizeof(BundleRecord)) {
+                return false;
+            }
+            BundleRecord record;
+            std::memcpy(&record, body, sizeof(record));
+            if (size - sizeof(record) < record.length) {
+                return false;
+            }
+            fn(record.type_major, record.type_minor, body + sizeof(record), static_cast<size_t>(record.length));
+            body += sizeof(record) + record.length;
+            size -= sizeof(record) + record.length;
+        }
+        return true;
+    }
+
+    /** \brief Split a bundle into messages of type T
+     *
+     * Each message gets the timestamp of the bundle and is passed to fn(major, minor, std::shared_ptr<Message>),
+     * which pushes it in the queue of its type.
+     *
+     * \param header const msg_hdr* the header of the bundle
+     * \param body const char* the records
+     * \param size size_t the size of the records, without the tag
+     * \param cnxd const ConnectionData* the connection of the bundle
+     * \param fn the dispatch function
+     * \return bool false if the bundle is malformed
+     *
+     */
+    template<class T, class Function>
+    static bool Unbundle(const msg_hdr* header, const char* body, size_t size, const ConnectionData* cnxd, Function&& fn) {
+        auto timestamp = header->timestamp;
+        return Unpack(body, size, [&](uint8_t major, uint8_t minor, const char* data, size_t length) {
+            std::shared_ptr<Message> msg = Message::New<T>(sizeof(Frame) + length, cnxd);
+            auto msg_header = msg->Header();
+            msg_header->flags = 0;
+            msg_header->type_major = major;
+            msg_header->type_minor = minor;
+            msg_header->timestamp = timestamp;
+            msg->append(data, length);
+            fn(major, minor, std::move(msg));
+        });
+    }
+
+private:
+    const size_t tag_size;
+    const size_t mtu;
+    size_t records;
+    std::vector<bundle_type> bundles;
+};
+
+} // network
+} // trillek
+
+#endif // MESSAGE_BUNDLE_HPP_INCLUDED
@@ -1,15 +1,20 @@
 #ifndef MESSAGE_H_INCLUDED
 #define MESSAGE_H_INCLUDED
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <vector>
 #include <cstring>
 #include <assert.h>
+#include "controllers/network/network-node-data.hpp"
 #include "controllers/network/packet-handler.hpp"
 #include <network>
 #include "trillek.hpp"
 #include "logging.hpp"
+#include "memory/thread-cache-allocator.hpp"
+#include "memory/trillek-allocator.hpp"
+#include "util/wire-format.hpp"
 
 // size of the VMAC tag
 #define VMAC_SIZE      8
@@ -47,13 +52,18 @@
 
 #define IS_RESTRICTED(x) ((x >> 3) != 0)
 
+// Flags of msg_hdr
+// the body is a bundle of several messages, see MessageBundler
+#define MSG_FLAG_BUNDLE       0x0001
+// the body is compressed, see PayloadCompressor
+#define MSG_FLAG_COMPRESSED   0x0002
+
 namespace trillek {
 namespace network {
 
 using net::socket_t;
 
 class ConnectionData;
-class NetworkNodeData;
 
 /** \brief The header of the message, without the preceding length
  */
@@ -89,15 +99,28 @@ struct Frame {
 };
 #pragma pack(pop)
 
+/** \brief A message sent or received
+ *
+ * The buffers of the messages and the messages themselves (with their reference counter)
+ * are taken from a pool of fixed size blocks cached by each thread. A buffer released by
+ * another thread than the one that allocated it goes back to the cache of its owner, so that
+ * a steady flow of messages from the network threads to the handlers does not allocate memory.
+ */
 class Message {
 public:
-    typedef TrillekAllocator<char> allocator_type;
+    typedef memory::ThreadCacheAllocator pool_type;
+    typedef TrillekAllocator<char,pool_type,memory::AllocationTag::NETWORK> allocator_type;
     typedef std::vector<char,allocator_type> vector_type;
 
     friend class Authentication;
     friend class NetworkController;
     friend class Frame_req;
+    friend class DatagramBatch;
+    friend class SendQueue;
+    friend class MessageBundler;
+    friend class PayloadCompressor;
     friend void packet_handler::PacketHandler::Process<NET_MSG,5>() const;
+    friend std::shared_ptr<ConnectionMetrics> MetricsOf(const Message& msg);
 
     virtual ~Message() {}
 
@@ -120,16 +143,47 @@ public:
 
     template<class T>
     static std::shared_ptr<T> New(size_t size, const ConnectionData* cnxd = nullptr, socket_t fd = -1) {
-        auto buffer = typename T::vector_type(typename T::allocator_type());
-        buffer.reserve(size);
-        return std::allocate_shared<T>(TrillekAllocator<T>(), std::move(buffer), size, cnxd, fd);
+        return std::allocate_shared<T>(ObjectAllocator<T>(), NewBuffer(size), size, cnxd, fd);
     }
 
     template<class T>
     static std::shared_ptr<T> New(id_t id, size_t size) {
-        auto buffer = typename T::vector_type(T::GetAllocator());
+        return std::allocate_shared<T>(ObjectAllocator<T>(), NewBuffer(size), size);
+    }
+
+    /** \brief Get a buffer for a message
+     *
+     * The buffers are recycled by the pool, so the frame header is zeroed: a message that is
+     * sent must not carry the flags of the previous user of its buffer.
+     *
+     * \param size size_t the capacity of the buffer
+     * \return vector_type the buffer
+     *
+     */
+    static vector_type NewBuffer(size_t size) {
+        auto buffer = vector_type(GetAllocator());
         buffer.reserve(size);
-        return std::allocate_shared<T>(TrillekAllocator<T>(), std::move(buffer), size);
+        std::memset(buffer.data(), 0, std::min(size, sizeof(Frame)));
+        return buffer;
+    }
+
+    /** \brief Get the allocator of the message buffers
+     *
+     * \return allocator_type the allocator
+     *
+     */
+    static allocator_type GetAllocator() {
+        return allocator_type(&pool_type::Instance());
+    }
+
+    /** \brief Get the allocator of the messages, used with std::allocate_shared
+     *
+     * \return TrillekAllocator<T,pool_type,memory::AllocationTag::NETWORK> the allocator
+     *
+     */
+    template<class T>
+    static TrillekAllocator<T,pool_type,memory::AllocationTag::NETWORK> ObjectAllocator() {
+        return TrillekAllocator<T,pool_type,memory::AllocationTag::NETWORK>(&pool_type::Instance());
     }
 
     /** \brief Send a message to a client using TCP
@@ -164,6 +218,39 @@ public:
         return reinterpret_cast<U*>(Body());
     }
 
+    /** \brief Encode a structure declaring its fields with TRILLEK_WIRE_FIELDS in the body
+     *
+     * The index is updated to point to the byte after the encoded data, which is little endian
+     * and does not depend on the layout of T.
+     *
+     * \param content const T& the structure
+     * \return bool false if the buffer is too small, the message is then unchanged
+     *
+     */
+    template<class T>
+    bool Encode(const T& content) {
+        auto size = util::wire::EncodedSize(content);
+        if (size + sizeof(Frame) > data_size) {
+            return false;
+        }
+        Resize(size);
+        util::wire::Encode(content, Body());
+        return true;
+    }
+
+    /** \brief Decode the body in place into a structure declaring its fields with TRILLEK_WIRE_FIELDS
+     *
+     * The Bytes and ArrayView fields point in the message, which must outlive them.
+     *
+     * \param content T& the structure
+     * \return bool false if the body is truncated or malformed
+     *
+     */
+    template<class T>
+    bool Decode(T& content) {
+        return util::wire::Decode(content, Body(), BodySize());
+    }
+
     /** \brief Return the entity id attached to this message
      *
      * \return id_t the id
@@ -438,6 +525,13 @@ private:
     std::shared_ptr<NetworkNodeData> node_data;
 };
 
+/** \brief Get the metrics of the connection of a message, used by the dispatch table
+ *
+ */
+inline std::shared_ptr<ConnectionMetrics> MetricsOf(const Message& msg) {
+    return msg.node_data ? msg.node_data->Metrics() : std::shared_ptr<ConnectionMetrics>();
+}
+
 // Declare specialized template functions.
 template<> Message& Message::operator<<(const std::string& in);
 template<> Message& Message::operator<<(const std::vector<uint8_t>& in);
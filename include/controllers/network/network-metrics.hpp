@@ -0,0 +1,403 @@
+#ifndef NETWORK_METRICS_HPP_INCLUDED
+#define NETWORK_METRICS_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "trillek.hpp"
+
+namespace trillek {
+namespace network {
+
+/** \brief Copy of a histogram, to aggregate and query
+ *
+ */
+class HistogramSnapshot final {
+public:
+    // 8 sub-buckets per power of 2: the relative error of a value is at most 12.5%
+    static const unsigned int SUB_BITS = 3;
+    static const size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    HistogramSnapshot() : counts(BUCKETS, 0), total(0), sum(0), max(0) {}
+
+    /** \brief Get the bucket of a value
+     *
+     */
+    static size_t Bucket(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        unsigned int msb = 63;
+        while (! (value >> msb)) {
+            --msb;
+        }
+        auto shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<size_t>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    /** \brief Get the highest value of a bucket
+     *
+     */
+    static uint64_t BucketMax(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        auto shift = bucket / SUB_BUCKETS - 1;
+        auto base = (SUB_BUCKETS | (bucket % SUB_BUCKETS)) << shift;
+        return base + ((uint64_t(1) << shift) - 1);
+    }
+
+    /** \brief Get a percentile
+     *
+     * \param p double the fraction of the values, between 0 and 1
+     * \return uint64_t the upper bound of the bucket of the percentile, 0 if there is no value
+     *
+     */
+    uint64_t Percentile(double p) const {
+        if (! total) {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(p * total);
+        if (rank >= total) {
+            rank = total - 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank) {
+                return std::min(BucketMax(i), max);
+            }
+        }
+        return max;
+    }
+
+    void Merge(const HistogramSnapshot& other) {
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        max = std::max(max, other.max);
+    }
+
+    uint64_t Count() const {
+        return total;
+    }
+
+    uint64_t Max() const {
+        return max;
+    }
+
+    double Mean() const {
+        return total ? static_cast<double>(sum) / total : 0;
+    }
+
+private:
+    friend class LogHistogram;
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/** \brief Histogram of values with logarithmic buckets, in the manner of HDR histograms
+ *
+ * Record() is lock-free and can be called from any thread. The buckets cover all the
+ * uint64_t values with a bounded relative error, so the unit (usually microseconds) does not matter.
+ */
+class LogHistogram final {
+public:
+    LogHistogram() : counts(new std::atomic<uint64_t>[HistogramSnapshot::BUCKETS]), total(0), sum(0), max(0) {
+        for (size_t i = 0; i < HistogramSnapshot::BUCKETS; ++i) {
+            counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Record(uint64_t value) {
+        counts[HistogramSnapshot::Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        auto current = max.load(std::memory_order_relaxed);
+        while (current < value && ! max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    /** \brief Copy the histogram
+     *
+     * The copy is not atomic as a whole: values recorded meanwhile may be partially counted.
+     *
+     */
+    HistogramSnapshot Snapshot() const {
+        HistogramSnapshot ret;
+        for (size_t i = 0; i < HistogramSnapshot::BUCKETS; ++i) {
+            ret.counts[i] = counts[i].load(std::memory_order_relaxed);
+        }
+        ret.total = total.load(std::memory_order_relaxed);
+        ret.sum = sum.load(std::memory_order_relaxed);
+        ret.max = max.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+/** \brief Values of the metrics of a connection, or of the whole server
+ *
+ */
+struct MetricsSnapshot {
+    MetricsSnapshot() : id(0), bytes_sent(0), bytes_received(0), packets_sent(0), packets_received(0),
+        retransmissions(0), authentication_failures(0), tag_failures(0), queue_depth(0), max_queue_depth(0),
+        processing_time(0), type_messages(256, 0), type_time(256, 0) {}
+
+    void Merge(const MetricsSnapshot& other) {
+        bytes_sent += other.bytes_sent;
+        bytes_received += other.bytes_received;
+        packets_sent += other.packets_sent;
+        packets_received += other.packets_received;
+        retransmissions += other.retransmissions;
+        authentication_failures += other.authentication_failures;
+        tag_failures += other.tag_failures;
+        queue_depth += other.queue_depth;
+        max_queue_depth = std::max(max_queue_depth, other.max_queue_depth);
+        processing_time += other.processing_time;
+        for (size_t i = 0; i < 256; ++i) {
+            type_messages[i] += other.type_messages[i];
+            type_time[i] += other.type_time[i];
+        }
+        rtt.Merge(other.rtt);
+        reassembly_time.Merge(other.reassembly_time);
+    }
+
+    id_t id;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t packets_sent;
+    uint64_t packets_received;
+    uint64_t retransmissions;
+    uint64_t authentication_failures;
+    uint64_t tag_failures;
+    uint64_t queue_depth;
+    uint64_t max_queue_depth;
+    // time spent processing the messages received, in microseconds
+    uint64_t processing_time;
+    // messages received and processing time by major type
+    std::vector<uint64_t> type_messages;
+    std::vector<uint64_t> type_time;
+    HistogramSnapshot rtt;
+    HistogramSnapshot reassembly_time;
+};
+
+/** \brief Counters and histograms of a connection
+ *
+ * All the methods are lock-free and can be called from the network and worker threads.
+ * The relaxed memory order is used: the counters are statistics, they do not synchronize anything.
+ */
+class ConnectionMetrics final {
+public:
+    ConnectionMetrics() : bytes_sent(0), bytes_received(0), packets_sent(0), packets_received(0),
+        retransmissions(0), authentication_failures(0), tag_failures(0), queue_depth(0), max_queue_depth(0),
+        processing_time(0) {
+        for (size_t i = 0; i < 256; ++i) {
+            type_messages[i].store(0, std::memory_order_relaxed);
+            type_time[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ConnectionMetrics(const ConnectionMetrics&) = delete;
+    ConnectionMetrics& operator=(const ConnectionMetrics&) = delete;
+
+    void Sent(size_t bytes) {
+        bytes_sent.fetch_add(bytes, std::memory_order_relaxed);
+        packets_sent.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Received(size_t bytes) {
+        bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+        packets_received.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Retransmitted(size_t count = 1) {
+        retransmissions.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void AuthenticationFailed() {
+        authentication_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void TagFailed() {
+        tag_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** \brief Record a message queued for processing
+     *
+     */
+    void Queued() {
+        auto depth = queue_depth.fetch_add(1, std::memory_order_relaxed) + 1;
+        auto current = max_queue_depth.load(std::memory_order_relaxed);
+        while (current < depth && ! max_queue_depth.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {}
+    }
+
+    /** \brief Record a message processed
+     *
+     * \param major uint8_t the major type of the message
+     * \param time uint64_t the processing time in microseconds
+     * \param queued bool false if the message was handled without being queued
+     *
+     */
+    void Processed(uint8_t major, uint64_t time, bool queued = true) {
+        if (queued) {
+            queue_depth.fetch_sub(1, std::memory_order_relaxed);
+        }
+        processing_time.fetch_add(time, std::memory_order_relaxed);
+        type_messages[major].fetch_add(1, std::memory_order_relaxed);
+        type_time[major].fetch_add(time, std::memory_order_relaxed);
+    }
+
+    /// Record a round-trip time in microseconds
+    void RoundTrip(uint64_t time) {
+        rtt.Record(time);
+    }
+
+    /// Record the time between the first and the last byte of a frame, in microseconds
+    void Reassembled(uint64_t time) {
+        reassembly_time.Record(time);
+    }
+
+    MetricsSnapshot Snapshot() const {
+        MetricsSnapshot ret;
+        ret.bytes_sent = bytes_sent.load(std::memory_order_relaxed);
+        ret.bytes_received = bytes_received.load(std::memory_order_relaxed);
+        ret.packets_sent = packets_sent.load(std::memory_order_relaxed);
+        ret.packets_received = packets_received.load(std::memory_order_relaxed);
+        ret.retransmissions = retransmissions.load(std::memory_order_relaxed);
+        ret.authentication_failures = authentication_failures.load(std::memory_order_relaxed);
+        ret.tag_failures = tag_failures.load(std::memory_order_relaxed);
+        ret.queue_depth = queue_depth.load(std::memory_order_relaxed);
+        ret.max_queue_depth = max_queue_depth.load(std::memory_order_relaxed);
+        ret.processing_time = processing_time.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < 256; ++i) {
+            ret.type_messages[i] = type_messages[i].load(std::memory_order_relaxed);
+            ret.type_time[i] = type_time[i].load(std::memory_order_relaxed);
+        }
+        ret.rtt = rtt.Snapshot();
+        ret.reassembly_time = reassembly_time.Snapshot();
+        return ret;
+    }
+
+private:
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> bytes_received;
+    std::atomic<uint64_t> packets_sent;
+    std::atomic<uint64_t> packets_received;
+    std::atomic<uint64_t> retransmissions;
+    std::atomic<uint64_t> authentication_failures;
+    std::atomic<uint64_t> tag_failures;
+    std::atomic<uint64_t> queue_depth;
+    std::atomic<uint64_t> max_queue_depth;
+    std::atomic<uint64_t> processing_time;
+    std::atomic<uint64_t> type_messages[256];
+    std::atomic<uint64_t> type_time[256];
+    LogHistogram rtt;
+    LogHistogram reassembly_time;
+};
+
+/** \brief The metrics of all the connections of the server
+ *
+ * The connections register their metrics when they are created and are forgotten when
+ * their metrics are destroyed, i.e. when the connection is closed. The mutex only protects
+ * the registration: the metrics are updated without lock.
+ *
+ * The failures of connections not yet registered, e.g. failed authentications, are
+ * recorded in Unattributed().
+ */
+class NetworkMetrics final {
+public:
+    /** \brief Get the metrics of the server, where the connections are registered
+     *
+     */
+    static NetworkMetrics& Default() {
+        static NetworkMetrics metrics;
+        return metrics;
+    }
+
+    /** \brief Register the metrics of a connection
+     *
+     * \param id id_t the id of the entity of the connection
+     * \param metrics const std::shared_ptr<ConnectionMetrics>& the metrics
+     *
+     */
+    void Register(id_t id, const std::shared_ptr<ConnectionMetrics>& metrics) {
+        std::lock_guard<std::mutex> lock(mutex);
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+            [](const std::pair<id_t,std::weak_ptr<ConnectionMetrics>>& c) { return c.second.expired(); }), connections.end());
+        connections.emplace_back(id, metrics);
+    }
+
+    ConnectionMetrics& Unattributed() {
+        return unattributed;
+    }
+
+    /** \brief Take a snapshot of the server
+     *
+     * \param per_connection std::vector<MetricsSnapshot>* if not null, receives the snapshots of the connections
+     * \return MetricsSnapshot the sum of the metrics of the live connections and of the unattributed ones
+     *
+     */
+    MetricsSnapshot Snapshot(std::vector<MetricsSnapshot>* per_connection = nullptr) const {
+        std::vector<std::pair<id_t,std::shared_ptr<ConnectionMetrics>>> live;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& c : connections) {
+                if (auto metrics = c.second.lock()) {
+                    live.emplace_back(c.first, std::move(metrics));
+                }
+            }
+        }
+        auto ret = unattributed.Snapshot();
+        for (const auto& c : live) {
+            auto snapshot = c.second->Snapshot();
+            snapshot.id = c.first;
+            ret.Merge(snapshot);
+            if (per_connection) {
+                per_connection->push_back(std::move(snapshot));
+            }
+        }
+        return ret;
+    }
+
+    /** \brief Get the connections that spent the most time processing their messages
+     *
+     * \param count size_t the number of connections
+     * \return std::vector<MetricsSnapshot> the connections, the most expensive first
+     *
+     */
+    std::vector<MetricsSnapshot> TopConnections(size_t count) const {
+        std::vector<MetricsSnapshot> ret;
+        Snapshot(&ret);
+        std::sort(ret.begin(), ret.end(), [](const MetricsSnapshot& a, const MetricsSnapshot& b) {
+            return a.processing_time > b.processing_time;
+        });
+        if (ret.size() > count) {
+            ret.erase(ret.begin() + count, ret.end());
+        }
+        return ret;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::pair<id_t,std::weak_ptr<ConnectionMetrics>>> connections;
+    ConnectionMetrics unattributed;
+};
+
+} // network
+} // trillek
+
+#endif // NETWORK_METRICS_HPP_INCLUDED
@@ -2,11 +2,17 @@
 #define NETWORK_NODE_DATA_HPP_INCLUDED
 
 #include <network>
+#include "controllers/network/network-metrics.hpp"
 #include "memory/stream-allocator.hpp"
 
 namespace trillek {
 namespace network {
 
+/** \brief The data of a connection
+ *
+ * The connections created with the id of their entity register their metrics in
+ * NetworkMetrics::Default().
+ */
 class NetworkNodeData {
 public:
     // constructor used by the client in connect() and by the server with new connections
@@ -14,14 +20,17 @@ public:
         _addr(std::move(remote)),
         udp_counter(0),
         _id(0),
-        _timestamp(timestamp) {}
+        _timestamp(timestamp),
+        metrics(std::make_shared<ConnectionMetrics>()) {}
 
     // constructor used by the authentication handler on server side to set cnx_data
     NetworkNodeData(const id_t id,
         std::function<bool(const uint8_t*, const uint8_t*, size_t, uint64_t)>&& verifier,
         net::address remote, uint64_t timestamp)
         : _id(id), _verifier(std::move(verifier)), _addr(std::move(remote)), _timestamp(timestamp),
-        udp_counter(0) {}
+        udp_counter(0), metrics(std::make_shared<ConnectionMetrics>()) {
+        NetworkMetrics::Default().Register(id, metrics);
+    }
 
     // constructor used by the authentication handler on server side to set the Networknode component
     NetworkNodeData(const id_t id,
@@ -33,7 +42,10 @@ public:
             _hasher_udp(std::move(hasher_udp)),
             _hasher_tcp(std::move(hasher_tcp)),
             _addr(std::move(remote)), _timestamp(timestamp), udp_counter(0),
-             udp_reliable_buffer(make_unique<memory::StreamAllocator<4096>>()) {}
+             udp_reliable_buffer(make_unique<memory::StreamAllocator<4096,true>>()),
+             metrics(std::make_shared<ConnectionMetrics>()) {
+        NetworkMetrics::Default().Register(id, metrics);
+    }
 
     /** \brief Return the verifier associated to this socket
      *
@@ -85,14 +97,24 @@ public:
         return ++udp_counter;
     }
 
-    memory::StreamAllocator<4096>* UDPReliableBuffer() {
+    memory::StreamAllocator<4096,true>* UDPReliableBuffer() {
         return udp_reliable_buffer.get();
     }
 
     const net::address& GetRemoteAddress() const { return _addr; }
 
+    /** \brief Return the metrics of the connection
+     *
+     * The pointer is shared with NetworkMetrics::Register() to include the connection in the
+     * snapshots of the server.
+     *
+     * \return const std::shared_ptr<ConnectionMetrics>& the metrics
+     *
+     */
+    const std::shared_ptr<ConnectionMetrics>& Metrics() const { return metrics; }
+
 private:
-    std::unique_ptr<memory::StreamAllocator<4096>> udp_reliable_buffer;
+    std::unique_ptr<memory::StreamAllocator<4096,true>> udp_reliable_buffer;
     const net::address _addr;
     const std::function<bool(const uint8_t*, const uint8_t*, size_t, uint64_t)> _verifier;
     const std::function<void(uint8_t*, const uint8_t*, size_t, uint64_t)> _hasher_udp;
@@ -100,6 +122,7 @@ private:
     const uint64_t _timestamp;
     const id_t _id;
     uint_least16_t udp_counter;
+    const std::shared_ptr<ConnectionMetrics> metrics;
 };
 
 } // network
@@ -1,7 +1,16 @@
 #ifndef PACKETHANDLER_HPP_INCLUDED
 #define PACKETHANDLER_HPP_INCLUDED
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
 #include "atomic-queue.hpp"
+#include "trillek.hpp"
+#include "controllers/network/network-metrics.hpp"
 
 namespace trillek {
 namespace network {
@@ -10,14 +19,357 @@ class Message;
 
 namespace packet_handler {
 
+/** \brief Get the metrics of the connection of a message
+ *
+ * The overloads for the message types are found by argument-dependent lookup, e.g. the
+ * one of Message returns the metrics of its connection. By default, none.
+ */
+template<class T>
+std::shared_ptr<ConnectionMetrics> MetricsOf(const T&) {
+    return std::shared_ptr<ConnectionMetrics>();
+}
+
+/** \brief Routing statistics of a message type
+ *
+ * The messages processed and their processing time are in the ConnectionMetrics of their connection.
+ */
+struct TypeStatistics {
+    // messages routed to the type, queued or handled inline
+    uint64_t dispatched;
+    uint64_t handled_inline;
+    // biggest number of messages processed at once
+    uint64_t max_batch;
+};
+
+/** \brief Routing of the messages received to their handlers
+ *
+ * The table has a slot for each of the 256 x 256 (major, minor) types, created when a handler is
+ * registered or when its queue is requested. A message is routed with a single lookup:
+ * - to the queue of the slot, which a worker empties with Process(),
+ * - or directly to the handler, on the I/O thread, for the types registered inline. The handler
+ * must then be short and thread-safe.
+ *
+ * DispatchBatch() routes the messages received together with one lock per type.
+ *
+ * The queue depth and the processing time of each message are recorded in the metrics of its
+ * connection, given by MetricsOf().
+ *
+ * A decoder can be set to transform the messages before they are routed, e.g. to expand the
+ * compressed bodies with PayloadCompressor::Decoder().
+ *
+ * The handlers and the decoder are set at startup, before the messages are dispatched. Dispatch(),
+ * Process() and Queue() are thread-safe.
+ */
+template<class T>
+class DispatchTable final {
+public:
+    typedef std::shared_ptr<T> message_type;
+    typedef std::function<void(message_type)> handler_type;
+    typedef AtomicQueue<message_type> queue_type;
+    typedef std::function<message_type(message_type)> decoder_type;
+
+    /** \brief Messages to dispatch together
+     *
+     */
+    class Batch {
+    public:
+        void Add(uint8_t major, uint8_t minor, message_type msg) {
+            items.emplace_back(Key(major, minor), std::move(msg));
+        }
+
+        size_t Size() const {
+            return items.size();
+        }
+
+    private:
+        friend class DispatchTable;
+        std::vector<std::pair<uint16_t,message_type>> items;
+    };
+
+    DispatchTable() : slots(new std::atomic<Slot*>[TYPES]), unrouted(0), rejected(0) {
+        for (size_t i = 0; i < TYPES; ++i) {
+            slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~DispatchTable() {
+        for (size_t i = 0; i < TYPES; ++i) {
+            delete slots[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    DispatchTable(const DispatchTable&) = delete;
+    DispatchTable& operator=(const DispatchTable&) = delete;
+
+    /** \brief Get the table used by the PacketHandler queues
+     *
+     */
+    static DispatchTable& Default() {
+        static DispatchTable table;
+        return table;
+    }
+
+    /** \brief Register the handler of a message type
+     *
+     * \param major uint8_t the major type
+     * \param minor uint8_t the minor type
+     * \param handler handler_type the function called for each message
+     * \param inline_handling bool true to call the handler in Dispatch(), on the I/O thread
+     *
+     */
+    void Register(uint8_t major, uint8_t minor, handler_type handler, bool inline_handling = false) {
+        auto& slot = GetSlot(Key(major, minor));
+        slot.handler = std::move(handler);
+        slot.inline_handling = inline_handling;
+        std::lock_guard<std::mutex> lock(registered_mutex);
+        if (std::find(registered.begin(), registered.end(), Key(major, minor)) == registered.end()) {
+            registered.push_back(Key(major, minor));
+        }
+    }
+
+    /** \brief Set the function applied to each message before it is routed
+     *
+     * \param decoder decoder_type returns the message to route, or an empty pointer to drop it
+     *
+     */
+    void SetDecoder(decoder_type decoder) {
+        this->decoder = std::move(decoder);
+    }
+
+    /** \brief Get the queue of a message type, for the handlers that poll it themselves
+     *
+     */
+    queue_type& Queue(uint8_t major, uint8_t minor) {
+        return GetSlot(Key(major, minor)).queue;
+    }
+
+    /** \brief Route a message
+     *
+     * \param major uint8_t the major type
+     * \param minor uint8_t the minor type
+     * \param msg message_type the message
+     * \return bool false if the type has no slot or the decoder rejected the message, which is then dropped
+     *
+     */
+    bool Dispatch(uint8_t major, uint8_t minor, message_type msg) {
+        auto slot = slots[Key(major, minor)].load(std::memory_order_acquire);
+        if (! slot) {
+            unrouted.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (! Decode(msg)) {
+            return false;
+        }
+        slot->dispatched.fetch_add(1, std::memory_order_relaxed);
+        if (slot->inline_handling) {
+            slot->handled_inline.fetch_add(1, std::memory_order_relaxed);
+            Handle(*slot, major, std::move(msg), false);
+            return true;
+        }
+        if (auto metrics = MetricsOf(*msg)) {
+            metrics->Queued();
+        }
+        slot->queue.Push(std::move(msg));
+        return true;
+    }
+
+    /** \brief Route the messages of a batch, which is emptied
+     *
+     * The order of the messages of each type is kept.
+     *
+     * \return size_t the number of messages routed, without the messages rejected by the decoder
+     *
+     */
+    size_t DispatchBatch(Batch& batch) {
+        auto& items = batch.items;
+        std::stable_sort(items.begin(), items.end(),
+            [](const std::pair<uint16_t,message_type>& a, const std::pair<uint16_t,message_type>& b) { return a.first < b.first; });
+        size_t ret = 0;
+        for (size_t i = 0; i < items.size();) {
+            auto key = items[i].first;
+            auto end = i;
+            while (end < items.size() && items[end].first == key) {
+                ++end;
+            }
+            auto slot = slots[key].load(std::memory_order_acquire);
+            if (! slot) {
+                unrouted.fetch_add(end - i, std::memory_order_relaxed);
+            }
+            else if (slot->inline_handling) {
+                for (auto j = i; j < end; ++j) {
+                    if (Dispatch(static_cast<uint8_t>(key >> 8), static_cast<uint8_t>(key), std::move(items[j].second))) {
+                        ++ret;
+                    }
+                }
+            }
+            else {
+                typename std::remove_reference<decltype(slot->queue.Poll())>::type list;
+                for (auto j = i; j < end; ++j) {
+                    if (Decode(items[j].second)) {
+                        if (auto metrics = MetricsOf(*items[j].second)) {
+                            metrics->Queued();
+                        }
+                        list.push_back(std::move(items[j].second));
+                    }
+                }
+                slot->dispatched.fetch_add(list.size(), std::memory_order_relaxed);
+                ret += list.size();
+                slot->queue.PushList(std::move(list));
+            }
+            i = end;
+        }
+        items.clear();
+        return ret;
+    }
+
+    /** \brief Call the handler of a type on the messages queued
+     *
+     * \return size_t the number of messages processed
+     *
+     */
+    size_t Process(uint8_t major, uint8_t minor) {
+        auto slot = slots[Key(major, minor)].load(std::memory_order_acquire);
+        if (! slot || ! slot->handler) {
+            return 0;
+        }
+        auto list = slot->queue.Poll();
+        if (list.empty()) {
+            return 0;
+        }
+        size_t count = 0;
+        for (auto& msg : list) {
+            Handle(*slot, major, std::move(msg), true);
+            ++count;
+        }
+        auto max = slot->max_batch.load(std::memory_order_relaxed);
+        while (max < count && ! slot->max_batch.compare_exchange_weak(max, count, std::memory_order_relaxed)) {}
+        return count;
+    }
+
+    /** \brief Process the messages queued of all the registered types
+     *
+     * \return size_t the number of messages processed
+     *
+     */
+    size_t ProcessAll() {
+        std::vector<uint16_t> keys;
+        {
+            std::lock_guard<std::mutex> lock(registered_mutex);
+            keys = registered;
+        }
+        size_t ret = 0;
+        for (auto key : keys) {
+            ret += Process(static_cast<uint8_t>(key >> 8), static_cast<uint8_t>(key));
+        }
+        return ret;
+    }
+
+    /** \brief Get the statistics of a type
+     *
+     */
+    TypeStatistics Statistics(uint8_t major, uint8_t minor) const {
+        TypeStatistics ret{};
+        auto slot = slots[Key(major, minor)].load(std::memory_order_acquire);
+        if (slot) {
+            ret.dispatched = slot->dispatched.load(std::memory_order_relaxed);
+            ret.handled_inline = slot->handled_inline.load(std::memory_order_relaxed);
+            ret.max_batch = slot->max_batch.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    /// Get the number of messages of types without slot
+    uint64_t Unrouted() const {
+        return unrouted.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of messages dropped by the decoder
+    uint64_t Rejected() const {
+        return rejected.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const size_t TYPES = 256 * 256;
+
+    struct Slot {
+        Slot() : inline_handling(false), dispatched(0), handled_inline(0), max_batch(0) {}
+
+        queue_type queue;
+        handler_type handler;
+        bool inline_handling;
+        std::atomic<uint64_t> dispatched;
+        std::atomic<uint64_t> handled_inline;
+        std::atomic<uint64_t> max_batch;
+    };
+
+    static uint16_t Key(uint8_t major, uint8_t minor) {
+        return static_cast<uint16_t>((major << 8) | minor);
+    }
+
+    /** \brief Call the handler on a message and record its processing time
+     *
+     */
+    static void Handle(Slot& slot, uint8_t major, message_type msg, bool queued) {
+        // the message may hold the last reference on its connection
+        auto metrics = MetricsOf(*msg);
+        if (! metrics) {
+            slot.handler(std::move(msg));
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        slot.handler(std::move(msg));
+        auto time = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        metrics->Processed(major, time, queued);
+    }
+
+    bool Decode(message_type& msg) {
+        if (decoder) {
+            msg = decoder(std::move(msg));
+            if (! msg) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Slot& GetSlot(uint16_t key) {
+        auto slot = slots[key].load(std::memory_order_acquire);
+        if (slot) {
+            return *slot;
+        }
+        auto created = new Slot();
+        if (! slots[key].compare_exchange_strong(slot, created, std::memory_order_acq_rel)) {
+            // created by another thread
+            delete created;
+            return *slot;
+        }
+        return *created;
+    }
+
+    std::unique_ptr<std::atomic<Slot*>[]> slots;
+    std::atomic<uint64_t> unrouted;
+    std::atomic<uint64_t> rejected;
+    decoder_type decoder;
+    std::mutex registered_mutex;
+    std::vector<uint16_t> registered;
+};
+
+typedef DispatchTable<Message> MessageDispatchTable;
+
+/** \brief Queue of a message type
+ *
+ * \deprecated Use MessageDispatchTable::Default().Queue(Major, Minor), input_queue is the same queue.
+ */
 template<int Major,int Minor>
 class PacketQueue {
 public:
-    static AtomicQueue<std::shared_ptr<Message>> input_queue;
+    DEPRECATED static AtomicQueue<std::shared_ptr<Message>>& input_queue;
 };
 
 template<int Major,int Minor>
-AtomicQueue<std::shared_ptr<Message>> PacketQueue<Major,Minor>::input_queue;
+AtomicQueue<std::shared_ptr<Message>>& PacketQueue<Major,Minor>::input_queue = MessageDispatchTable::Default().Queue(Major, Minor);
 
 class PacketHandler {
 public:
@@ -27,14 +379,17 @@ public:
     template<int Major, int Minor>
     void Process() const;
 
+    /** \brief Get the queue of a message type in the default dispatch table
+     *
+     */
     template<int Major, int Minor>
     AtomicQueue<std::shared_ptr<Message>>& GetQueue() {
-        return PacketQueue<Major,Minor>::input_queue;
+        return MessageDispatchTable::Default().Queue(Major, Minor);
     };
 
     template<int Major, int Minor>
     AtomicQueue<std::shared_ptr<Message>>& GetQueue() const {
-        return PacketQueue<Major,Minor>::input_queue;
+        return MessageDispatchTable::Default().Queue(Major, Minor);
     };
 
 };
@@ -0,0 +1,157 @@
+#ifndef PAYLOAD_COMPRESSOR_HPP_INCLUDED
+#define PAYLOAD_COMPRESSOR_HPP_INCLUDED
+
+#include <cstring>
+#include <vector>
+#include "controllers/network/message.hpp"
+#include "util/lz-codec.hpp"
+
+namespace trillek {
+namespace network {
+
+/** \brief Optional compression of the body of the messages
+ *
+ * A compressed body starts with the size of the original body on 4 bytes, followed by
+ * the data compressed with the LZ codec, and the message has the MSG_FLAG_COMPRESSED flag.
+ * The header and the tag are not compressed, so the tag is checked before decompression.
+ *
+ * Compress() is called before sending and leaves the small or incompressible bodies untouched.
+ * On the receiving side, Decoder() is set on the dispatch table to expand the messages before
+ * they reach their handlers. The codec, and its dictionary, must be the same on both sides.
+ *
+ * The methods are const and thread-safe.
+ */
+class PayloadCompressor final {
+public:
+    // the biggest body accepted, to bound the memory allocated for a received message
+    static const size_t MAX_BODY_SIZE = 1 << 24;
+
+    /** \brief Constructor
+     *
+     * \param codec const util::algorithm::LZCodec& the codec
+     * \param threshold size_t the size under which the bodies are not compressed
+     *
+     */
+    PayloadCompressor(const util::algorithm::LZCodec& codec, size_t threshold = 128) :
+        codec(codec), threshold(threshold) {}
+
+    /** \brief Compress the body of a message in place
+     *
+     * Must be called before sending the message, the tag is then computed on the compressed body.
+     *
+     * \param msg Message& the message
+     * \return bool true if the body was compressed
+     *
+     */
+    bool Compress(Message& msg) const {
+        auto size = msg.BodySize();
+        if (size < threshold || size > MAX_BODY_SIZE || (msg.Header()->flags & MSG_FLAG_COMPRESSED)) {
+            return false;
+        }
+        auto& scratch = Scratch();
+        scratch.resize(sizeof(uint32_t) + util::algorithm::LZCodec::Bound(size));
+        auto compressed = codec.Compress(msg.Body(), size, scratch.data() + sizeof(uint32_t), scratch.size() - sizeof(uint32_t));
+        if (! compressed || compressed + sizeof(uint32_t) >= size) {
+            return false;
+        }
+        auto original = static_cast<uint32_t>(size);
+        std::memcpy(scratch.data(), &original, sizeof(original));
+        std::memcpy(msg.Body(), scratch.data(), compressed + sizeof(uint32_t));
+        msg.SetIndexPosition(sizeof(Frame) + sizeof(uint32_t) + compressed);
+        msg.Header()->flags |= MSG_FLAG_COMPRESSED;
+        return true;
+    }
+
+    /** \brief Tell if a message is compressed
+     *
+     */
+    static bool IsCompressed(const msg_hdr* header) {
+        return (header->flags & MSG_FLAG_COMPRESSED) != 0;
+    }
+
+    /** \brief Get the size of the body once decompressed
+     *
+     * \param body const char* the compressed body
+     * \param size size_t the size of the compressed body
+     * \return size_t the size, 0 if the body is malformed
+     *
+     */
+    static size_t OriginalSize(const char* body, size_t size) {
+        if (size < sizeof(uint32_t)) {
+            return 0;
+        }
+        uint32_t original;
+        std::memcpy(&original, body, sizeof(original));
+        return original <= MAX_BODY_SIZE ? original : 0;
+    }
+
+    /** \brief Decompress a body
+     *
+     * \param body const char* the compressed body, without the tag
+     * \param size size_t the size of the compressed body
+     * \param out char* the buffer of OriginalSize() bytes receiving the body
+     * \return bool false if the body is malformed
+     *
+     */
+    bool Decompress(const char* body, size_t size, char* out) const {
+        auto original = OriginalSize(body, size);
+        return original && codec.Decompress(body + sizeof(uint32_t), size - sizeof(uint32_t), out, original);
+    }
+
+    /** \brief Build the decompressed version of a received message
+     *
+     * The tag must have been removed from the message.
+     *
+     * \param msg Message& the compressed message
+     * \return std::shared_ptr<T> the new message, empty if the body is malformed
+     *
+     */
+    template<class T>
+    std::shared_ptr<T> Expand(Message& msg) const {
+        auto original = OriginalSize(msg.Body(), msg.BodySize());
+        if (! original) {
+            return std::shared_ptr<T>();
+        }
+        auto ret = Message::New<T>(sizeof(Frame) + original);
+        ret->node_data = msg.node_data;
+        *ret->Header() = *msg.Header();
+        ret->Header()->flags &= ~MSG_FLAG_COMPRESSED;
+        ret->Resize(original);
+        if (! Decompress(msg.Body(), msg.BodySize(), ret->Body())) {
+            return std::shared_ptr<T>();
+        }
+        return ret;
+    }
+
+    /** \brief Get the decoder of a dispatch table, expanding the compressed messages
+     *
+     * The other messages are routed unchanged, the malformed ones are dropped. The compressor
+     * must outlive the table.
+     *
+     * \return MessageDispatchTable::decoder_type the decoder
+     *
+     */
+    template<class T>
+    packet_handler::MessageDispatchTable::decoder_type Decoder() const {
+        return [this](std::shared_ptr<Message> msg) -> std::shared_ptr<Message> {
+            if (! IsCompressed(msg->Header())) {
+                return msg;
+            }
+            return std::shared_ptr<Message>(Expand<T>(*msg));
+        };
+    }
+
+private:
+    static std::vector<char>& Scratch() {
+        static thread_local std::vector<char> scratch;
+        return scratch;
+    }
+
+    const util::algorithm::LZCodec& codec;
+    const size_t threshold;
+};
+
+} // network
+} // trillek
+
+#endif // PAYLOAD_COMPRESSOR_HPP_INCLUDED
@@ -0,0 +1,594 @@
+#ifndef RELIABLE_CHANNEL_HPP_INCLUDED
+#define RELIABLE_CHANNEL_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "controllers/network/network-metrics.hpp"
+
+namespace trillek {
+namespace network {
+
+/** \brief Reliable delivery of messages over an unreliable datagram transport
+ *
+ * Each datagram has a sequence number and acknowledges the last datagram received
+ * with a bitfield of the 32 previous ones (selective acknowledgment), so that a single
+ * datagram received acknowledges several ones and the losses are detected without timeout.
+ * The messages of a datagram are acknowledged with it and are sent again in new datagrams when
+ * it is lost. A datagram is lost when 3 later datagrams were acknowledged, or after the
+ * retransmission timeout, computed from the round-trip time as in RFC 6298.
+ *
+ * The number of bytes in flight is limited by a congestion window managed as in TCP NewReno:
+ * slow start, then additive increase and multiplicative decrease on losses, once per round trip.
+ * On a retransmission timeout, the window restarts from one datagram.
+ * The datagrams are paced at 1.25 window per round trip (2 in slow start), so that a window is not
+ * sent as a burst.
+ *
+ * Messages are sent on the ORDERED channel, delivered in the order they were sent, or on the
+ * UNORDERED channel, delivered as soon as they arrive. Both are reliable and without duplicates.
+ * The receiver accepts the messages up to MESSAGE_WINDOW ids beyond the oldest one it is missing,
+ * a datagram carrying a message further away is malformed.
+ *
+ * The sequence numbers and the message ids wrap around: they are compared modulo 2^32, which is
+ * valid since the values in use at a given time are within a window.
+ *
+ * The channel does no I/O: Update() produces the datagrams to send and Receive() processes the
+ * datagrams received, so it is used with any socket, usually through a DatagramBatch.
+ * The times are in microseconds, from any origin. The round-trip times and the retransmissions
+ * are recorded in the metrics of the connection, if set.
+ *
+ * Not thread-safe: each connection has its own channel, used by its network thread.
+ */
+class ReliableChannel final {
+public:
+    enum class Mode : uint8_t { ORDERED = 0, UNORDERED = 1 };
+
+    // maximal number of messages sent and not acknowledged, per mode
+    static const uint32_t MESSAGE_WINDOW = 1024;
+
+    /** \brief Constructor
+     *
+     * \param mtu size_t the maximal size of a datagram
+     * \param first_id uint32_t the id of the first message and the first sequence number, the same on both sides
+     *
+     */
+    ReliableChannel(size_t mtu = 1200, uint32_t first_id = 0) :
+        mtu(mtu), next_sequence(first_id), has_received(false), received_sequence(0), received_bits(0), ack_pending(false),
+        srtt(0), rttvar(0), rto(INITIAL_RTO), largest_acked(0), has_acked(false),
+        cwnd(INITIAL_WINDOW * mtu), ssthresh(SIZE_MAX), in_flight(0), recovery_sequence(0), in_recovery(false),
+        next_send_time(0), sent_datagrams(0), retransmissions(0), lost_datagrams(0), metrics(nullptr) {
+        next_id[0] = next_id[1] = first_id;
+        acked_base[0] = acked_base[1] = first_id;
+        expected_id = first_id;
+        unordered_base = first_id;
+    }
+
+    /** \brief Set the metrics to update
+     *
+     * \param metrics ConnectionMetrics* the metrics of the connection, nullptr to update none
+     *
+     */
+    void SetMetrics(ConnectionMetrics* metrics) {
+        this->metrics = metrics;
+    }
+
+    /// Get the biggest message that can be sent
+    size_t MaxMessageSize() const {
+        return mtu - sizeof(DatagramHeader) - sizeof(MessageHeader);
+    }
+
+    /** \brief Queue a message
+     *
+     * \param mode Mode the channel
+     * \param data const char* the message
+     * \param size size_t the size of the message
+     * \return bool false if the message is bigger than MaxMessageSize()
+     *
+     */
+    bool Send(Mode mode, const char* data, size_t size) {
+        if (size > MaxMessageSize()) {
+            return false;
+        }
+        auto m = static_cast<size_t>(mode);
+        auto id = next_id[m]++;
+        auto& message = outgoing[m][id];
+        message.data.assign(data, size);
+        pending[m].push_back(id);
+        return true;
+    }
+
+    /** \brief Produce the datagrams to send now
+     *
+     * \param now uint64_t the current time
+     * \param sink the function called as sink(const char* data, size_t size) for each datagram
+     * \return size_t the number of datagrams
+     *
+     */
+    template<class Sink>
+    size_t Update(uint64_t now, Sink&& sink) {
+        DetectTimeouts(now);
+        size_t count = 0;
+        std::string datagram;
+        // after an idle period, at most a quarter of round trip can be sent at once
+        if (next_send_time + srtt / 4 < now) {
+            next_send_time = now - srtt / 4;
+        }
+        while (next_send_time <= now) {
+            if (in_flight && in_flight + mtu > cwnd) {
+                break;
+            }
+            std::vector<MessageRef> contents;
+            datagram.clear();
+            datagram.resize(sizeof(DatagramHeader));
+            Fill(datagram, contents);
+            if (contents.empty()) {
+                break;
+            }
+            Emit(now, datagram, contents, sink);
+            ++count;
+            // pacing: the window is spread over the round trip, faster in slow start to let it grow
+            next_send_time += srtt * datagram.size() * (cwnd < ssthresh ? 2 : 4) / (cwnd * (cwnd < ssthresh ? 4 : 5));
+        }
+        if (ack_pending) {
+            // acknowledgment alone, not tracked
+            datagram.clear();
+            datagram.resize(sizeof(DatagramHeader));
+            std::vector<MessageRef> contents;
+            Emit(now, datagram, contents, sink);
+            ++count;
+        }
+        return count;
+    }
+
+    /** \brief Process a datagram received
+     *
+     * \param now uint64_t the current time
+     * \param data const char* the datagram
+     * \param size size_t the size of the datagram
+     * \return bool false if the datagram is malformed
+     *
+     */
+    bool Receive(uint64_t now, const char* data, size_t size) {
+        if (size < sizeof(DatagramHeader)) {
+            return false;
+        }
+        DatagramHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        if (header.flags & FLAG_HAS_ACK) {
+            ProcessAcks(now, header.ack, header.ack_bits);
+        }
+        auto p = data + sizeof(header);
+        auto end = data + size;
+        if (p == end) {
+            // acknowledgment only
+            return true;
+        }
+        auto duplicate = ! RecordReceived(header.sequence);
+        ack_pending = true;
+        bool valid = true;
+        while (p < end) {
+            if (static_cast<size_t>(end - p) < sizeof(MessageHeader)) {
+                return false;
+            }
+            MessageHeader mh;
+            std::memcpy(&mh, p, sizeof(mh));
+            p += sizeof(mh);
+            if (static_cast<size_t>(end - p) < mh.length || mh.mode > 1) {
+                return false;
+            }
+            if (! duplicate && ! Accept(static_cast<Mode>(mh.mode), mh.id, p, mh.length)) {
+                valid = false;
+            }
+            p += mh.length;
+        }
+        return valid;
+    }
+
+    /** \brief Get the next message delivered
+     *
+     * \param mode Mode& the channel of the message
+     * \param data std::string& the message
+     * \return bool false if there is no message
+     *
+     */
+    bool Pop(Mode& mode, std::string& data) {
+        if (delivered.empty()) {
+            return false;
+        }
+        mode = delivered.front().first;
+        data = std::move(delivered.front().second);
+        delivered.pop_front();
+        return true;
+    }
+
+    /// Tell if all the messages were acknowledged
+    bool Idle() const {
+        return outgoing[0].empty() && outgoing[1].empty();
+    }
+
+    /// Get the smoothed round-trip time
+    uint64_t Rtt() const {
+        return srtt;
+    }
+
+    /// Get the retransmission timeout
+    uint64_t Rto() const {
+        return rto;
+    }
+
+    /// Get the congestion window in bytes
+    size_t Window() const {
+        return cwnd;
+    }
+
+    /// Get the number of bytes sent and not acknowledged
+    size_t InFlight() const {
+        return in_flight;
+    }
+
+    size_t SentDatagrams() const {
+        return sent_datagrams;
+    }
+
+    size_t LostDatagrams() const {
+        return lost_datagrams;
+    }
+
+    size_t Retransmissions() const {
+        return retransmissions;
+    }
+
+private:
+    static const uint8_t FLAG_HAS_ACK = 1;
+    // number of datagrams acknowledged after a datagram for it to be lost
+    static const uint32_t REORDER_THRESHOLD = 3;
+    static const uint64_t INITIAL_RTO = 200000;
+    static const uint64_t MIN_RTO = 10000;
+    static const uint64_t MAX_RTO = 2000000;
+    static const size_t INITIAL_WINDOW = 4;
+
+#pragma pack(push)
+#pragma pack(1)
+    struct DatagramHeader {
+        uint32_t sequence;
+        uint32_t ack;           // last sequence received
+        uint32_t ack_bits;      // bit i set if ack - 1 - i was received
+        uint8_t flags;
+    };
+
+    struct MessageHeader {
+        uint8_t mode;
+        uint32_t id;
+        uint16_t length;
+    };
+#pragma pack(pop)
+
+    typedef std::pair<size_t,uint32_t> MessageRef;
+
+    struct Outgoing {
+        Outgoing() : datagrams(0), sent(false) {}
+        std::string data;
+        // number of datagrams in flight carrying the message
+        uint32_t datagrams;
+        bool sent;
+    };
+
+    struct SentDatagram {
+        uint64_t time;
+        size_t size;
+        std::vector<MessageRef> messages;
+    };
+
+    static bool Before(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b) < 0;
+    }
+
+    // order of the sequence numbers and of the ids, across the wraparound
+    struct SequenceLess {
+        bool operator()(uint32_t a, uint32_t b) const {
+            return Before(a, b);
+        }
+    };
+
+    typedef std::map<uint32_t,SentDatagram,SequenceLess> DatagramMap;
+
+    /** \brief Put the messages to send in a datagram, the lost ones first
+     *
+     */
+    void Fill(std::string& datagram, std::vector<MessageRef>& contents) {
+        for (size_t m = 0; m < 2; ++m) {
+            auto it = pending[m].begin();
+            while (it != pending[m].end()) {
+                auto id = *it;
+                auto message = outgoing[m].find(id);
+                if (message == outgoing[m].end()) {
+                    // acknowledged in the meantime
+                    it = pending[m].erase(it);
+                    continue;
+                }
+                if (id - acked_base[m] >= MESSAGE_WINDOW) {
+                    // the receiver could not buffer it
+                    break;
+                }
+                auto size = sizeof(MessageHeader) + message->second.data.size();
+                if (datagram.size() + size > mtu) {
+                    return;
+                }
+                MessageHeader mh;
+                mh.mode = static_cast<uint8_t>(m);
+                mh.id = id;
+                mh.length = static_cast<uint16_t>(message->second.data.size());
+                datagram.append(reinterpret_cast<const char*>(&mh), sizeof(mh));
+                datagram.append(message->second.data);
+                if (message->second.sent) {
+                    ++retransmissions;
+                    if (metrics) {
+                        metrics->Retransmitted();
+                    }
+                }
+                message->second.sent = true;
+                ++message->second.datagrams;
+                contents.emplace_back(m, id);
+                it = pending[m].erase(it);
+            }
+        }
+    }
+
+    template<class Sink>
+    void Emit(uint64_t now, std::string& datagram, std::vector<MessageRef>& contents, Sink& sink) {
+        DatagramHeader header;
+        header.sequence = next_sequence;
+        header.ack = received_sequence;
+        header.ack_bits = received_bits;
+        header.flags = has_received ? FLAG_HAS_ACK : 0;
+        std::memcpy(&datagram[0], &header, sizeof(header));
+        if (! contents.empty()) {
+            auto& sent = in_flight_datagrams[next_sequence++];
+            sent.time = now;
+            sent.size = datagram.size();
+            sent.messages = std::move(contents);
+            in_flight += datagram.size();
+            ++sent_datagrams;
+        }
+        ack_pending = false;
+        sink(static_cast<const char*>(datagram.data()), datagram.size());
+    }
+
+    /** \brief Record the sequence of a datagram received
+     *
+     * \return bool false if it was already received
+     *
+     */
+    bool RecordReceived(uint32_t sequence) {
+        if (! has_received) {
+            has_received = true;
+            received_sequence = sequence;
+            received_bits = 0;
+            return true;
+        }
+        if (sequence == received_sequence) {
+            return false;
+        }
+        if (Before(received_sequence, sequence)) {
+            auto shift = sequence - received_sequence;
+            received_bits = shift >= 32 ? 0 : (received_bits << shift);
+            if (shift <= 32) {
+                received_bits |= 1U << (shift - 1);
+            }
+            received_sequence = sequence;
+            return true;
+        }
+        auto distance = received_sequence - sequence;
+        if (distance > 32) {
+            // too old to be acknowledged: the messages are accepted, duplicates are filtered by id
+            return true;
+        }
+        auto bit = 1U << (distance - 1);
+        if (received_bits & bit) {
+            return false;
+        }
+        received_bits |= bit;
+        return true;
+    }
+
+    /** \brief Deliver or buffer a message received
+     *
+     * \return bool false if the id is beyond the window
+     *
+     */
+    bool Accept(Mode mode, uint32_t id, const char* data, size_t size) {
+        if (mode == Mode::ORDERED) {
+            if (! Before(id, expected_id + MESSAGE_WINDOW)) {
+                return false;
+            }
+            if (Before(id, expected_id) || reorder_buffer.count(id)) {
+                return true;
+            }
+            reorder_buffer[id].assign(data, size);
+            for (auto it = reorder_buffer.find(expected_id); it != reorder_buffer.end(); it = reorder_buffer.find(expected_id)) {
+                delivered.emplace_back(Mode::ORDERED, std::move(it->second));
+                reorder_buffer.erase(it);
+                ++expected_id;
+            }
+            return true;
+        }
+        if (! Before(id, unordered_base + MESSAGE_WINDOW)) {
+            return false;
+        }
+        if (Before(id, unordered_base) || ! unordered_received.insert(id).second) {
+            return true;
+        }
+        delivered.emplace_back(Mode::UNORDERED, std::string(data, size));
+        while (unordered_received.count(unordered_base)) {
+            unordered_received.erase(unordered_base++);
+        }
+        return true;
+    }
+
+    void ProcessAcks(uint64_t now, uint32_t ack, uint32_t ack_bits) {
+        size_t acked_bytes = 0;
+        bool newest_sampled = false;
+        for (uint32_t i = 0; i <= 32; ++i) {
+            if (i && ! (ack_bits & (1U << (i - 1)))) {
+                continue;
+            }
+            auto sequence = ack - i;
+            auto it = in_flight_datagrams.find(sequence);
+            if (it == in_flight_datagrams.end()) {
+                continue;
+            }
+            if (! newest_sampled) {
+                UpdateRtt(now - it->second.time);
+                newest_sampled = true;
+            }
+            acked_bytes += it->second.size;
+            Acknowledge(it);
+        }
+        if (! has_acked || Before(largest_acked, ack)) {
+            largest_acked = ack;
+            has_acked = true;
+        }
+        if (acked_bytes) {
+            if (in_recovery && ! Before(largest_acked, recovery_sequence)) {
+                in_recovery = false;
+            }
+            if (2 * (in_flight + acked_bytes) < cwnd) {
+                // limited by the application, not by the window: it is not validated (RFC 7661)
+            }
+            else if (cwnd < ssthresh) {
+                cwnd += acked_bytes;
+            }
+            else {
+                cwnd += std::max<size_t>(1, mtu * acked_bytes / cwnd);
+            }
+        }
+        // datagrams sent before 3 acknowledged datagrams are lost
+        bool lost = false;
+        for (auto it = in_flight_datagrams.begin(); it != in_flight_datagrams.end();) {
+            if (! Before(it->first + REORDER_THRESHOLD - 1, largest_acked)) {
+                break;
+            }
+            it = Lose(it);
+            lost = true;
+        }
+        if (lost && ! in_recovery) {
+            // once per round trip
+            in_recovery = true;
+            recovery_sequence = next_sequence;
+            ssthresh = std::max<size_t>(cwnd / 2, 2 * mtu);
+            cwnd = ssthresh;
+        }
+    }
+
+    void DetectTimeouts(uint64_t now) {
+        auto flight = in_flight;
+        bool timeout = false;
+        for (auto it = in_flight_datagrams.begin(); it != in_flight_datagrams.end();) {
+            if (it->second.time + rto > now) {
+                ++it;
+                continue;
+            }
+            it = Lose(it);
+            timeout = true;
+        }
+        if (timeout) {
+            // the path may have changed: slow start again from one datagram (RFC 5681)
+            ssthresh = std::max<size_t>(flight / 2, 2 * mtu);
+            cwnd = mtu;
+            in_recovery = true;
+            recovery_sequence = next_sequence;
+            // exponential backoff
+            rto = std::min(rto * 2, static_cast<uint64_t>(MAX_RTO));
+        }
+    }
+
+    void Acknowledge(DatagramMap::iterator it) {
+        in_flight -= it->second.size;
+        for (const auto& ref : it->second.messages) {
+            auto& messages = outgoing[ref.first];
+            messages.erase(ref.second);
+            acked_base[ref.first] = messages.empty() ? next_id[ref.first] : messages.begin()->first;
+        }
+        in_flight_datagrams.erase(it);
+    }
+
+    DatagramMap::iterator Lose(DatagramMap::iterator it) {
+        in_flight -= it->second.size;
+        ++lost_datagrams;
+        for (const auto& ref : it->second.messages) {
+            auto message = outgoing[ref.first].find(ref.second);
+            if (message != outgoing[ref.first].end() && ! --message->second.datagrams) {
+                // sent again before the new messages
+                auto& queue = pending[ref.first];
+                queue.insert(std::lower_bound(queue.begin(), queue.end(), ref.second,
+                    [](uint32_t a, uint32_t b) { return Before(a, b); }), ref.second);
+            }
+        }
+        return in_flight_datagrams.erase(it);
+    }
+
+    void UpdateRtt(uint64_t sample) {
+        if (metrics) {
+            metrics->RoundTrip(sample);
+        }
+        if (! srtt) {
+            srtt = sample ? sample : 1;
+            rttvar = sample / 2;
+        }
+        else {
+            auto delta = srtt > sample ? srtt - sample : sample - srtt;
+            rttvar = (3 * rttvar + delta) / 4;
+            srtt = (7 * srtt + sample) / 8;
+        }
+        // MIN_RTO is also the granularity of the clock of RFC 6298, as the channel is updated by ticks
+        rto = std::min(static_cast<uint64_t>(MAX_RTO), srtt + std::max(static_cast<uint64_t>(MIN_RTO), 4 * rttvar));
+    }
+
+    const size_t mtu;
+    // sender
+    uint32_t next_sequence;
+    uint32_t next_id[2];
+    // oldest message not acknowledged
+    uint32_t acked_base[2];
+    std::map<uint32_t,Outgoing,SequenceLess> outgoing[2];
+    // messages to send, by id
+    std::deque<uint32_t> pending[2];
+    DatagramMap in_flight_datagrams;
+    // receiver
+    bool has_received;
+    uint32_t received_sequence;
+    uint32_t received_bits;
+    bool ack_pending;
+    uint32_t expected_id;
+    std::map<uint32_t,std::string,SequenceLess> reorder_buffer;
+    uint32_t unordered_base;
+    std::set<uint32_t,SequenceLess> unordered_received;
+    std::deque<std::pair<Mode,std::string>> delivered;
+    // round trip and congestion
+    uint64_t srtt;
+    uint64_t rttvar;
+    uint64_t rto;
+    uint32_t largest_acked;
+    bool has_acked;
+    size_t cwnd;
+    size_t ssthresh;
+    size_t in_flight;
+    uint32_t recovery_sequence;
+    bool in_recovery;
+    uint64_t next_send_time;
+    // statistics
+    size_t sent_datagrams;
+    size_t retransmissions;
+    size_t lost_datagrams;
+    ConnectionMetrics* metrics;
+};
+
+} // network
+} // trillek
+
+#endif // RELIABLE_CHANNEL_HPP_INCLUDED
@@ -12,8 +12,8 @@ namespace network {
 
 class UDPReliableMessage final : public Message {
 public:
-    typedef memory::StreamAllocator<UDP_RELIABLE_BUFFER_SIZE> raw_allocator_type;
-    typedef TrillekAllocator<char, raw_allocator_type> allocator_type;
+    typedef memory::StreamAllocator<UDP_RELIABLE_BUFFER_SIZE,true> raw_allocator_type;
+    typedef TrillekAllocator<char, raw_allocator_type, memory::AllocationTag::NETWORK> allocator_type;
     typedef std::vector<char, allocator_type> vector_type;
 
     UDPReliableMessage(vector_type buffer, size_t size, const ConnectionData* cnxd = nullptr, socket_t fd = -1)
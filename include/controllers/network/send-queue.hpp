@@ -0,0 +1,225 @@
+#ifndef SEND_QUEUE_HPP_INCLUDED
+#define SEND_QUEUE_HPP_INCLUDED
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "controllers/network/message.hpp"
+#include "controllers/network/network-metrics.hpp"
+
+namespace trillek {
+namespace network {
+
+/** \brief Queue of frames to send on a stream socket with scatter-gather I/O
+ *
+ * A frame is sent as 2 parts without being copied: the message buffer, holding the length,
+ * the header and the payload, and the authentication tag, stored in the queue.
+ * Flush() sends all the frames queued with a single sendmsg() call of up to IOV_MAX parts.
+ *
+ * The queue keeps a reference on each message until it is completely sent. If the socket
+ * accepts only a part of the data, the rest is sent by the next call to Flush().
+ *
+ * The frames completely sent are counted in the metrics of the connection, if set.
+ *
+ * Not thread-safe: each connection has its own queue, flushed by a single thread.
+ */
+class SendQueue final {
+public:
+    // the biggest tag supported
+    static const size_t MAX_TAG_SIZE = ESIGN_SIZE;
+
+    SendQueue() : offset(0), queued_bytes(0), iov_bytes(0), metrics(nullptr) {}
+
+    /** \brief Set the metrics to update
+     *
+     * \param metrics ConnectionMetrics* the metrics of the connection, nullptr to update none
+     *
+     */
+    void SetMetrics(ConnectionMetrics* metrics) {
+        this->metrics = metrics;
+    }
+
+    /** \brief Queue a prepared message
+     *
+     * The header of the message is filled and the tag is computed over the header and the payload by
+     * hasher(tag, data, size), where tag points on tag_size bytes. The tag is not appended to the
+     * message buffer.
+     *
+     * \param msg std::shared_ptr<Message> the message
+     * \param major uint8_t the major code
+     * \param minor uint8_t the minor code
+     * \param hasher the tag generator
+     * \param tag_size size_t the size of the tag
+     *
+     */
+    template<class Hasher>
+    void Push(std::shared_ptr<Message> msg, uint8_t major, uint8_t minor, Hasher&& hasher, size_t tag_size) {
+        auto header = msg->Header();
+        header->type_major = major;
+        header->type_minor = minor;
+        msg->FrameHeader()->length = static_cast<uint32_t>(msg->PacketSize() + tag_size - sizeof(Frame_hdr));
+        auto data = reinterpret_cast<const char*>(msg->FrameHeader());
+        auto size = msg->PacketSize();
+        auto& entry = Append(std::move(msg), data, size, nullptr, tag_size);
+        hasher(entry.tag, reinterpret_cast<const uint8_t*>(data + sizeof(Frame_hdr)), size - sizeof(Frame_hdr));
+    }
+
+    /** \brief Queue a buffer followed by a tag
+     *
+     * \param owner std::shared_ptr<const void> the object owning the buffer, kept until the data is sent
+     * \param data const char* the buffer
+     * \param size size_t the size of the buffer
+     * \param tag const uint8_t* the tag to copy, or nullptr to fill it later
+     * \param tag_size size_t the size of the tag, at most MAX_TAG_SIZE
+     *
+     */
+    void Push(std::shared_ptr<const void> owner, const char* data, size_t size, const uint8_t* tag, size_t tag_size) {
+        Append(std::move(owner), data, size, tag, tag_size);
+    }
+
+    /** \brief Send the frames queued
+     *
+     * \param fd socket_t the socket
+     * \return int the number of bytes sent, -1 on error
+     *
+     */
+    int Flush(socket_t fd) {
+        size_t total = 0;
+        while (! entries.empty()) {
+            BuildIov();
+            msghdr header;
+            std::memset(&header, 0, sizeof(header));
+            header.msg_iov = iov.data();
+            header.msg_iovlen = iov.size();
+#if defined(MSG_NOSIGNAL)
+            auto ret = sendmsg(fd, &header, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            auto ret = sendmsg(fd, &header, MSG_DONTWAIT);
+#endif
+            if (ret < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    break;
+                }
+                LOGMSG(ERROR) << "SendQueue: could not send frames to fd = " << fd << ": " << std::strerror(errno);
+                return -1;
+            }
+            Consume(static_cast<size_t>(ret));
+            total += ret;
+            if (static_cast<size_t>(ret) < iov_bytes) {
+                // the socket buffer is full
+                break;
+            }
+        }
+        return static_cast<int>(total);
+    }
+
+    /// Tell if all the frames were sent
+    bool Empty() const {
+        return entries.empty();
+    }
+
+    /// Get the number of frames waiting, including a frame partially sent
+    size_t Frames() const {
+        return entries.size();
+    }
+
+    /// Get the number of bytes waiting
+    size_t Bytes() const {
+        return queued_bytes - offset;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const void> owner;
+        const char* data;
+        size_t size;
+        uint8_t tag[MAX_TAG_SIZE];
+        size_t tag_size;
+    };
+
+    Entry& Append(std::shared_ptr<const void> owner, const char* data, size_t size, const uint8_t* tag, size_t tag_size) {
+        assert(tag_size <= MAX_TAG_SIZE);
+        entries.emplace_back();
+        auto& entry = entries.back();
+        entry.owner = std::move(owner);
+        entry.data = data;
+        entry.size = size;
+        entry.tag_size = tag_size;
+        if (tag) {
+            std::memcpy(entry.tag, tag, tag_size);
+        }
+        queued_bytes += size + tag_size;
+        return entry;
+    }
+
+    /** \brief Build the parts to send, starting after the bytes already sent
+     *
+     */
+    void BuildIov() {
+        iov.clear();
+        iov_bytes = 0;
+        auto skip = offset;
+        for (auto& entry : entries) {
+            if (iov.size() + 2 > IOV_LIMIT) {
+                break;
+            }
+            Add(entry.data, entry.size, skip);
+            Add(reinterpret_cast<const char*>(entry.tag), entry.tag_size, skip);
+        }
+    }
+
+    void Add(const char* data, size_t size, size_t& skip) {
+        if (skip >= size) {
+            skip -= size;
+            return;
+        }
+        iovec part;
+        part.iov_base = const_cast<char*>(data + skip);
+        part.iov_len = size - skip;
+        iov.push_back(part);
+        iov_bytes += part.iov_len;
+        skip = 0;
+    }
+
+    /** \brief Remove the frames sent
+     *
+     */
+    void Consume(size_t sent) {
+        offset += sent;
+        while (! entries.empty()) {
+            auto frame_size = entries.front().size + entries.front().tag_size;
+            if (offset < frame_size) {
+                break;
+            }
+            offset -= frame_size;
+            queued_bytes -= frame_size;
+            entries.pop_front();
+            if (metrics) {
+                metrics->Sent(frame_size);
+            }
+        }
+    }
+
+#if defined(IOV_MAX)
+    static const size_t IOV_LIMIT = IOV_MAX;
+#else
+    static const size_t IOV_LIMIT = 1024;
+#endif
+
+    std::deque<Entry> entries;
+    // bytes of the first entry already sent
+    size_t offset;
+    size_t queued_bytes;
+    std::vector<iovec> iov;
+    size_t iov_bytes;
+    ConnectionMetrics* metrics;
+};
+
+} // network
+} // trillek
+
+#endif // SEND_QUEUE_HPP_INCLUDED
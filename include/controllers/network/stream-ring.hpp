@@ -0,0 +1,311 @@
+#ifndef STREAM_RING_HPP_INCLUDED
+#define STREAM_RING_HPP_INCLUDED
+
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+#include "controllers/network/message.hpp"
+#include "controllers/network/network-metrics.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace trillek {
+namespace network {
+
+/** \brief A complete frame in a StreamRing
+ *
+ * The view points in the ring and remains valid until it is released.
+ */
+struct FrameView {
+    FrameView() : data(nullptr), size(0) {}
+
+    /// Get the header of the message
+    const msg_hdr* Header() const {
+        return reinterpret_cast<const msg_hdr*>(data + sizeof(Frame_hdr));
+    }
+
+    /// Get the body of the message, after the header
+    const char* Body() const {
+        return data + sizeof(Frame);
+    }
+
+    /// Get the size of the body, without the tag of tag_size bytes
+    size_t BodySize(size_t tag_size) const {
+        return size - sizeof(Frame) - tag_size;
+    }
+
+    /// Get the tag of tag_size bytes at the end of the frame
+    const uint8_t* Tag(size_t tag_size) const {
+        return reinterpret_cast<const uint8_t*>(data + size - tag_size);
+    }
+
+    // the first byte of the frame, i.e the length
+    const char* data;
+    // the size of the frame, including the length
+    size_t size;
+};
+
+enum class FrameStatus {
+    INCOMPLETE,     // more data is needed
+    COMPLETE,       // a frame is available
+    TOO_BIG         // the frame does not fit in the ring, the connection must be closed
+};
+
+/** \brief Receive buffer of a TCP connection
+ *
+ * The data read from the socket is written in a ring and the frames are parsed in place:
+ * NextFrame() returns views on the complete frames, without copy nor allocation. The frames must be
+ * released in the order they were returned, when they are no more used.
+ *
+ * On Linux, the memory of the ring is mapped twice at consecutive addresses, so that
+ * the data crossing the end of the ring is contiguous. Elsewhere, or if the mapping fails,
+ * the data is moved to the beginning of the buffer when there is no contiguous space left.
+ *
+ * The frames returned are counted in the metrics of the connection, if set, with the time
+ * taken to receive them completely.
+ *
+ * Not thread-safe, but a view may be read by another thread until it is released.
+ */
+class StreamRing final {
+public:
+    /** \brief Constructor
+     *
+     * \param size size_t the minimal size of the ring, rounded up to the page size when mirrored
+     *
+     */
+    StreamRing(size_t size = 1 << 16) : capacity(size), mirrored(false), shift(0), read(0), parsed(0), written(0),
+        metrics(nullptr), frame_start(0) {
+        Map();
+    }
+
+    ~StreamRing() {
+        Unmap();
+    }
+
+    // views point in the ring
+    StreamRing(const StreamRing&) = delete;
+    StreamRing& operator=(const StreamRing&) = delete;
+
+    /** \brief Set the metrics to update
+     *
+     * \param metrics ConnectionMetrics* the metrics of the connection, nullptr to update none
+     *
+     */
+    void SetMetrics(ConnectionMetrics* metrics) {
+        this->metrics = metrics;
+    }
+
+    /** \brief Read the data available on a socket
+     *
+     * \param fd socket_t the socket
+     * \return int the number of bytes read, 0 if the peer closed the connection, -1 on error
+     * or if the ring is full. When no data is available, EAGAIN is set in errno and -1 is returned.
+     *
+     */
+    int Receive(socket_t fd) {
+        size_t total = 0;
+        for (auto ptr = WritePointer(); Free(); ptr = WritePointer()) {
+            auto ret = recv(fd, ptr, Free(), MSG_DONTWAIT);
+            if (ret <= 0) {
+                if (total) {
+                    break;
+                }
+                return static_cast<int>(ret);
+            }
+            Commit(static_cast<size_t>(ret));
+            total += ret;
+        }
+        if (! total) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        return static_cast<int>(total);
+    }
+
+    /** \brief Get the address where to write new data
+     *
+     * Free() bytes can be written contiguously at this address. Without mirror, the
+     * data is moved to the beginning of the buffer first if less than half of it is free
+     * at the end and no frame is in use.
+     *
+     * \return char* the pointer
+     *
+     */
+    char* WritePointer() {
+        if (! mirrored && read != shift && parsed == read && Free() < capacity / 2) {
+            Compact();
+        }
+        return base + Offset(written);
+    }
+
+    /** \brief Get the number of bytes that can be written contiguously at WritePointer()
+     *
+     */
+    size_t Free() const {
+        if (mirrored) {
+            return capacity - (written - read);
+        }
+        return capacity - (written - shift);
+    }
+
+    /** \brief Tell that data was written at WritePointer()
+     *
+     * \param n size_t the number of bytes written
+     *
+     */
+    void Commit(size_t n) {
+        written += n;
+    }
+
+    /** \brief Get the next complete frame
+     *
+     * \param view FrameView& the view on the frame, set when COMPLETE is returned
+     * \return FrameStatus the status
+     *
+     */
+    FrameStatus NextFrame(FrameView& view) {
+        auto available = written - parsed;
+        if (available < sizeof(Frame_hdr)) {
+            return Incomplete(available);
+        }
+        auto data = base + Offset(parsed);
+        Frame_hdr header;
+        std::memcpy(&header, data, sizeof(Frame_hdr));
+        auto size = sizeof(Frame_hdr) + static_cast<size_t>(header.length);
+        if (size > capacity || header.length < sizeof(msg_hdr)) {
+            return FrameStatus::TOO_BIG;
+        }
+        if (available < size) {
+            return Incomplete(available);
+        }
+        view.data = data;
+        view.size = size;
+        parsed += size;
+        if (metrics) {
+            metrics->Received(size);
+            metrics->Reassembled(frame_start ? Now() - frame_start : 0);
+            frame_start = 0;
+        }
+        return FrameStatus::COMPLETE;
+    }
+
+    /** \brief Release the oldest frame returned by NextFrame()
+     *
+     * \param view const FrameView& the view
+     *
+     */
+    void Release(const FrameView& view) {
+        assert(view.data == base + Offset(read));
+        read += view.size;
+        if (read == written) {
+            // empty ring, restart at the beginning to avoid moving data
+            read = parsed = written = shift = 0;
+        }
+    }
+
+    /// Get the number of bytes received and not released
+    size_t Used() const {
+        return written - read;
+    }
+
+    size_t Capacity() const {
+        return capacity;
+    }
+
+    /// Tell if the ring is mapped twice in memory
+    bool Mirrored() const {
+        return mirrored;
+    }
+
+private:
+    size_t Offset(size_t position) const {
+        return mirrored ? position % capacity : position - shift;
+    }
+
+    static uint64_t Now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    FrameStatus Incomplete(size_t available) {
+        if (metrics && available && ! frame_start) {
+            // the frame started to arrive
+            frame_start = Now();
+        }
+        return FrameStatus::INCOMPLETE;
+    }
+
+    /** \brief Move the data at the beginning of the buffer (not mirrored only)
+     *
+     * The views not released would be invalidated, so all the frames parsed must be released.
+     *
+     */
+    void Compact() {
+        std::memmove(base, base + Offset(read), written - read);
+        shift = read;
+    }
+
+    void Map() {
+#if defined(__linux__) && defined(SYS_memfd_create)
+        auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        auto size = (capacity + page - 1) / page * page;
+        auto fd = static_cast<int>(syscall(SYS_memfd_create, "trillek-stream-ring", 0));
+        if (fd != -1) {
+            if (ftruncate(fd, size) == 0) {
+                // reserve the address space, then map the memory twice in it
+                auto area = static_cast<char*>(mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                if (area != MAP_FAILED) {
+                    if (mmap(area, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED
+                        && mmap(area + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED) {
+                        close(fd);
+                        base = area;
+                        capacity = size;
+                        mirrored = true;
+                        return;
+                    }
+                    munmap(area, 2 * size);
+                }
+            }
+            close(fd);
+        }
+#endif
+        buffer.resize(capacity);
+        base = buffer.data();
+        shift = 0;
+    }
+
+    void Unmap() {
+#if defined(__linux__)
+        if (mirrored) {
+            munmap(base, 2 * capacity);
+        }
+#endif
+    }
+
+    size_t capacity;
+    bool mirrored;
+    char* base;
+    // the buffer when not mirrored
+    std::vector<char> buffer;
+    // position of the first byte of the buffer, when not mirrored
+    size_t shift;
+    // positions in the stream of the first byte not released, not parsed, and not written
+    size_t read;
+    size_t parsed;
+    size_t written;
+    ConnectionMetrics* metrics;
+    // time when the first bytes of the frame being received arrived, 0 if none
+    uint64_t frame_start;
+};
+
+} // network
+} // trillek
+
+#endif // STREAM_RING_HPP_INCLUDED
@@ -8,7 +8,7 @@ namespace network {
 
 class UDPMessage final : public Message {
 public:
-    typedef TrillekAllocator<char> allocator_type;
+    typedef Message::allocator_type allocator_type;
     typedef std::vector<char,allocator_type> vector_type;
 
     UDPMessage(vector_type&& buffer, size_t size, const ConnectionData* cnxd = nullptr, socket_t fd = -1)
@@ -34,7 +34,7 @@ public:
     virtual void Send(uint8_t major, uint8_t minor, uint64_t timestamp) final;
 
     static allocator_type GetAllocator() {
-        return allocator_type();
+        return Message::GetAllocator();
     }
 
 private:
@@ -0,0 +1,461 @@
+#ifndef ALLOCATION_TRACE_HPP_INCLUDED
+#define ALLOCATION_TRACE_HPP_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <istream>
+#include <new>
+#include <ostream>
+#include <random>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "trillek.hpp"
+#include "memory/allocation-tracker.hpp"
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace trillek { namespace memory {
+
+/** \brief Synthetic allocation patterns
+ *
+ */
+enum class TracePattern {
+    FRAME,      // blocks released in allocation order after a few frames, e.g messages
+    MIXED       // blocks of various sizes released in random order, e.g components and resources
+};
+
+/** \brief Results of the replay of a trace
+ *
+ */
+struct ReplayReport {
+    // number of allocations and deallocations replayed
+    size_t operations;
+    // time spent in the allocator
+    double seconds;
+    double operations_per_second;
+    // maximal sum of the sizes of the live blocks
+    size_t peak_live_bytes;
+    // maximal number of bytes reserved by the allocator as reported by ReservedBytes(),
+    // rss_growth_bytes if the allocator reports none
+    size_t peak_footprint_bytes;
+    // growth of the resident memory of the process during the replay
+    size_t rss_growth_bytes;
+    // 1 - peak_live_bytes / peak_footprint_bytes, 0 if the footprint is below the live bytes,
+    // e.g the heap reused the memory released before the replay
+    double fragmentation;
+    // allocations that threw std::bad_alloc
+    size_t failures;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const ReplayReport& report) {
+    return os << report.operations << " ops in " << report.seconds * 1000 << " ms ("
+              << static_cast<size_t>(report.operations_per_second) << " ops/s), peak live "
+              << report.peak_live_bytes << " B, peak footprint " << report.peak_footprint_bytes
+              << " B, fragmentation " << report.fragmentation * 100 << " %, RSS growth "
+              << report.rss_growth_bytes << " B, failures " << report.failures;
+}
+
+/** \brief Allocator of the C library, to compare the allocators with malloc()
+ *
+ */
+namespace detail {
+
+template<class Alloc>
+struct ReportsReserved {
+    template<class U> static auto Test(const U* u) -> decltype(u->ReservedBytes(), std::true_type());
+    template<class U> static std::false_type Test(...);
+    static const bool value = decltype(Test<Alloc>(nullptr))::value;
+};
+
+template<class Alloc>
+size_t ReservedBytes(const Alloc& alloc, std::true_type) {
+    return alloc.ReservedBytes();
+}
+
+template<class Alloc>
+size_t ReservedBytes(const Alloc&, std::false_type) {
+    return 0;
+}
+
+} // detail
+
+struct MallocAllocator {
+    MallocAllocator() : heap_start(HeapBytes()) {}
+
+    void* allocate(size_t n) {
+        auto ret = std::malloc(n);
+        if (! ret) {
+            throw std::bad_alloc();
+        }
+        return ret;
+    }
+
+    void deallocate(void* p, size_t) {
+        std::free(p);
+    }
+
+    /// Get the growth of the memory obtained by the C library since the construction, 0 if unknown
+    size_t ReservedBytes() const {
+        auto heap = HeapBytes();
+        return heap > heap_start ? heap - heap_start : 0;
+    }
+
+private:
+    static size_t HeapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        auto info = mallinfo2();
+        return info.arena + info.hblkhd;
+#else
+        return 0;
+#endif
+    }
+
+    size_t heap_start;
+};
+
+/** \brief A sequence of allocations and deallocations
+ *
+ * A trace is recorded from the engine between Start() and Stop(): all the allocations made
+ * through TrillekAllocator by the calling thread are recorded, whatever their tag.
+ * Blocks allocated before Start() are ignored when they are deallocated.
+ *
+ * A trace can also be generated with a deterministic pseudo-random pattern, see Generate().
+ *
+ * Replay() runs the trace against an allocator providing allocate(size_t) and deallocate(p, size_t),
+ * and measures the throughput and the memory used. The memory used is the number of bytes reserved
+ * by the allocator when it provides ReservedBytes(), and the growth of the resident memory otherwise.
+ * The trace must respect the constraints of the allocator: FIFOAllocator and StreamAllocator without
+ * ring mode need a trace for which IsFifo() is true.
+ *
+ * Traces are saved in a text format, one event per line:
+ *  a <id> <size>
+ *  d <id>
+ */
+class AllocationTrace final : public AllocationRecorder {
+public:
+    struct Event {
+        bool allocate;
+        uint32_t id;
+        uint32_t size;
+    };
+
+    AllocationTrace() : recording(false) {}
+
+    ~AllocationTrace() {
+        Stop();
+    }
+
+    AllocationTrace(const AllocationTrace& other) : recording(false), events(other.events), sizes(other.sizes) {}
+
+    AllocationTrace& operator=(const AllocationTrace& other) {
+        Stop();
+        events = other.events;
+        sizes = other.sizes;
+        return *this;
+    }
+
+    /** \brief Record the allocations of the calling thread
+     *
+     */
+    void Start() {
+        recording = true;
+        AllocationTracker::SetRecorder(this);
+    }
+
+    /** \brief Stop the recording
+     *
+     * Must be called by the thread that called Start().
+     *
+     */
+    void Stop() {
+        if (recording) {
+            AllocationTracker::SetRecorder(nullptr);
+            recording = false;
+            live.clear();
+        }
+    }
+
+    void OnAllocate(AllocationTag, const void* p, size_t bytes) override {
+        live[p] = Allocate(bytes);
+    }
+
+    void OnDeallocate(AllocationTag, const void* p, size_t) override {
+        auto it = live.find(p);
+        if (it != live.end()) {
+            Deallocate(it->second);
+            live.erase(it);
+        }
+    }
+
+    /** \brief Append an allocation
+     *
+     * \param bytes size_t the size
+     * \return uint32_t the id of the block
+     *
+     */
+    uint32_t Allocate(size_t bytes) {
+        auto id = static_cast<uint32_t>(sizes.size());
+        sizes.push_back(static_cast<uint32_t>(bytes));
+        events.push_back({ true, id, static_cast<uint32_t>(bytes) });
+        return id;
+    }
+
+    /** \brief Append a deallocation
+     *
+     * \param id uint32_t the id of the block
+     *
+     */
+    void Deallocate(uint32_t id) {
+        events.push_back({ false, id, sizes.at(id) });
+    }
+
+    const std::vector<Event>& Events() const {
+        return events;
+    }
+
+    /** \brief Generate a trace
+     *
+     * The same arguments always produce the same trace. All the blocks are released at the end.
+     *
+     * \param pattern TracePattern the pattern
+     * \param count size_t the number of allocations
+     * \param seed uint32_t the seed of the pseudo-random generator
+     * \return AllocationTrace the trace
+     *
+     */
+    static AllocationTrace Generate(TracePattern pattern, size_t count, uint32_t seed) {
+        AllocationTrace ret;
+        std::mt19937 random(seed);
+        // sizes between 16 and 4096 bytes, small sizes are more frequent
+        auto size = [&random]() {
+            auto size_class = random() % 9;
+            return static_cast<size_t>((16 << size_class) - random() % (8 << size_class));
+        };
+        if (pattern == TracePattern::FRAME) {
+            // each frame allocates some blocks, released 3 frames later
+            std::vector<std::vector<uint32_t>> frames;
+            while (ret.sizes.size() < count) {
+                frames.emplace_back();
+                auto n = (std::min)(static_cast<size_t>(1 + random() % 32), count - ret.sizes.size());
+                for (size_t i = 0; i < n; ++i) {
+                    frames.back().push_back(ret.Allocate(size()));
+                }
+                if (frames.size() > 3) {
+                    for (auto id : frames.front()) {
+                        ret.Deallocate(id);
+                    }
+                    frames.erase(frames.begin());
+                }
+            }
+            for (auto& frame : frames) {
+                for (auto id : frame) {
+                    ret.Deallocate(id);
+                }
+            }
+        }
+        else {
+            // a pool of about 1000 live blocks, a random block is released at each step
+            std::vector<uint32_t> alive;
+            while (ret.sizes.size() < count) {
+                alive.push_back(ret.Allocate(size()));
+                if (alive.size() > 1000 || (alive.size() > 1 && random() % 3 == 0)) {
+                    auto i = random() % alive.size();
+                    ret.Deallocate(alive[i]);
+                    alive[i] = alive.back();
+                    alive.pop_back();
+                }
+            }
+            for (auto id : alive) {
+                ret.Deallocate(id);
+            }
+        }
+        return ret;
+    }
+
+    /** \brief Tell if the blocks are released in the order of allocation
+     *
+     */
+    bool IsFifo() const {
+        uint32_t next = 0;
+        for (auto& event : events) {
+            if (! event.allocate) {
+                if (event.id != next) {
+                    return false;
+                }
+                ++next;
+            }
+        }
+        return true;
+    }
+
+    /** \brief Get the maximal sum of the sizes of the live blocks
+     *
+     */
+    size_t PeakLiveBytes() const {
+        size_t live_bytes = 0;
+        size_t peak = 0;
+        for (auto& event : events) {
+            if (event.allocate) {
+                live_bytes += event.size;
+                peak = (std::max)(peak, live_bytes);
+            }
+            else {
+                live_bytes -= event.size;
+            }
+        }
+        return peak;
+    }
+
+    void Save(std::ostream& os) const {
+        for (auto& event : events) {
+            if (event.allocate) {
+                os << "a " << event.id << " " << event.size << "\n";
+            }
+            else {
+                os << "d " << event.id << "\n";
+            }
+        }
+    }
+
+    /** \brief Load a trace saved by Save()
+     *
+     * \param is std::istream& the stream
+     * \return bool false if the stream is not a valid trace
+     *
+     */
+    bool Load(std::istream& is) {
+        events.clear();
+        sizes.clear();
+        char op;
+        uint32_t id;
+        while (is >> op >> id) {
+            if (op == 'a') {
+                uint32_t size;
+                if (! (is >> size) || id != sizes.size()) {
+                    return false;
+                }
+                Allocate(size);
+            }
+            else if (op == 'd' && id < sizes.size()) {
+                Deallocate(id);
+            }
+            else {
+                return false;
+            }
+        }
+        return is.eof();
+    }
+
+    /** \brief Replay the trace
+     *
+     * The trace is replayed twice: a first time to measure the memory footprint, and a second time
+     * to measure the time spent in the allocator.
+     *
+     * The bytes reserved include the memory the allocator held before the replay, e.g the slabs
+     * carved by the other users of ThreadCacheAllocator.
+     *
+     * \param alloc Alloc& the allocator
+     * \return ReplayReport the results
+     *
+     */
+    template<class Alloc>
+    ReplayReport Replay(Alloc& alloc) const {
+        typedef decltype(alloc.allocate(size_t())) pointer;
+        ReplayReport ret;
+        ret.operations = events.size();
+        ret.failures = 0;
+        std::vector<pointer> blocks(sizes.size(), nullptr);
+        // measured run
+        typedef std::integral_constant<bool,detail::ReportsReserved<Alloc>::value> reports_reserved;
+        size_t live_bytes = 0;
+        auto rss_start = ResidentBytes();
+        size_t rss_peak = rss_start;
+        ret.peak_live_bytes = 0;
+        ret.peak_footprint_bytes = 0;
+        for (size_t i = 0; i < events.size(); ++i) {
+            auto& event = events[i];
+            if (event.allocate) {
+                try {
+                    blocks[event.id] = alloc.allocate(event.size);
+                }
+                catch (const std::bad_alloc&) {
+                    continue;
+                }
+                live_bytes += event.size;
+                ret.peak_live_bytes = (std::max)(ret.peak_live_bytes, live_bytes);
+                ret.peak_footprint_bytes = (std::max)(ret.peak_footprint_bytes, detail::ReservedBytes(alloc, reports_reserved()));
+            }
+            else if (blocks[event.id]) {
+                live_bytes -= event.size;
+                alloc.deallocate(blocks[event.id], event.size);
+            }
+            if (i % 1024 == 0) {
+                rss_peak = (std::max)(rss_peak, ResidentBytes());
+            }
+        }
+        ret.rss_growth_bytes = (std::max)(rss_peak, ResidentBytes()) - rss_start;
+        if (! ret.peak_footprint_bytes) {
+            ret.peak_footprint_bytes = ret.rss_growth_bytes;
+        }
+        ret.fragmentation = ret.peak_footprint_bytes > ret.peak_live_bytes ?
+            1.0 - static_cast<double>(ret.peak_live_bytes) / ret.peak_footprint_bytes : 0;
+        // timed run
+        std::fill(blocks.begin(), blocks.end(), nullptr);
+        auto start = std::chrono::steady_clock::now();
+        for (auto& event : events) {
+            if (event.allocate) {
+                try {
+                    blocks[event.id] = alloc.allocate(event.size);
+                }
+                catch (const std::bad_alloc&) {
+                    ++ret.failures;
+                }
+            }
+            else if (blocks[event.id]) {
+                alloc.deallocate(blocks[event.id], event.size);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        ret.seconds = elapsed.count();
+        ret.operations_per_second = ret.seconds > 0 ? ret.operations / ret.seconds : 0;
+        return ret;
+    }
+
+    /** \brief Get the resident memory of the process
+     *
+     * \return size_t the size in bytes, 0 if unknown
+     *
+     */
+    static size_t ResidentBytes() {
+#if defined(__linux__)
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0;
+        size_t resident = 0;
+        if (statm >> pages >> resident) {
+            return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+#endif
+        return 0;
+    }
+
+private:
+    bool recording;
+    std::vector<Event> events;
+    std::vector<uint32_t> sizes;
+    // id of the live blocks recorded
+    std::unordered_map<const void*,uint32_t> live;
+};
+
+} // memory
+} // trillek
+
+#endif // ALLOCATION_TRACE_HPP_INCLUDED
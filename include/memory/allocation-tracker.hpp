@@ -0,0 +1,277 @@
+#ifndef ALLOCATION_TRACKER_HPP_INCLUDED
+#define ALLOCATION_TRACKER_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "trillek.hpp"
+
+namespace trillek { namespace memory {
+
+/** \brief Statistics of the allocations of a tag
+ *
+ */
+struct AllocationStats {
+    // bytes allocated and not yet deallocated
+    int64_t live_bytes;
+    // maximal value of live_bytes
+    int64_t peak_bytes;
+    // total number of allocations and deallocations
+    uint64_t allocations;
+    uint64_t deallocations;
+    // rates since the previous call to Stats() for this tag
+    double bytes_per_second;
+    double allocations_per_second;
+};
+
+/** \brief Interface of the objects receiving the allocations of a thread
+ *
+ * See AllocationTracker::SetRecorder().
+ */
+class AllocationRecorder {
+public:
+    virtual ~AllocationRecorder() {}
+    virtual void OnAllocate(AllocationTag tag, const void* p, size_t bytes) = 0;
+    virtual void OnDeallocate(AllocationTag tag, const void* p, size_t bytes) = 0;
+};
+
+/** \brief Accounting of the memory allocated by TrillekAllocator
+ *
+ * Allocations are counted by tag, in counters local to each thread. Each counter
+ * is written by a single thread without read-modify-write operation. The counters of
+ * all threads are summed on demand by Stats(). A memory block may be deallocated by
+ * another thread than the one that allocated it, so the counters of a single thread
+ * are meaningless.
+ *
+ * The live bytes of each tag are also kept in a shared counter, so that the peak is
+ * updated with an atomic maximum on each allocation. This costs a relaxed fetch_add
+ * per call, and a compare-and-swap when the peak grows.
+ *
+ * A thread can also forward its allocations to an AllocationRecorder, e.g to record a trace.
+ */
+class AllocationTracker final {
+public:
+    static const size_t TAG_COUNT = static_cast<size_t>(AllocationTag::TAG_COUNT);
+
+    /** \brief Record an allocation
+     *
+     * \param tag AllocationTag the tag
+     * \param p const void* the memory allocated
+     * \param bytes size_t the size allocated
+     *
+     */
+    static void Allocate(AllocationTag tag, const void* p, size_t bytes) {
+        auto& local = Local();
+        auto& counters = local.tags[static_cast<size_t>(tag)];
+        Add(counters.allocated_bytes, bytes);
+        Add(counters.allocations, 1);
+        auto& level = Instance().levels[static_cast<size_t>(tag)];
+        auto live = level.live_bytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+        auto peak = level.peak_bytes.load(std::memory_order_relaxed);
+        while (peak < live && ! level.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+        if (local.recorder) {
+            local.recorder->OnAllocate(tag, p, bytes);
+        }
+    }
+
+    /** \brief Record a deallocation
+     *
+     * \param tag AllocationTag the tag
+     * \param p const void* the memory deallocated
+     * \param bytes size_t the size deallocated
+     *
+     */
+    static void Deallocate(AllocationTag tag, const void* p, size_t bytes) {
+        auto& local = Local();
+        auto& counters = local.tags[static_cast<size_t>(tag)];
+        Add(counters.deallocated_bytes, bytes);
+        Add(counters.deallocations, 1);
+        Instance().levels[static_cast<size_t>(tag)].live_bytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+        if (local.recorder) {
+            local.recorder->OnDeallocate(tag, p, bytes);
+        }
+    }
+
+    /** \brief Forward the allocations of the calling thread to a recorder
+     *
+     * \param recorder AllocationRecorder* the recorder, or nullptr to stop recording
+     *
+     */
+    static void SetRecorder(AllocationRecorder* recorder) {
+        Local().recorder = recorder;
+    }
+
+    /** \brief Get the number of bytes allocated and not deallocated
+     *
+     * \param tag AllocationTag the tag
+     * \return int64_t the live bytes
+     *
+     */
+    static int64_t LiveBytes(AllocationTag tag) {
+        return Instance().levels[static_cast<size_t>(tag)].live_bytes.load(std::memory_order_relaxed);
+    }
+
+    /** \brief Get the number of bytes allocated and not deallocated for all tags
+     *
+     * \return int64_t the live bytes
+     *
+     */
+    static int64_t LiveBytes() {
+        int64_t ret = 0;
+        for (size_t i = 0; i < TAG_COUNT; ++i) {
+            ret += LiveBytes(static_cast<AllocationTag>(i));
+        }
+        return ret;
+    }
+
+    /** \brief Aggregate the counters of a tag
+     *
+     * \param tag AllocationTag the tag
+     * \return AllocationStats the statistics
+     *
+     */
+    static AllocationStats Stats(AllocationTag tag) {
+        auto& instance = Instance();
+        auto total = Sum(tag);
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(instance.registry_m);
+        auto& sample = instance.samples[static_cast<size_t>(tag)];
+        auto& level = instance.levels[static_cast<size_t>(tag)];
+        AllocationStats ret;
+        ret.live_bytes = level.live_bytes.load(std::memory_order_relaxed);
+        ret.peak_bytes = (std::max)(level.peak_bytes.load(std::memory_order_relaxed), ret.live_bytes);
+        ret.allocations = total.allocations;
+        ret.deallocations = total.deallocations;
+        std::chrono::duration<double> elapsed = now - sample.time;
+        if (sample.allocations && elapsed.count() > 0) {
+            ret.bytes_per_second = (total.allocated_bytes - sample.allocated_bytes) / elapsed.count();
+            ret.allocations_per_second = (total.allocations - sample.allocations) / elapsed.count();
+        }
+        else {
+            ret.bytes_per_second = 0;
+            ret.allocations_per_second = 0;
+        }
+        sample.time = now;
+        sample.allocated_bytes = total.allocated_bytes;
+        sample.allocations = total.allocations;
+        return ret;
+    }
+
+    /** \brief Get the name of a tag
+     *
+     */
+    static const char* TagName(AllocationTag tag) {
+        static const char* names[] = { "general", "component", "resource", "network", "scripting" };
+        return names[static_cast<size_t>(tag)];
+    }
+
+private:
+    struct Counters {
+        Counters() : allocated_bytes(0), deallocated_bytes(0), allocations(0), deallocations(0) {}
+        std::atomic<uint64_t> allocated_bytes;
+        std::atomic<uint64_t> deallocated_bytes;
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> deallocations;
+    };
+
+    struct ThreadCounters {
+        ThreadCounters() : recorder(nullptr), orphan(false) {}
+        Counters tags[TAG_COUNT];
+        AllocationRecorder* recorder;
+        bool orphan;
+    };
+
+    struct Level {
+        Level() : live_bytes(0), peak_bytes(0) {}
+        std::atomic<int64_t> live_bytes;
+        std::atomic<int64_t> peak_bytes;
+    };
+
+    struct Total {
+        Total() : allocated_bytes(0), deallocated_bytes(0), allocations(0), deallocations(0) {}
+        uint64_t allocated_bytes;
+        uint64_t deallocated_bytes;
+        uint64_t allocations;
+        uint64_t deallocations;
+    };
+
+    struct Sample {
+        Sample() : allocated_bytes(0), allocations(0) {}
+        uint64_t allocated_bytes;
+        uint64_t allocations;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    static AllocationTracker& Instance() {
+        // never destroyed, static objects may deallocate memory after it
+        static AllocationTracker* instance = new AllocationTracker();
+        return *instance;
+    }
+
+    /** \brief Get the counters of the calling thread
+     *
+     * The counters of a thread that exits are kept and given to the next thread created.
+     *
+     */
+    static ThreadCounters& Local() {
+        struct Holder {
+            Holder(ThreadCounters* counters) : counters(counters) {}
+            ~Holder() {
+                std::lock_guard<std::mutex> lock(Instance().registry_m);
+                counters->recorder = nullptr;
+                counters->orphan = true;
+            }
+            ThreadCounters* counters;
+        };
+        // a plain pointer remains usable during the destruction of the thread
+        static thread_local ThreadCounters* counters = nullptr;
+        if (! counters) {
+            counters = Instance().Adopt();
+            static thread_local Holder holder(counters);
+        }
+        return *counters;
+    }
+
+    /// Increment a counter written by the calling thread only
+    static void Add(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static Total Sum(AllocationTag tag) {
+        auto& instance = Instance();
+        Total ret;
+        std::lock_guard<std::mutex> lock(instance.registry_m);
+        for (auto& thread : instance.threads) {
+            auto& counters = thread->tags[static_cast<size_t>(tag)];
+            ret.allocated_bytes += counters.allocated_bytes.load(std::memory_order_relaxed);
+            ret.deallocated_bytes += counters.deallocated_bytes.load(std::memory_order_relaxed);
+            ret.allocations += counters.allocations.load(std::memory_order_relaxed);
+            ret.deallocations += counters.deallocations.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    ThreadCounters* Adopt() {
+        std::lock_guard<std::mutex> lock(registry_m);
+        for (auto& thread : threads) {
+            if (thread->orphan) {
+                thread->orphan = false;
+                return thread.get();
+            }
+        }
+        threads.emplace_back(new ThreadCounters());
+        return threads.back().get();
+    }
+
+    std::mutex registry_m;
+    std::vector<std::unique_ptr<ThreadCounters>> threads;
+    Sample samples[TAG_COUNT];
+    Level levels[TAG_COUNT];
+};
+
+} // memory
+} // trillek
+
+#endif // ALLOCATION_TRACKER_HPP_INCLUDED
@@ -82,7 +82,7 @@ public:
             if (new_upper_bound > buffer_end) {
                 // above the buffer end, try to allocate at the buffer first address
                 new_upper_bound = buffer_start + aligned_n;
-                if (new_upper_bound > lower_bound) {
+                if (new_upper_bound >= lower_bound) {
                     // requested size is too big, so we allocate memory in next buffer
                     if (! next_buffer) {
                         this->next_buffer = make_unique<FIFOAllocator<size,Alignment>>();
@@ -98,7 +98,7 @@ public:
             }
         }
         else {
-            if (new_upper_bound > lower_bound) {
+            if (new_upper_bound >= lower_bound) {
                 // requested size is too big, so we allocate memory in next buffer
                 if (! next_buffer) {
                     this->next_buffer = make_unique<FIFOAllocator<size,Alignment>>();
@@ -162,6 +162,11 @@ public:
         return size_t(-1);
     }
 
+    /// Get the number of bytes reserved by the buffers of the chain
+    size_t ReservedBytes() const {
+        return buffer.capacity() + (next_buffer ? next_buffer->ReservedBytes() : 0);
+    }
+
 private:
     template<class T>
     T Align(T ptr) const {
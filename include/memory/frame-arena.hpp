@@ -0,0 +1,191 @@
+#ifndef FRAME_ARENA_HPP_INCLUDED
+#define FRAME_ARENA_HPP_INCLUDED
+
+#include <new>
+#include <vector>
+#include <algorithm>
+#include "trillek.hpp"
+#include "logging.hpp"
+#include "memory/trillek-allocator.hpp"
+
+namespace trillek { namespace memory {
+
+/** \brief Linear allocator freed in bulk at each frame
+ *
+ * This allocator must be wrapped in TrillekAllocator, see Allocator().
+ *
+ * An allocation is a pointer bump in a fixed size buffer. deallocate() does nothing:
+ * all the memory is released by Reset(), called by the scheduler at the frame boundary
+ * of the thread owning the arena. Data allocated here must not live longer than the frame.
+ *
+ * When the buffer is full, the allocations are served by the heap and the overflow
+ * is counted. Reset() reports it and grows the buffer to the high-water mark, so
+ * that the next frame fits in the arena.
+ *
+ * Not thread-safe: each thread uses its own arena, returned by ThreadArena().
+ *
+ * for example:
+ *  std::vector<id_t,TrillekAllocator<id_t,FrameArena>> ids(FrameArena::Allocator<id_t>());
+ */
+class FrameArena final {
+public:
+    // containers must not move data to another arena
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+
+    typedef FrameArena* self_raw_pointer_type;
+
+    static const size_t DEFAULT_CAPACITY = 1 << 20;
+    static const size_t Alignment = 16;
+
+    /** \brief Constructor
+     *
+     * \param capacity size_t the size of the buffer in bytes
+     *
+     */
+    FrameArena(size_t capacity = DEFAULT_CAPACITY) : top(0), high_water(0), overflow_size(0), overflow_count(0) {
+        Resize(capacity);
+    }
+
+    // the arena is referenced by raw pointers, copy is not allowed
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    ~FrameArena() {
+        ReleaseOverflow();
+    }
+
+    void* allocate(size_t n) {
+        auto aligned_n = Align(n);
+        if (aligned_n < n) {
+            // integer overflow
+            throw std::bad_alloc();
+        }
+        if (aligned_n <= capacity - top) {
+            auto ret = buffer_start + top;
+            top += aligned_n;
+            return ret;
+        }
+        // the arena is full, fall back to the heap until the next reset
+        auto ret = ::operator new(n);
+        overflow.push_back(ret);
+        overflow_size += aligned_n;
+        ++overflow_count;
+        return ret;
+    }
+
+    void deallocate(void*, size_t) {
+        // memory is released in bulk by Reset()
+    }
+
+    /** \brief Release all the allocations
+     *
+     * Must be called by the owning thread when no allocation of the frame is used anymore.
+     *
+     */
+    void Reset() {
+        auto used = top + overflow_size;
+        high_water = (std::max)(high_water, used);
+        if (overflow_count) {
+            LOGMSG(WARNING) << "FrameArena: overflow of " << overflow_size << " bytes in "
+                            << overflow_count << " allocations, growing the arena to " << high_water << " bytes";
+            ReleaseOverflow();
+            Resize(high_water);
+        }
+        top = 0;
+    }
+
+    /** \brief Tell if a pointer was allocated in the buffer of the arena
+     *
+     */
+    bool Owns(const void* p) const {
+        return p >= buffer_start && p < buffer_start + capacity;
+    }
+
+    /// Get the number of bytes allocated since the last reset
+    size_t Used() const {
+        return top + overflow_size;
+    }
+
+    /// Get the maximal number of bytes allocated during a frame
+    size_t HighWater() const {
+        return (std::max)(high_water, Used());
+    }
+
+    /// Get the number of allocations served by the heap since the last reset
+    size_t OverflowCount() const {
+        return overflow_count;
+    }
+
+    size_t Capacity() const {
+        return capacity;
+    }
+
+    bool operator==(const FrameArena& lhs) const {
+        return this == &lhs;
+    }
+
+    bool operator!=(const FrameArena& lhs) const {
+        return this != &lhs;
+    }
+
+    /// Get the max allocation size
+    size_t max_size() const {
+        return size_t(-1);
+    }
+
+    /** \brief Get the arena of the calling thread
+     *
+     * \return FrameArena& the arena
+     *
+     */
+    static FrameArena& ThreadArena() {
+        static thread_local FrameArena arena;
+        return arena;
+    }
+
+    /** \brief Get an allocator on the arena of the calling thread
+     *
+     * \return TrillekAllocator<T,FrameArena> the allocator
+     *
+     */
+    template<class T>
+    static TrillekAllocator<T,FrameArena> Allocator() {
+        return TrillekAllocator<T,FrameArena>(&ThreadArena());
+    }
+
+private:
+    static size_t Align(size_t n) {
+        return (n + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    void Resize(size_t new_capacity) {
+        capacity = Align(new_capacity);
+        buffer = std::vector<char>(capacity + Alignment);
+        buffer_start = reinterpret_cast<char*>(Align(reinterpret_cast<size_t>(buffer.data())));
+    }
+
+    void ReleaseOverflow() {
+        for (auto p : overflow) {
+            ::operator delete(p);
+        }
+        overflow.clear();
+        overflow_size = 0;
+        overflow_count = 0;
+    }
+
+    std::vector<char> buffer;
+    char* buffer_start;
+    size_t capacity;
+    size_t top;
+    size_t high_water;
+    std::vector<void*> overflow;
+    size_t overflow_size;
+    size_t overflow_count;
+};
+
+} // memory
+} // trillek
+
+#endif // FRAME_ARENA_HPP_INCLUDED
@@ -0,0 +1,230 @@
+#ifndef HUGE_PAGE_ALLOCATOR_HPP_INCLUDED
+#define HUGE_PAGE_ALLOCATOR_HPP_INCLUDED
+
+#include <new>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include "trillek.hpp"
+#include "memory/trillek-allocator.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace trillek { namespace memory {
+
+/** \brief Allocator of big regions backed by huge pages
+ *
+ * This allocator must be wrapped in TrillekAllocator, see Allocator(). There is a single instance,
+ * returned by Instance().
+ *
+ * Allocations of at least MIN_REGION_SIZE bytes are mapped in their own region, rounded
+ * to a multiple of HUGE_PAGE_SIZE and aligned on it. The kernel is asked for huge pages:
+ * - first with MAP_HUGETLB, that succeeds only if huge pages were reserved by the administrator,
+ * - then with a normal mapping and MADV_HUGEPAGE, that lets the kernel back the region with
+ * transparent huge pages,
+ * - and if the advice is rejected, the region keeps normal pages.
+ *
+ * Smaller allocations, and all allocations on systems without mmap, are served by the heap.
+ *
+ * Big pools (pixel buffers, vertex arrays...) opt in by using this allocator, so that
+ * the TLB covers more memory with less entries.
+ *
+ * for example:
+ *  std::vector<float,TrillekAllocator<float,HugePageAllocator>> v(HugePageAllocator::Allocator<float>());
+ */
+class HugePageAllocator final {
+public:
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    typedef HugePageAllocator* self_raw_pointer_type;
+
+    static const size_t HUGE_PAGE_SIZE = 1 << 21;
+    static const size_t MIN_REGION_SIZE = HUGE_PAGE_SIZE;
+
+    HugePageAllocator(const HugePageAllocator&) = delete;
+    HugePageAllocator& operator=(const HugePageAllocator&) = delete;
+
+    /** \brief Get the allocator
+     *
+     * \return HugePageAllocator& the instance
+     *
+     */
+    static HugePageAllocator& Instance() {
+        static HugePageAllocator instance;
+        return instance;
+    }
+
+    void* allocate(size_t n) {
+        if (n < MIN_REGION_SIZE) {
+            return ::operator new(n);
+        }
+        auto size = RegionSize(n);
+        if (size < n) {
+            // integer overflow
+            throw std::bad_alloc();
+        }
+        auto ret = Map(size);
+        mapped_bytes.fetch_add(size, std::memory_order_relaxed);
+        regions.fetch_add(1, std::memory_order_relaxed);
+        return ret;
+    }
+
+    void deallocate(void* p, size_t n) {
+        if (n < MIN_REGION_SIZE) {
+            ::operator delete(p);
+            return;
+        }
+        auto size = RegionSize(n);
+        Unmap(p, size);
+        mapped_bytes.fetch_sub(size, std::memory_order_relaxed);
+        regions.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool operator==(const HugePageAllocator& lhs) const {
+        return this == &lhs;
+    }
+
+    bool operator!=(const HugePageAllocator& lhs) const {
+        return this != &lhs;
+    }
+
+    /// Get the max allocation size
+    size_t max_size() const {
+        return size_t(-1);
+    }
+
+    /// Get the number of regions currently mapped
+    size_t Regions() const {
+        return regions.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of bytes currently mapped in regions
+    size_t MappedBytes() const {
+        return mapped_bytes.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of regions mapped with huge pages, reserved or transparent
+    size_t HugeRegions() const {
+        return huge_regions.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of regions that fell back to normal pages
+    size_t FallbackRegions() const {
+        return fallback_regions.load(std::memory_order_relaxed);
+    }
+
+    /** \brief Get an allocator for containers
+     *
+     * \return TrillekAllocator<T,HugePageAllocator,Tag> the allocator
+     *
+     */
+    template<class T, AllocationTag Tag = AllocationTag::GENERAL>
+    static TrillekAllocator<T,HugePageAllocator,Tag> Allocator() {
+        return TrillekAllocator<T,HugePageAllocator,Tag>(&Instance());
+    }
+
+    /** \brief Deleter of the arrays returned by MakeArray()
+     *
+     */
+    template<class T, AllocationTag Tag>
+    struct Deleter {
+        Deleter() : count(0) {}
+        Deleter(size_t count) : count(count) {}
+        void operator()(T* p) const {
+            AllocationTracker::Deallocate(Tag, p, count * sizeof(T));
+            Instance().deallocate(p, count * sizeof(T));
+        }
+        size_t count;
+    };
+
+    template<class T, AllocationTag Tag = AllocationTag::GENERAL>
+    using Array = std::unique_ptr<T[],Deleter<T,Tag>>;
+
+    /** \brief Allocate an array of trivial objects
+     *
+     * The content of the array is not initialized.
+     *
+     * \param count size_t the number of elements
+     * \return Array<T,Tag> the array
+     *
+     */
+    template<class T, AllocationTag Tag = AllocationTag::GENERAL>
+    static Array<T,Tag> MakeArray(size_t count) {
+        static_assert(std::is_trivial<T>::value, "MakeArray() does not call constructors");
+        if (count > size_t(-1) / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        auto p = static_cast<T*>(Instance().allocate(count * sizeof(T)));
+        AllocationTracker::Allocate(Tag, p, count * sizeof(T));
+        return Array<T,Tag>(p, Deleter<T,Tag>(count));
+    }
+
+private:
+    HugePageAllocator() : regions(0), mapped_bytes(0), huge_regions(0), fallback_regions(0) {}
+
+    static size_t RegionSize(size_t n) {
+        return (n + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    }
+
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+    void* Map(size_t size) {
+#if defined(MAP_HUGETLB)
+        auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            huge_regions.fetch_add(1, std::memory_order_relaxed);
+            return p;
+        }
+#endif
+        // map a bigger region to align it on a huge page, then trim it
+        auto mapped_size = size + HUGE_PAGE_SIZE;
+        auto base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        auto start = RegionSize(reinterpret_cast<size_t>(base));
+        auto head = start - reinterpret_cast<size_t>(base);
+        if (head) {
+            munmap(base, head);
+        }
+        if (HUGE_PAGE_SIZE - head) {
+            munmap(reinterpret_cast<char*>(start + size), HUGE_PAGE_SIZE - head);
+        }
+        auto ret = reinterpret_cast<void*>(start);
+#if defined(MADV_HUGEPAGE)
+        if (! madvise(ret, size, MADV_HUGEPAGE)) {
+            huge_regions.fetch_add(1, std::memory_order_relaxed);
+            return ret;
+        }
+#endif
+        fallback_regions.fetch_add(1, std::memory_order_relaxed);
+        return ret;
+    }
+
+    void Unmap(void* p, size_t size) {
+        munmap(p, size);
+    }
+#else
+    void* Map(size_t size) {
+        fallback_regions.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+
+    void Unmap(void* p, size_t) {
+        ::operator delete(p);
+    }
+#endif
+
+    std::atomic<size_t> regions;
+    std::atomic<size_t> mapped_bytes;
+    std::atomic<size_t> huge_regions;
+    std::atomic<size_t> fallback_regions;
+};
+
+} // memory
+} // trillek
+
+#endif // HUGE_PAGE_ALLOCATOR_HPP_INCLUDED
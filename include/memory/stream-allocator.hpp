@@ -1,6 +1,11 @@
 #ifndef STREAM_ALLOCATOR_HPP_INCLUDED
 #define STREAM_ALLOCATOR_HPP_INCLUDED
 
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
 namespace trillek { namespace memory {
 
 /** \brief FIFO allocator in a contiguous segment
@@ -41,9 +46,21 @@ namespace trillek { namespace memory {
  *
  * When the containers are no more used, reset the smart pointers to deallocate memory in the order you created them.
  *
+ * RING MODE
+ *
+ * With Ring = true, the buffer is a ring: allocations wrap around to the beginning of the buffer
+ * instead of moving the data, and deallocate() releases the space immediately when the oldest block
+ * is released. Blocks released out of order are reclaimed when all the blocks preceding them are released.
+ * gc() is not available. Each block is preceded by a header of sizeof(size_t) bytes.
+ * data() only returns the blocks preceding the wrap point. A full buffer throws std::bad_alloc.
+ *
+ * No I/O is done by the allocator. HighWater() and WrapCount() give the maximal size used and
+ * the number of times the allocations came back to the beginning of the buffer.
+ *
  * size: size of the buffer
+ * Ring: ring mode
  */
-template<size_t size>
+template<size_t size, bool Ring = false>
 class StreamAllocator {
 public:
     // 'const' qualified to have a build-time error when trying to move a container
@@ -56,22 +73,24 @@ public:
     typedef std::true_type propagate_on_container_move_assignment;
     typedef std::true_type propagate_on_container_swap;
 
-    StreamAllocator() : deallocated_size(0) {
+    StreamAllocator() : deallocated_size(0), high_water(0), wrap_count(0) {
         buffer.reserve(size);
         buffer_start = buffer.data();
         lower_bound = buffer_start;
         upper_bound = lower_bound;
         buffer_end = lower_bound + size;
+        last_address = buffer_end;
     }
 
     // Copy
     StreamAllocator(const StreamAllocator& other) :
-        buffer(other.buffer), deallocated_size(other.deallocated_size) {
+        buffer(other.buffer), deallocated_size(other.deallocated_size), high_water(0), wrap_count(0) {
         buffer.reserve(size);
         buffer_start = this->buffer.data();
         lower_bound = this->buffer_start;
         upper_bound = this->lower_bound;
         buffer_end = this->lower_bound + size;
+        last_address = buffer_end;
     }
 
     // Move
@@ -90,40 +109,14 @@ public:
         swap(this->lower_bound, other.lower_bound);
         swap(this->upper_bound, other.upper_bound);
         swap(this->buffer_end, other.buffer_end);
+        swap(this->last_address, other.last_address);
         swap(this->deallocated_size, other.deallocated_size);
+        swap(this->high_water, other.high_water);
+        swap(this->wrap_count, other.wrap_count);
     }
 
     void* allocate(size_t n) {
-        std::cout << "   >>> allocate lower_bound = " << std::dec << lower_bound - buffer_start << std::endl;
-        std::cout << "   >>> allocate upper_bound = " << std::dec << upper_bound - buffer_start << std::endl;
-        std::cout << "+++allocate n = " << std::dec << n << std::endl;
-        auto new_upper_bound = upper_bound + n;
-        std::cout << "+++allocate new upper_bound = " << std::dec << new_upper_bound - buffer_start << std::endl;
-        if ( n > size || new_upper_bound < upper_bound) {
-            // integer overflow or buffer too small
-            throw std::bad_alloc();
-        }
-        void* ret;
-        if (new_upper_bound > buffer_end) {
-            // above the buffer end, move the data at the beginning of the buffer
-            size_t data_size = upper_bound - lower_bound;
-            std::memmove(buffer_start, lower_bound, data_size);
-            lower_bound = buffer_start;
-            upper_bound = buffer_start + data_size;
-            new_upper_bound = upper_bound + n;
-            if (new_upper_bound > buffer_end) {
-                throw std::bad_alloc();
-            }
-           std::cout << "+++allocate copy to start, lower_bound = " << std::dec << lower_bound - buffer_start << std::endl;
-           std::cout << "+++allocate copy to start, lower_bound = " << std::hex << (void*)lower_bound << std::endl;
-           std::cout << "+++allocate copy to start, upper_bound = " << std::dec << upper_bound - buffer_start << std::endl;
-           std::cout << "+++allocate copy to start, upper_bound = " << std::hex << (void*)upper_bound << std::endl;
-           std::cout << "+++allocate copy to start, size = " << std::dec << data_size << std::endl;
-        }
-        ret = upper_bound;
-        upper_bound = new_upper_bound;
-        std::cout << "   OOO return " << std::hex << static_cast<void*>(ret) << std::endl;
-        return ret;
+        return allocate(n, ring_tag());
     }
 
     void deallocate(void* p, size_t n) {
@@ -131,15 +124,13 @@ public:
             LOGMSG(ERROR) << "StreamAllocator: Trying to deallocate a bad pointer.";
             return;
         }
-        deallocated_size += n;
+        deallocate(p, n, ring_tag());
     }
 
     void gc() {
-        std::cout << "   >>> deallocate lower_bound = " << std::dec << lower_bound - buffer_start << std::endl;
-        std::cout << "   >>> deallocate upper_bound = " << std::dec << upper_bound - buffer_start << std::endl;
-        std::cout << "---deallocate n = " << std::dec << deallocated_size << std::endl;
+        // in ring mode, the blocks are reclaimed by deallocate() and deallocated_size is not used
+        static_assert(! Ring, "StreamAllocator: gc() is not available in ring mode");
         auto new_lower_bound = lower_bound + deallocated_size;
-        std::cout << "   >>> allocate new lower_bound = " << std::dec << new_lower_bound - buffer_start << std::endl;
         assert(new_lower_bound <= buffer_end);
         if (new_lower_bound > lower_bound) {
             lower_bound = new_lower_bound;
@@ -149,7 +140,21 @@ public:
             upper_bound = lower_bound;
         }
         deallocated_size = 0;
-        std::cout << "---deallocate new lower_bound = " << std::dec << lower_bound - buffer_start << std::endl;
+    }
+
+    /// Get the maximal number of bytes used at the same time
+    size_t HighWater() const {
+        return high_water;
+    }
+
+    /// Get the number of times the allocations restarted at the beginning of the buffer
+    size_t WrapCount() const {
+        return wrap_count;
+    }
+
+    /// Get the number of bytes reserved by the buffer
+    size_t ReservedBytes() const {
+        return buffer.capacity();
     }
 
     std::pair<char*,size_t> data() {
@@ -170,12 +175,115 @@ public:
     }
 
 private:
+    typedef std::integral_constant<bool,Ring> ring_tag;
+    // flag set in the header of a block when it is released
+    static const size_t RELEASED = ~(size_t(-1) >> 1);
+    static const size_t HEADER_SIZE = sizeof(size_t);
+
+    void* allocate(size_t n, std::false_type) {
+        auto new_upper_bound = upper_bound + n;
+        if ( n > size || new_upper_bound < upper_bound) {
+            // integer overflow or buffer too small
+            throw std::bad_alloc();
+        }
+        if (new_upper_bound > buffer_end) {
+            // above the buffer end, move the data at the beginning of the buffer
+            size_t data_size = upper_bound - lower_bound;
+            std::memmove(buffer_start, lower_bound, data_size);
+            lower_bound = buffer_start;
+            upper_bound = buffer_start + data_size;
+            new_upper_bound = upper_bound + n;
+            if (new_upper_bound > buffer_end) {
+                throw std::bad_alloc();
+            }
+            ++wrap_count;
+        }
+        auto ret = upper_bound;
+        upper_bound = new_upper_bound;
+        high_water = (std::max)(high_water, static_cast<size_t>(upper_bound - lower_bound));
+        return ret;
+    }
+
+    void deallocate(void*, size_t n, std::false_type) {
+        deallocated_size += n;
+    }
+
+    void* allocate(size_t n, std::true_type) {
+        auto block_size = n + HEADER_SIZE;
+        if (n > size || block_size > size) {
+            // integer overflow or buffer too small
+            throw std::bad_alloc();
+        }
+        char* block;
+        if (lower_bound <= upper_bound) {
+            if (static_cast<size_t>(buffer_end - upper_bound) >= block_size) {
+                block = upper_bound;
+            }
+            else if (static_cast<size_t>(lower_bound - buffer_start) > block_size) {
+                // wrap around, the end of the buffer is skipped
+                last_address = upper_bound;
+                block = buffer_start;
+                ++wrap_count;
+            }
+            else {
+                throw std::bad_alloc();
+            }
+        }
+        else if (static_cast<size_t>(lower_bound - upper_bound) > block_size) {
+            block = upper_bound;
+        }
+        else {
+            throw std::bad_alloc();
+        }
+        std::memcpy(block, &n, HEADER_SIZE);
+        upper_bound = block + block_size;
+        high_water = (std::max)(high_water, Used());
+        return block + HEADER_SIZE;
+    }
+
+    void deallocate(void* p, size_t, std::true_type) {
+        auto header = static_cast<char*>(p) - HEADER_SIZE;
+        size_t block_size;
+        std::memcpy(&block_size, header, HEADER_SIZE);
+        block_size |= RELEASED;
+        std::memcpy(header, &block_size, HEADER_SIZE);
+        // reclaim the released blocks at the tail of the ring
+        while (lower_bound != upper_bound) {
+            if (lower_bound == last_address) {
+                lower_bound = buffer_start;
+                last_address = buffer_end;
+                continue;
+            }
+            std::memcpy(&block_size, lower_bound, HEADER_SIZE);
+            if (! (block_size & RELEASED)) {
+                break;
+            }
+            lower_bound += HEADER_SIZE + (block_size & ~RELEASED);
+        }
+        if (lower_bound == upper_bound) {
+            lower_bound = buffer_start;
+            upper_bound = lower_bound;
+            last_address = buffer_end;
+        }
+    }
+
+    size_t Used() const {
+        if (lower_bound <= upper_bound) {
+            return upper_bound - lower_bound;
+        }
+        return (last_address - lower_bound) + (upper_bound - buffer_start);
+    }
+
     std::vector<char> buffer;
     char* buffer_start;
     char* buffer_end;
     char* lower_bound;
     char* upper_bound;
+    // end of the data when the ring has wrapped around
+    char* last_address;
     size_t deallocated_size;
+    size_t high_water;
+    size_t wrap_count;
 };
 
 } // memory
@@ -0,0 +1,329 @@
+#ifndef THREAD_CACHE_ALLOCATOR_HPP_INCLUDED
+#define THREAD_CACHE_ALLOCATOR_HPP_INCLUDED
+
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "trillek.hpp"
+
+namespace trillek { namespace memory {
+
+/** \brief Multi-threaded allocator with thread-local caches
+ *
+ * This allocator must be wrapped in TrillekAllocator. There is a single instance, returned by Instance().
+ *
+ * Blocks are grouped in size classes (powers of 2 from 16 to 4096 bytes) and carved from slabs.
+ * Each thread has a cache per size class holding a magazine, i.e an array of free blocks.
+ * - allocate() pops a block from the magazine of the calling thread,
+ * - deallocate() pushes the block in the magazine of the thread owning its slab. If the caller is
+ * not the owner, the block is pushed in a lock-free list that the owner drains when its magazine is empty.
+ *
+ * Full magazines are exchanged with a global depot, by batches of MAGAZINE_SIZE blocks. This is
+ * the only place where a lock is taken, so that allocations and deallocations are lock-free
+ * and without contention most of the time.
+ *
+ * When a thread exits, its magazines go to the depot and its cache is adopted by the next thread created.
+ *
+ * Allocations bigger than the biggest size class are served by the heap.
+ * Memory of the slabs is never returned to the system.
+ *
+ * FIFOAllocator must be used by a single thread. This allocator is its counterpart for
+ * data shared between threads.
+ */
+class ThreadCacheAllocator final {
+public:
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    typedef ThreadCacheAllocator* self_raw_pointer_type;
+
+    static const size_t Alignment = 16;
+    static const size_t SIZE_CLASSES = 9;
+    static const size_t MAX_BLOCK_SIZE = Alignment << (SIZE_CLASSES - 1);
+    static const size_t MAGAZINE_SIZE = 64;
+    static const size_t SLAB_SIZE = 1 << 16;
+    static const size_t SLABS_PER_REGION = 64;
+
+    ThreadCacheAllocator(const ThreadCacheAllocator&) = delete;
+    ThreadCacheAllocator& operator=(const ThreadCacheAllocator&) = delete;
+
+    ~ThreadCacheAllocator() {
+        for (auto& depot : depots) {
+            for (auto m : depot.full) {
+                delete m;
+            }
+            for (auto m : depot.empty) {
+                delete m;
+            }
+        }
+    }
+
+    /** \brief Get the allocator
+     *
+     * \return ThreadCacheAllocator& the instance
+     *
+     */
+    static ThreadCacheAllocator& Instance() {
+        // never destroyed, static objects may deallocate memory after it
+        static ThreadCacheAllocator* instance = new ThreadCacheAllocator();
+        return *instance;
+    }
+
+    void* allocate(size_t n) {
+        if (n > MAX_BLOCK_SIZE) {
+            return ::operator new(n);
+        }
+        auto& cache = Local().classes[SizeClass(n)];
+        if (cache.loaded->count) {
+            return cache.loaded->blocks[--cache.loaded->count];
+        }
+        return Refill(cache, SizeClass(n));
+    }
+
+    void deallocate(void* p, size_t n) {
+        if (n > MAX_BLOCK_SIZE) {
+            ::operator delete(p);
+            return;
+        }
+        auto size_class = SizeClass(n);
+        auto owner = SlabOf(p)->owner;
+        auto& local = Local();
+        if (owner != &local) {
+            // give the block back to its owner
+            auto& remote = owner->classes[size_class].remote;
+            auto block = static_cast<FreeBlock*>(p);
+            block->next = remote.load(std::memory_order_relaxed);
+            while (! remote.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed)) {}
+            return;
+        }
+        auto& cache = local.classes[size_class];
+        if (cache.loaded->count == MAGAZINE_SIZE) {
+            Exchange(cache, size_class);
+        }
+        cache.loaded->blocks[cache.loaded->count++] = p;
+    }
+
+    bool operator==(const ThreadCacheAllocator& lhs) const {
+        return this == &lhs;
+    }
+
+    bool operator!=(const ThreadCacheAllocator& lhs) const {
+        return this != &lhs;
+    }
+
+    /// Get the max allocation size
+    size_t max_size() const {
+        return size_t(-1);
+    }
+
+    /// Get the number of magazines exchanged with the depot
+    size_t DepotTransfers() const {
+        return transfers.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of slabs carved, i.e the memory used is Slabs() * SLAB_SIZE
+    size_t Slabs() const {
+        return slab_count.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of bytes of the slabs carved, without the blocks served by the heap
+    size_t ReservedBytes() const {
+        return Slabs() * SLAB_SIZE;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct Magazine {
+        Magazine() : count(0) {}
+        size_t count;
+        void* blocks[MAGAZINE_SIZE];
+    };
+
+    struct ThreadCache;
+
+    struct ClassCache {
+        ClassCache() : owner(nullptr), loaded(new Magazine()), slab_next(nullptr), slab_end(nullptr), remote(nullptr) {}
+        ~ClassCache() {
+            delete loaded;
+        }
+        ThreadCache* owner;
+        Magazine* loaded;
+        char* slab_next;
+        char* slab_end;
+        // blocks deallocated by other threads
+        std::atomic<FreeBlock*> remote;
+    };
+
+    struct ThreadCache {
+        ThreadCache() : orphan(false) {
+            for (auto& c : classes) {
+                c.owner = this;
+            }
+        }
+        ClassCache classes[SIZE_CLASSES];
+        bool orphan;
+    };
+
+    struct SlabHeader {
+        ThreadCache* owner;
+    };
+
+    struct Depot {
+        std::mutex m;
+        std::vector<Magazine*> full;
+        std::vector<Magazine*> empty;
+    };
+
+    ThreadCacheAllocator() : transfers(0), slab_count(0) {}
+
+    static size_t SizeClass(size_t n) {
+        size_t size_class = 0;
+        for (auto size = Alignment; size < n; size <<= 1) {
+            ++size_class;
+        }
+        return size_class;
+    }
+
+    static SlabHeader* SlabOf(void* p) {
+        return reinterpret_cast<SlabHeader*>(reinterpret_cast<size_t>(p) & ~(SLAB_SIZE - 1));
+    }
+
+    /** \brief Get the cache of the calling thread
+     *
+     */
+    ThreadCache& Local() {
+        struct Holder {
+            Holder() : cache(nullptr) {}
+            ~Holder() {
+                if (cache) {
+                    Instance().Orphan(*cache);
+                }
+            }
+            ThreadCache* cache;
+        };
+        static thread_local Holder holder;
+        if (! holder.cache) {
+            holder.cache = Adopt();
+        }
+        return *holder.cache;
+    }
+
+    /** \brief Allocate when the magazine is empty
+     *
+     */
+    void* Refill(ClassCache& cache, size_t size_class) {
+        // blocks released by other threads
+        auto block = cache.remote.exchange(nullptr, std::memory_order_acquire);
+        while (block) {
+            auto next = block->next;
+            if (cache.loaded->count == MAGAZINE_SIZE) {
+                Exchange(cache, size_class);
+            }
+            cache.loaded->blocks[cache.loaded->count++] = block;
+            block = next;
+        }
+        if (! cache.loaded->count) {
+            // a full magazine from the depot
+            auto& depot = depots[size_class];
+            std::lock_guard<std::mutex> lock(depot.m);
+            if (! depot.full.empty()) {
+                depot.empty.push_back(cache.loaded);
+                cache.loaded = depot.full.back();
+                depot.full.pop_back();
+                transfers.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (cache.loaded->count) {
+            return cache.loaded->blocks[--cache.loaded->count];
+        }
+        // carve a new block
+        auto size = Alignment << size_class;
+        if (cache.slab_next + size > cache.slab_end) {
+            NewSlab(cache);
+        }
+        auto ret = cache.slab_next;
+        cache.slab_next += size;
+        return ret;
+    }
+
+    /** \brief Put the full magazine in the depot and get an empty one
+     *
+     */
+    void Exchange(ClassCache& cache, size_t size_class) {
+        auto& depot = depots[size_class];
+        std::lock_guard<std::mutex> lock(depot.m);
+        depot.full.push_back(cache.loaded);
+        if (depot.empty.empty()) {
+            cache.loaded = new Magazine();
+        }
+        else {
+            cache.loaded = depot.empty.back();
+            depot.empty.pop_back();
+        }
+        transfers.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void NewSlab(ClassCache& cache) {
+        std::lock_guard<std::mutex> lock(registry_m);
+        if (slabs.empty()) {
+            regions.emplace_back(new char[SLAB_SIZE * (SLABS_PER_REGION + 1)]);
+            auto start = (reinterpret_cast<size_t>(regions.back().get()) | (SLAB_SIZE - 1)) + 1;
+            for (size_t i = 0; i < SLABS_PER_REGION; ++i) {
+                slabs.push_back(reinterpret_cast<char*>(start + i * SLAB_SIZE));
+            }
+        }
+        auto slab = slabs.back();
+        slabs.pop_back();
+        slab_count.fetch_add(1, std::memory_order_relaxed);
+        reinterpret_cast<SlabHeader*>(slab)->owner = cache.owner;
+        cache.slab_next = slab + Alignment;
+        cache.slab_end = slab + SLAB_SIZE;
+    }
+
+    /** \brief Get a cache for a new thread
+     *
+     */
+    ThreadCache* Adopt() {
+        std::lock_guard<std::mutex> lock(registry_m);
+        for (auto& cache : caches) {
+            if (cache->orphan) {
+                cache->orphan = false;
+                return cache.get();
+            }
+        }
+        caches.emplace_back(new ThreadCache());
+        return caches.back().get();
+    }
+
+    /** \brief Release the cache of a thread that exits
+     *
+     */
+    void Orphan(ThreadCache& cache) {
+        for (size_t i = 0; i < SIZE_CLASSES; ++i) {
+            auto& c = cache.classes[i];
+            if (c.loaded->count) {
+                Exchange(c, i);
+            }
+        }
+        std::lock_guard<std::mutex> lock(registry_m);
+        cache.orphan = true;
+    }
+
+    Depot depots[SIZE_CLASSES];
+    std::atomic<size_t> transfers;
+    std::atomic<size_t> slab_count;
+    std::mutex registry_m;
+    std::vector<std::unique_ptr<ThreadCache>> caches;
+    std::vector<std::unique_ptr<char[]>> regions;
+    std::vector<char*> slabs;
+};
+
+} // memory
+} // trillek
+
+#endif // THREAD_CACHE_ALLOCATOR_HPP_INCLUDED
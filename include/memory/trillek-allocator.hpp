@@ -3,15 +3,18 @@
 
 #include <cstddef>
 #include "trillek.hpp"
+#include "memory/allocation-tracker.hpp"
 #include <iostream>
 
-extern size_t gAllocatedSize;
-
 namespace trillek {
 
-template<class T, class Alloc = std::allocator<T>>
+/** \brief STL allocator wrapping the trillek allocators
+ *
+ * The memory allocated is accounted under Tag by memory::AllocationTracker.
+ */
+template<class T, class Alloc, memory::AllocationTag Tag>
 class TrillekAllocator {
-    template<class U,class AnyAlloc>
+    template<class U,class AnyAlloc,memory::AllocationTag AnyTag>
     friend class TrillekAllocator;
 public:
     typedef size_t size_type;
@@ -34,30 +37,30 @@ public:
     TrillekAllocator(TrillekAllocator&& other) NOEXCEPT :  alloc(std::move(other.alloc)) {}
     /// Copy constructor with another type
     template<typename U>
-    TrillekAllocator(const TrillekAllocator<U,Alloc>& other) NOEXCEPT : alloc(other.alloc) {}
+    TrillekAllocator(const TrillekAllocator<U,Alloc,Tag>& other) NOEXCEPT : alloc(other.alloc) {}
     /// Move constructor with another type
     template<typename U>
-    TrillekAllocator(TrillekAllocator<U,Alloc>&& other) NOEXCEPT : alloc(std::move(other.alloc)) {}
+    TrillekAllocator(TrillekAllocator<U,Alloc,Tag>&& other) NOEXCEPT : alloc(std::move(other.alloc)) {}
 
     /// Destructor
     ~TrillekAllocator() {}
 
     /// Copy
-    TrillekAllocator<T,Alloc>& operator=(TrillekAllocator other) NOEXCEPT {
+    TrillekAllocator<T,Alloc,Tag>& operator=(TrillekAllocator other) NOEXCEPT {
         swap(other);
         return *this;
     }
 
     /// Copy with another type
     template<typename U>
-    TrillekAllocator<T,Alloc>& operator=(TrillekAllocator<U,Alloc> other) NOEXCEPT {
+    TrillekAllocator<T,Alloc,Tag>& operator=(TrillekAllocator<U,Alloc,Tag> other) NOEXCEPT {
         swap(other);
         return *this;
     }
 
     /// swap
     template<class U>
-    void swap(TrillekAllocator<U,Alloc>& other) NOEXCEPT {
+    void swap(TrillekAllocator<U,Alloc,Tag>& other) NOEXCEPT {
         using std::swap;
         swap(this->alloc, other.alloc);
     }
@@ -82,14 +85,15 @@ public:
     /// Allocate memory
     pointer allocate(size_type n, const void* = 0) {
         size_type size = n * sizeof(value_type);
-        gAllocatedSize += size;
-        return static_cast<pointer>(alloc->allocate(size));
+        auto ret = static_cast<pointer>(alloc->allocate(size));
+        memory::AllocationTracker::Allocate(Tag, ret, size);
+        return ret;
     }
 
     /// Deallocate memory
     void deallocate(void* p, size_type n) {
         size_type size = n * sizeof(T);
-        gAllocatedSize -= size;
+        memory::AllocationTracker::Deallocate(Tag, p, size);
         alloc->deallocate(static_cast<pointer>(p), size);
     }
 
@@ -124,24 +128,24 @@ public:
     /// A struct to rebind the allocator to another allocator of type U
     template<typename U>
     struct rebind {
-        typedef TrillekAllocator<U,Alloc> other;
+        typedef TrillekAllocator<U,Alloc,Tag> other;
     };
 
     // called by copy assignment operator of containers only if
     // propagate_on_container_copy_assignment == true
     // && alloc this != alloc other (i.e other can't deallocate objects allocated by this)
     // && always_equal == false
-    TrillekAllocator<T,Alloc> select_on_container_copy_construction() {
+    TrillekAllocator<T,Alloc,Tag> select_on_container_copy_construction() {
         auto copy = std::make_shared<Alloc>();
-        return TrillekAllocator<T,Alloc>(std::move(copy));
+        return TrillekAllocator<T,Alloc,Tag>(std::move(copy));
     }
 
 private:
     typename Alloc::self_raw_pointer_type alloc;
 };
 
-template<class T>
-class TrillekAllocator<T,std::allocator<T>> : public std::allocator_traits<std::allocator<T>> {
+template<class T, memory::AllocationTag Tag>
+class TrillekAllocator<T,std::allocator<T>,Tag> : public std::allocator_traits<std::allocator<T>> {
 public:
     typedef T& reference;
     typedef const T& const_reference;
@@ -152,24 +156,25 @@ public:
     TrillekAllocator(const TrillekAllocator&) NOEXCEPT {}
     /// Copy constructor with another type
     template<typename U>
-    TrillekAllocator(const TrillekAllocator<U,std::allocator<U>>&) NOEXCEPT {}
+    TrillekAllocator(const TrillekAllocator<U,std::allocator<U>,Tag>&) NOEXCEPT {}
     /// Destructor
     ~TrillekAllocator() { }
     /// Copy
-    TrillekAllocator<T,std::allocator<T>>& operator=(const TrillekAllocator&) NOEXCEPT {
+    TrillekAllocator<T,std::allocator<T>,Tag>& operator=(const TrillekAllocator&) NOEXCEPT {
         return *this;
     }
 
     /// Allocate memory
     T* allocate(size_t n) {
         auto size = n * sizeof(T);
-        gAllocatedSize += size;
-        return static_cast<T*>(::operator new(size));
+        auto ret = static_cast<T*>(::operator new(size));
+        memory::AllocationTracker::Allocate(Tag, ret, size);
+        return ret;
     }
 
     /// Deallocate memory
     void deallocate(T* p, size_t n) {
-        gAllocatedSize -= n * sizeof(T);
+        memory::AllocationTracker::Deallocate(Tag, p, n * sizeof(T));
         ::operator delete(p);
     }
 
@@ -199,7 +204,7 @@ public:
     /// A struct to rebind the allocator to another allocator of type U
     template<typename U>
     struct rebind {
-        typedef TrillekAllocator<U,std::allocator<U>> other;
+        typedef TrillekAllocator<U,std::allocator<U>,Tag> other;
     };
 
 };
@@ -0,0 +1,347 @@
+#ifndef PERSISTENTMAP_HPP_INCLUDED
+#define PERSISTENTMAP_HPP_INCLUDED
+
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include "trillek.hpp"
+#include "memory/trillek-allocator.hpp"
+
+namespace trillek {
+
+/** \brief An immutable ordered map with structural sharing
+ *
+ * The map is an AVL tree whose nodes are never modified. An insertion or a
+ * removal copies the path from the root to the node, and all other nodes are
+ * shared with the previous version.
+ *
+ * Copying the map only copies the root, i.e a copy is a snapshot in O(1).
+ * Snapshots can be read from any thread, the nodes being immutable.
+ *
+ * It has the interface of a const std::map, and the modifiers replace the
+ * root of this instance only.
+ *
+ * Complexity of modifiers is O(log(n)) time and O(log(n)) new nodes.
+ */
+template<class K, class V, class Compare = std::less<K>>
+class PersistentMap final {
+    struct Node;
+    typedef std::shared_ptr<const Node> node_ptr;
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K,V> value_type;
+    typedef size_t size_type;
+
+    /** \brief In-order iterator on the nodes
+     */
+    class const_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename PersistentMap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        const_iterator() {}
+
+        reference operator*() const {
+            return path.back()->value;
+        }
+
+        pointer operator->() const {
+            return &path.back()->value;
+        }
+
+        const_iterator& operator++() {
+            auto node = path.back();
+            if (node->right) {
+                node = node->right.get();
+                while (node) {
+                    path.push_back(node);
+                    node = node->left.get();
+                }
+                return *this;
+            }
+            path.pop_back();
+            while (! path.empty() && path.back()->right.get() == node) {
+                node = path.back();
+                path.pop_back();
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return (path.empty() && other.path.empty())
+                || (! path.empty() && ! other.path.empty() && path.back() == other.path.back());
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return ! (*this == other);
+        }
+
+    private:
+        friend class PersistentMap;
+        // the nodes from the root to the current node
+        std::vector<const Node*> path;
+    };
+
+    typedef const_iterator iterator;
+
+    PersistentMap() : length(0) {}
+
+    const_iterator begin() const {
+        const_iterator ret;
+        for (auto node = root.get(); node; node = node->left.get()) {
+            ret.path.push_back(node);
+        }
+        return ret;
+    }
+
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    size_type size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    /** \brief Find an element
+     *
+     * \param key const K& the key
+     * \return const_iterator the element or end()
+     *
+     */
+    const_iterator find(const K& key) const {
+        const_iterator ret;
+        auto node = root.get();
+        while (node) {
+            ret.path.push_back(node);
+            if (comp(key, node->value.first)) {
+                node = node->left.get();
+            }
+            else if (comp(node->value.first, key)) {
+                node = node->right.get();
+            }
+            else {
+                return ret;
+            }
+        }
+        return end();
+    }
+
+    size_type count(const K& key) const {
+        return Lookup(key) ? 1 : 0;
+    }
+
+    /** \brief Same as std::map::at
+     *
+     * \param key const K& the key
+     * \return const V& the value
+     * \throw std::out_of_range if the key is not in the map
+     *
+     */
+    const V& at(const K& key) const {
+        auto node = Lookup(key);
+        if (! node) {
+            throw std::out_of_range("PersistentMap::at");
+        }
+        return node->value.second;
+    }
+
+    /** \brief Insert an element if the key is not in the map
+     *
+     * \param value value_type the element
+     * \return bool true if the element was inserted
+     *
+     */
+    bool insert(value_type value) {
+        int delta = 0;
+        root = Insert(root, value.first, value.second, false, delta);
+        length += delta;
+        return delta != 0;
+    }
+
+    /** \brief Insert an element or replace its value
+     *
+     * \param key const K& the key
+     * \param value const V& the value
+     *
+     */
+    void assign(const K& key, const V& value) {
+        int delta = 0;
+        root = Insert(root, key, value, true, delta);
+        length += delta;
+    }
+
+    /** \brief Remove an element
+     *
+     * \param key const K& the key
+     * \return size_type the number of elements removed
+     *
+     */
+    size_type erase(const K& key) {
+        bool removed = false;
+        root = Erase(root, key, removed);
+        if (removed) {
+            --length;
+        }
+        return removed ? 1 : 0;
+    }
+
+    void clear() {
+        root.reset();
+        length = 0;
+    }
+
+    /** \brief Tell if 2 maps are the same version
+     *
+     * \param other const PersistentMap& the other map
+     * \return bool true if both maps share the same root
+     *
+     */
+    bool SameVersion(const PersistentMap& other) const {
+        return root == other.root;
+    }
+
+private:
+    struct Node {
+        Node(const K& key, const V& val, node_ptr left, node_ptr right)
+            : value(key, val), left(std::move(left)), right(std::move(right)),
+            height(1 + (std::max)(Height(this->left), Height(this->right))) {}
+
+        const value_type value;
+        const node_ptr left;
+        const node_ptr right;
+        const int height;
+    };
+
+    static int Height(const node_ptr& node) {
+        return node ? node->height : 0;
+    }
+
+    static node_ptr NewNode(const K& key, const V& value, node_ptr left, node_ptr right) {
+        return std::allocate_shared<Node>(TrillekAllocator<Node>(), key, value, std::move(left), std::move(right));
+    }
+
+    static node_ptr NewNode(const node_ptr& node, node_ptr left, node_ptr right) {
+        return NewNode(node->value.first, node->value.second, std::move(left), std::move(right));
+    }
+
+    /** \brief Build a node from its content and restore the AVL invariant
+     *
+     */
+    static node_ptr Balance(const node_ptr& node, node_ptr left, node_ptr right) {
+        auto hl = Height(left);
+        auto hr = Height(right);
+        if (hl > hr + 1) {
+            if (Height(left->left) >= Height(left->right)) {
+                return NewNode(left, left->left, NewNode(node, left->right, std::move(right)));
+            }
+            auto pivot = left->right;
+            return NewNode(pivot, NewNode(left, left->left, pivot->left), NewNode(node, pivot->right, std::move(right)));
+        }
+        if (hr > hl + 1) {
+            if (Height(right->right) >= Height(right->left)) {
+                return NewNode(right, NewNode(node, std::move(left), right->left), right->right);
+            }
+            auto pivot = right->left;
+            return NewNode(pivot, NewNode(node, std::move(left), pivot->left), NewNode(right, pivot->right, right->right));
+        }
+        return NewNode(node, std::move(left), std::move(right));
+    }
+
+    const Node* Lookup(const K& key) const {
+        auto node = root.get();
+        while (node) {
+            if (comp(key, node->value.first)) {
+                node = node->left.get();
+            }
+            else if (comp(node->value.first, key)) {
+                node = node->right.get();
+            }
+            else {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    node_ptr Insert(const node_ptr& node, const K& key, const V& value, bool replace, int& delta) const {
+        if (! node) {
+            delta = 1;
+            return NewNode(key, value, nullptr, nullptr);
+        }
+        if (comp(key, node->value.first)) {
+            auto left = Insert(node->left, key, value, replace, delta);
+            return left == node->left ? node : Balance(node, std::move(left), node->right);
+        }
+        if (comp(node->value.first, key)) {
+            auto right = Insert(node->right, key, value, replace, delta);
+            return right == node->right ? node : Balance(node, node->left, std::move(right));
+        }
+        if (! replace) {
+            return node;
+        }
+        return NewNode(key, value, node->left, node->right);
+    }
+
+    node_ptr Erase(const node_ptr& node, const K& key, bool& removed) const {
+        if (! node) {
+            return node;
+        }
+        if (comp(key, node->value.first)) {
+            auto left = Erase(node->left, key, removed);
+            return removed ? Balance(node, std::move(left), node->right) : node;
+        }
+        if (comp(node->value.first, key)) {
+            auto right = Erase(node->right, key, removed);
+            return removed ? Balance(node, node->left, std::move(right)) : node;
+        }
+        removed = true;
+        if (! node->left) {
+            return node->right;
+        }
+        if (! node->right) {
+            return node->left;
+        }
+        // replace the node by the smallest element of the right subtree
+        auto successor = node->right.get();
+        while (successor->left) {
+            successor = successor->left.get();
+        }
+        bool dummy = false;
+        auto right = Erase(node->right, successor->value.first, dummy);
+        auto replacement = NewNode(successor->value.first, successor->value.second, nullptr, nullptr);
+        return Balance(replacement, node->left, std::move(right));
+    }
+
+    node_ptr root;
+    size_type length;
+    Compare comp;
+};
+
+} // namespace trillek
+
+#endif // PERSISTENTMAP_HPP_INCLUDED
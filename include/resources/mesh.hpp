@@ -5,6 +5,7 @@
 #include <list>
 
 #include "systems/resource-system.hpp"
+#include "memory/huge-page-allocator.hpp"
 
 namespace trillek {
 namespace resource {
@@ -21,9 +22,17 @@ struct VertexData {
 };
 
 // Container for holding sub-mesh groups.
+// Vertex arrays of big meshes are backed by huge pages.
 struct MeshGroup {
-    std::vector<VertexData> verts;
-    std::vector<unsigned int> indicies;
+    template<class T>
+    using Allocator = TrillekAllocator<T,memory::HugePageAllocator,memory::AllocationTag::RESOURCE>;
+
+    MeshGroup() :
+        verts(memory::HugePageAllocator::Allocator<VertexData,memory::AllocationTag::RESOURCE>()),
+        indicies(memory::HugePageAllocator::Allocator<unsigned int,memory::AllocationTag::RESOURCE>()) { }
+
+    std::vector<VertexData,Allocator<VertexData>> verts;
+    std::vector<unsigned int,Allocator<unsigned int>> indicies;
     std::list<std::string> textures;
 };
 
@@ -2,6 +2,7 @@
 #define PIXELBUFFER_HPP_INCLUDED
 
 #include "systems/resource-system.hpp"
+#include "memory/huge-page-allocator.hpp"
 #include <mutex>
 
 namespace trillek {
@@ -114,7 +115,8 @@ protected:
 
     bool dirty;
 
-    std::unique_ptr<uint8_t[]> blockptr;
+    // big images are backed by huge pages
+    memory::HugePageAllocator::Array<uint8_t,memory::AllocationTag::RESOURCE> blockptr;
     std::mutex writelock;
 };
 
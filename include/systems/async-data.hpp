@@ -1,40 +1,128 @@
 #ifndef ASYNCDATA_HPP_INCLUDED
 #define ASYNCDATA_HPP_INCLUDED
 #include <mutex>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <condition_variable>
 #include <iterator>
 #include <map>
+#include <vector>
+#include <stdexcept>
 #include "trillek-scheduler.hpp"
 #include "logging.hpp"
 
 namespace trillek {
 
+/** \brief An iterator on a sequence of frames
+ *
+ * The position is a sequence number, the slot is found by masking it.
+ * A mask of ~0 gives a plain iterator on a contiguous array.
+ */
+template<class T>
+class FrameIterator final {
+public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef std::pair<frame_tp,T> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef const value_type& reference;
+
+    FrameIterator() : base(nullptr), mask(0), position(0) {}
+
+    FrameIterator(const value_type* base, size_t mask, uint64_t position)
+        : base(base), mask(mask), position(position) {}
+
+    reference operator*() const {
+        return base[position & mask];
+    }
+
+    pointer operator->() const {
+        return &base[position & mask];
+    }
+
+    FrameIterator& operator++() {
+        ++position;
+        return *this;
+    }
+
+    FrameIterator operator++(int) {
+        auto ret = *this;
+        ++position;
+        return ret;
+    }
+
+    FrameIterator& operator--() {
+        --position;
+        return *this;
+    }
+
+    FrameIterator operator--(int) {
+        auto ret = *this;
+        --position;
+        return ret;
+    }
+
+    bool operator==(const FrameIterator& other) const {
+        return position == other.position && base == other.base;
+    }
+
+    bool operator!=(const FrameIterator& other) const {
+        return ! (*this == other);
+    }
+
+    /** \brief Return the sequence number of the iterator
+     *
+     * \return uint64_t the position
+     *
+     */
+    uint64_t Position() const {
+        return position;
+    }
+
+private:
+    const value_type* base;
+    size_t mask;
+    uint64_t position;
+};
+
 /** \brief An history object
  */
 template<class T>
 class HistoryMap final {
 public:
-    typedef typename std::map<frame_tp,T>::const_iterator iter_type;
+    typedef FrameIterator<T> iter_type;
+
+    // an empty history
+    HistoryMap() {}
 
-    HistoryMap(typename std::map<frame_tp,T>::const_iterator begin,
-                typename std::map<frame_tp,T>::const_iterator end)
+    HistoryMap(iter_type begin, iter_type end)
         : start(std::move(begin)), stop(std::move(end))
     {};
 
+    /** \brief Build an history from a map
+     *
+     * The content of the map is copied in a contiguous array owned by the
+     * history object.
+     *
+     */
     HistoryMap(const std::map<frame_tp,T>& importations)
-        : start(importations.cbegin()), stop(importations.cend()) {}
+        : imported(std::make_shared<std::vector<std::pair<frame_tp,T>>>(importations.cbegin(), importations.cend())),
+        start(imported->data(), ~size_t(0), 0),
+        stop(imported->data(), ~size_t(0), imported->size()) {}
 
-    typename std::map<frame_tp,T>::const_iterator cbegin() const {
+    iter_type cbegin() const {
         return start;
     }
 
-    typename std::map<frame_tp,T>::const_iterator cend() const {
+    iter_type cend() const {
         return stop;
     }
 
 private:
-
-    typename std::map<frame_tp,T>::const_iterator start;
-    typename std::map<frame_tp,T>::const_iterator stop;
+    std::shared_ptr<const std::vector<std::pair<frame_tp,T>>> imported;
+    iter_type start;
+    iter_type stop;
 };
 
 /** \brief A reverse history object
@@ -44,38 +132,384 @@ class ReverseHistoryMap final {
 public:
     typedef typename std::reverse_iterator<typename HistoryMap<T>::iter_type> iter_type;
 
-    ReverseHistoryMap(typename std::map<frame_tp,T>::const_reverse_iterator last,
-                typename std::map<frame_tp,T>::const_reverse_iterator first)
+    ReverseHistoryMap(iter_type last, iter_type first)
         : start(std::move(last)), stop(std::move(first))
         {};
 
-    typename std::map<frame_tp,T>::const_reverse_iterator crbegin() const {
+    iter_type crbegin() const {
         return start;
     }
 
-    typename std::map<frame_tp,T>::const_reverse_iterator crend() const {
+    iter_type crend() const {
         return stop;
     }
 
 private:
-    typename std::map<frame_tp,T>::const_reverse_iterator start;
-    typename std::map<frame_tp,T>::const_reverse_iterator stop;
+    iter_type start;
+    iter_type stop;
+};
+
+/** \brief A fixed-capacity ring of frames with sequence-stamped slots
+ *
+ * Frames are stored in increasing order. The last HistorySize frames are
+ * retained. A published slot is never written until it is recycled: amending
+ * the history publishes a new version of the whole history in fresh slots.
+ *
+ * The capacity of the ring is the next power of 2 above three times the history
+ * size. A window handed out to a reader is recycled after 2 x HistorySize slots
+ * have been written, i.e. it stays valid during an amendment followed by
+ * HistorySize publications. Readers must be done with a window before that, or
+ * copy it.
+ *
+ * Each slot is stamped with the sequence number of the frame it holds plus 1,
+ * and the stamp is released after the data is written. Readers never lock.
+ *
+ * There must be only one writer. The history must be full before it is rewritten.
+ *
+ * T is the data type
+ * HistorySize is the number of frames retained
+ */
+template<class T,int HistorySize>
+class FrameRing final {
+public:
+    typedef FrameIterator<T> iterator;
+    typedef std::pair<frame_tp,T> value_type;
+
+    FrameRing() : slots(Capacity()), stamps(new std::atomic<uint64_t>[Capacity()]), head(0) {
+        for (size_t i = 0; i < Capacity(); ++i) {
+            stamps[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // copy functions are deleted
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    /** \brief Return the number of slots of the ring
+     *
+     * \return size_t the capacity
+     *
+     */
+    static constexpr size_t Capacity() {
+        return RoundUp(3 * HistorySize);
+    }
+
+    /** \brief Return the sequence number following the most recent frame
+     *
+     * \return uint64_t the sequence number
+     *
+     */
+    uint64_t Head() const {
+        return head.load(std::memory_order_acquire);
+    }
+
+    /** \brief Return the sequence number of the oldest frame retained
+     *
+     * \param head uint64_t the head to use
+     * \return uint64_t the sequence number
+     *
+     */
+    uint64_t Tail(uint64_t head) const {
+        return head > static_cast<uint64_t>(HistorySize) ? head - HistorySize : 0;
+    }
+
+    /** \brief Return an iterator at a sequence number
+     *
+     * \param position uint64_t the sequence number
+     * \return iterator the iterator
+     *
+     */
+    iterator At(uint64_t position) const {
+        return iterator(slots.data(), Capacity() - 1, position);
+    }
+
+    /** \brief Check that a slot still holds the frame of a sequence number
+     *
+     * \param position uint64_t the sequence number
+     * \return bool true if the slot was not recycled
+     *
+     */
+    bool IsValid(uint64_t position) const {
+        return stamps[position & (Capacity() - 1)].load(std::memory_order_acquire) == position + 1;
+    }
+
+    /** \brief Return the position of the first frame not less than frame
+     *
+     * \param frame const frame_tp& the frame to look for
+     * \param head uint64_t the head to use
+     * \return uint64_t the position, or head
+     *
+     */
+    uint64_t LowerBound(const frame_tp& frame, uint64_t head) const {
+        return Search(head, [&frame](const frame_tp& f) { return f < frame; });
+    }
+
+    /** \brief Return the position of the first frame greater than frame
+     *
+     * \param frame const frame_tp& the frame to look for
+     * \param head uint64_t the head to use
+     * \return uint64_t the position, or head
+     *
+     */
+    uint64_t UpperBound(const frame_tp& frame, uint64_t head) const {
+        return Search(head, [&frame](const frame_tp& f) { return ! (frame < f); });
+    }
+
+    /** \brief Return the position of a frame
+     *
+     * \param frame const frame_tp& the frame to look for
+     * \param head uint64_t the head to use
+     * \return uint64_t the position, or head if not found
+     *
+     */
+    uint64_t Find(const frame_tp& frame, uint64_t head) const {
+        auto position = LowerBound(frame, head);
+        if (position != head && Slot(position).first == frame) {
+            return position;
+        }
+        return head;
+    }
+
+    /** \brief Return the frame stored at a position
+     *
+     * \param position uint64_t the sequence number
+     * \return const value_type& the frame and its data
+     *
+     */
+    const value_type& Slot(uint64_t position) const {
+        return slots[position & (Capacity() - 1)];
+    }
+
+    /** \brief Append a frame, recycling the oldest slot
+     *
+     * \param frame const frame_tp& the frame
+     * \param data U&& the data
+     *
+     */
+    template<class U>
+    void Push(const frame_tp& frame, U&& data) {
+        auto position = head.load(std::memory_order_relaxed);
+        Write(position, frame, std::forward<U>(data));
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    /** \brief Republish the history with frames replaced or inserted
+     *
+     * The frames retained and the amendments are merged in fresh slots, and the
+     * most recent HistorySize frames are kept. This is only used when history is
+     * rewritten, which is not the common path.
+     *
+     * \param first It the first amendment, a pair of a frame and its data
+     * \param last It the end of the amendments, sorted by frame
+     *
+     */
+    template<class It>
+    void Amend(It first, It last) {
+        auto current = head.load(std::memory_order_relaxed);
+        // the number of frames merged, to drop the oldest ones
+        size_t count = 0;
+        Merge(first, last, current, [&count](const frame_tp&, const T&) { ++count; });
+        auto skip = count > static_cast<size_t>(HistorySize) ? count - HistorySize : 0;
+        auto next = current;
+        Merge(first, last, current, [&](const frame_tp& frame, const T& data) {
+            if (skip) {
+                --skip;
+            }
+            else {
+                Write(next++, frame, data);
+            }
+        });
+        head.store(next, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t RoundUp(size_t n, size_t p = 1) {
+        return p >= n ? p : RoundUp(n, p << 1);
+    }
+
+    template<class U>
+    void Write(uint64_t position, const frame_tp& frame, U&& data) {
+        auto index = position & (Capacity() - 1);
+        stamps[index].store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slots[index].first = frame;
+        slots[index].second = std::forward<U>(data);
+        stamps[index].store(position + 1, std::memory_order_release);
+    }
+
+    /** \brief Visit the frames retained and the amendments in order
+     *
+     * An amendment replaces the frame retained with the same timepoint.
+     *
+     */
+    template<class It,class F>
+    void Merge(It first, It last, uint64_t current, F&& f) const {
+        auto i = Tail(current);
+        while (i < current || first != last) {
+            if (first == last || (i < current && Slot(i).first < first->first)) {
+                f(Slot(i).first, Slot(i).second);
+                ++i;
+                continue;
+            }
+            if (i < current && ! (first->first < Slot(i).first)) {
+                ++i;
+            }
+            f(first->first, first->second);
+            ++first;
+        }
+    }
+
+    template<class Compare>
+    uint64_t Search(uint64_t head, Compare&& before) const {
+        auto first = Tail(head);
+        auto count = head - first;
+        while (count > 0) {
+            auto step = count / 2;
+            auto middle = first + step;
+            if (before(Slot(middle).first)) {
+                first = middle + 1;
+                count -= step + 1;
+            }
+            else {
+                count = step;
+            }
+        }
+        return first;
+    }
+
+    std::vector<value_type> slots;
+    std::unique_ptr<std::atomic<uint64_t>[]> stamps;
+    std::atomic<uint64_t> head;
+};
+
+/** \brief Slots where threads wait for the publication of a frame
+ *
+ * Each waiting thread claims its own slot with its own condition variable,
+ * and the publisher only wakes the threads waiting for a frame that has been
+ * published. When all slots are busy, the thread waits on a shared condition
+ * variable that is woken at each publication.
+ *
+ * The timeout of the waiters only expires if the publisher stalls.
+ *
+ * Slots is the number of slots
+ */
+template<size_t Slots = 16>
+class FrameWaiters final {
+public:
+    FrameWaiters() : overflow_count(0) {
+        for (auto& slot : slots) {
+            slot.awaited.store(Free(), std::memory_order_relaxed);
+        }
+    }
+
+    // copy functions are deleted
+    FrameWaiters(const FrameWaiters&) = delete;
+    FrameWaiters& operator=(const FrameWaiters&) = delete;
+
+    /** \brief Block until a frame is published
+     *
+     * published is checked after the slot is claimed, so that a publication
+     * occurring in the meantime is not lost.
+     *
+     * \param frame const frame_tp& the frame awaited
+     * \param timeout const std::chrono::milliseconds& the maximum time to wait
+     * \param published Predicate true when the frame is available
+     * \return bool the value of published when returning
+     *
+     */
+    template<class Predicate>
+    bool WaitFor(const frame_tp& frame, const std::chrono::milliseconds& timeout, Predicate published) const {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (auto& slot : slots) {
+            auto expected = Free();
+            if (slot.awaited.compare_exchange_strong(expected, frame)) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool ret;
+                {
+                    std::unique_lock<std::mutex> locker(slot.m);
+                    ret = slot.cv.wait_until(locker, deadline, published);
+                }
+                slot.awaited.store(Free(), std::memory_order_release);
+                return ret;
+            }
+        }
+        // all slots are busy
+        std::unique_lock<std::mutex> locker(overflow_m);
+        overflow_count.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto ret = overflow.wait_until(locker, deadline, published);
+        overflow_count.fetch_sub(1, std::memory_order_relaxed);
+        return ret;
+    }
+
+    /** \brief Wake the threads waiting for a frame up to frame
+     *
+     * Must be called after the publication is visible.
+     *
+     * \param frame const frame_tp& the frame published
+     *
+     */
+    void Notify(const frame_tp& frame) const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (auto& slot : slots) {
+            auto awaited = slot.awaited.load(std::memory_order_relaxed);
+            if (awaited != Free() && awaited <= frame) {
+                {
+                    // the waiter checks the publication while holding this lock
+                    std::lock_guard<std::mutex> locker(slot.m);
+                }
+                slot.cv.notify_one();
+            }
+        }
+        if (overflow_count.load(std::memory_order_relaxed)) {
+            {
+                std::lock_guard<std::mutex> locker(overflow_m);
+            }
+            overflow.notify_all();
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<frame_tp> awaited;
+        std::mutex m;
+        std::condition_variable cv;
+    };
+
+    static frame_tp Free() {
+        return std::numeric_limits<frame_tp>::min();
+    }
+
+    mutable std::array<Slot,Slots> slots;
+    mutable std::atomic<size_t> overflow_count;
+    mutable std::mutex overflow_m;
+    mutable std::condition_variable overflow;
 };
 
 /** \brief A data with navigable history
+ *
+ * The history is kept in a FrameRing: publishing and reading a frame does not
+ * allocate, and readers only lock when they have to wait for a publication.
+ * Modifying frames already published copies the history in fresh slots once, so
+ * the frames handed out to the readers are not modified while the FrameRing
+ * retains them: a history returned stays valid during a Rebase() followed by
+ * HistorySize publications.
+ *
+ * The history is bounded to HistorySize frames. A consumer that stays behind
+ * for more than HistorySize frames gets the oldest frames retained.
  *
  * T is the data type
  * Historysize is the size of the history
  */
 template<class T,int HistorySize = 30>
 class AsyncFrameData final {
-    typedef std::map<frame_tp,T> content_map;
+    typedef FrameRing<T,HistorySize> content_ring;
 public:
     AsyncFrameData() : current_frame(-1) {
         for (auto i = -HistorySize-1000000000; i < -1000000000; ++i) {
             frame_tp a{i};
             rebase_timepoint.emplace_hint(rebase_timepoint.end(), std::pair<frame_tp,frame_tp>(a, a));
-            datas.emplace_hint(datas.end(), std::make_pair<frame_tp,T>(std::move(a), T()));
+            datas.Push(a, T());
         }
     };
 
@@ -85,8 +519,8 @@ public:
      *
      * last_received will be updated if some data is retrieved
      *
-     * Blocks if the call is before the publication of frame_requested,
-     * and returns no data after 0.5s
+     * Blocks until the publication of frame_requested if the call is before it,
+     * and returns no data if the publisher stalls for 0.5s
      *
      * \param frame_requested const frame_tp& the "now" of the caller
      * \param last_received frame_tp& the last frame received by the caller
@@ -94,25 +528,23 @@ public:
      *
      */
     HistoryMap<T> PopSync(const frame_tp& frame_requested, frame_tp& last_received) const {
-        std::unique_lock<std::mutex> locker(m_current);
-        auto stop = datas.upper_bound(frame_requested);
-        if (datas.lower_bound(frame_requested) == datas.cend()) {
-            if ( ! ahead_request.wait_for(locker, std::chrono::milliseconds(500), [&](){ return datas.lower_bound(frame_requested) != datas.cend(); })) {
+        auto head = datas.Head();
+        if (datas.LowerBound(frame_requested, head) == head) {
+            if ( ! waiters.WaitFor(frame_requested, std::chrono::milliseconds(500), [&](){
+                        head = datas.Head();
+                        return datas.LowerBound(frame_requested, head) != head; })) {
                 // 500 ms have passed, let return a empty object
                 LOGMSGC(WARNING) << "PopSync: Seems that we are ahead of the publisher at frame " << frame_requested;
-                return HistoryMap<T>(datas.cend(), datas.cend());
+                return HistoryMap<T>(datas.At(head), datas.At(head));
             }
-            stop = datas.upper_bound(frame_requested);
-        }
-        auto start_index = datas.upper_bound(last_received);
-        if (stop != datas.cend() && (start_index == datas.cend() || start_index->first >= stop->first)) {
-            return HistoryMap<T>(datas.cend(), datas.cend());
         }
-        if (start_index != stop) {
-            auto it = stop; // make a copy
-            last_received = (--it)->first;
+        auto stop = datas.UpperBound(frame_requested, head);
+        auto start_index = datas.UpperBound(last_received, head);
+        if (start_index >= stop) {
+            return HistoryMap<T>(datas.At(head), datas.At(head));
         }
-        return HistoryMap<T>{std::move(start_index), std::move(stop)};
+        last_received = datas.Slot(stop - 1).first;
+        return HistoryMap<T>{datas.At(start_index), datas.At(stop)};
     };
 
     /** \brief Return the frames between last_received and frame_requested
@@ -124,8 +556,8 @@ public:
      * Rebase will be updated with the rebase point, if data received before last_received
      * has been modified
      *
-     * Blocks if the call is before the publication of frame_requested,
-     * and returns no data after 0.5s
+     * Blocks until the publication of frame_requested if the call is before it,
+     * and returns no data if the publisher stalls for 0.5s
      *
      * \param frame_requested const frame_tp& the "now" of the caller
      * \param last_received frame_tp& the last frame received by the caller
@@ -149,8 +581,8 @@ public:
      *
      * last_received is included, frame_requested is not included.
      *
-     * Blocks if the call is before the publication of new data since last_received,
-     * and returns no data after 0.01s
+     * Blocks until the publication of frame_requested if the call is before it,
+     * and returns no data if the publisher stalls for 0.5s
      *
      * \param frame_requested const frame_tp& the "now" of the caller
      * \param last_received frame_tp& the last frame received by the caller
@@ -158,21 +590,22 @@ public:
      *
      */
     HistoryMap<T> GetHistoryData(const frame_tp& frame_requested, const frame_tp& last_received) const {
-        std::unique_lock<std::mutex> locker(m_current);
-        auto stop = datas.upper_bound(frame_requested);
-        if (datas.lower_bound(frame_requested) == datas.cend()) {
-            if ( ! ahead_request.wait_for(locker, std::chrono::milliseconds(500), [&](){ return datas.lower_bound(frame_requested) != datas.cend(); })) {
+        auto head = datas.Head();
+        if (datas.LowerBound(frame_requested, head) == head) {
+            if ( ! waiters.WaitFor(frame_requested, std::chrono::milliseconds(500), [&](){
+                        head = datas.Head();
+                        return datas.LowerBound(frame_requested, head) != head; })) {
                 // 500 ms have passed, let return a empty object
                 LOGMSGC(WARNING) << "GetHistoryData: Seems that we are ahead of the publisher at frame " << frame_requested;
-                return HistoryMap<T>(datas.upper_bound(last_received), datas.cend());
+                return HistoryMap<T>(datas.At(datas.UpperBound(last_received, head)), datas.At(head));
             }
-            stop = datas.upper_bound(frame_requested);
         }
-        auto start_index = datas.upper_bound(last_received);
-        if (stop != datas.cend() && (start_index == datas.cend() || start_index->first >= stop->first)) {
-                return HistoryMap<T>(datas.cend(), datas.cend());
+        auto stop = datas.UpperBound(frame_requested, head);
+        auto start_index = datas.UpperBound(last_received, head);
+        if (start_index >= stop) {
+            return HistoryMap<T>(datas.At(head), datas.At(head));
         }
-        return HistoryMap<T>{std::move(start_index), std::move(stop)};
+        return HistoryMap<T>{datas.At(start_index), datas.At(stop)};
     };
 
     /** \brief Return the frames between first and last frame in reverse order
@@ -184,7 +617,8 @@ public:
      *
      * This allows to return in a previous state.
      *
-     * Blocks if the call is before last_frame, and returns no data after 0.01s
+     * Blocks until the publication of last_frame if the call is before it,
+     * and returns no data if the publisher stalls for 0.5s
      *
      * \param first_frame const frame_tp& the first frame
      * \param last_frame const frame_tp& the last frame
@@ -192,18 +626,20 @@ public:
      *
      */
     ReverseHistoryMap<T> GetReverseHistoryData(const frame_tp& first_frame, const frame_tp& last_frame) const {
-        std::unique_lock<std::mutex> locker2(m_current2);
-        auto start_index = datas.upper_bound(last_frame);
-        if (start_index == datas.cend() || last_frame > current_frame) {
-            // we block until the frame time or after 10 ms
-            if (! ahead_request2.wait_for(locker2, std::chrono::milliseconds(500), [&](){ return last_frame <= current_frame; })) {
+        typedef typename ReverseHistoryMap<T>::iter_type reverse_iter;
+        if (last_frame > current_frame.load(std::memory_order_acquire)) {
+            // we block until the frame is published or after 500 ms
+            if (! waiters.WaitFor(last_frame, std::chrono::milliseconds(500), [&](){
+                        return last_frame <= current_frame.load(std::memory_order_acquire); })) {
                 // 500 ms have passed, let return a empty object
                 LOGMSGC(WARNING) << "GetReverseHistoryData: Seems that we are ahead of the publisher at " << last_frame;
-                return ReverseHistoryMap<T>(datas.crend(), datas.crend());
+                auto head = datas.Head();
+                return ReverseHistoryMap<T>(reverse_iter(datas.At(head)), reverse_iter(datas.At(head)));
             }
-            start_index = datas.upper_bound(last_frame);
         }
-        return ReverseHistoryMap<T>(typename ReverseHistoryMap<T>::iter_type(std::move(start_index)), typename ReverseHistoryMap<T>::iter_type(datas.upper_bound(first_frame)));
+        auto head = datas.Head();
+        auto start_index = datas.UpperBound(last_frame, head);
+        return ReverseHistoryMap<T>(reverse_iter(datas.At(start_index)), reverse_iter(datas.At(datas.UpperBound(first_frame, head))));
     };
 
     /** \brief Return the data in history
@@ -213,16 +649,33 @@ public:
      *
      */
     T GetCommit(const frame_tp& frame) const {
-        std::unique_lock<std::mutex> locker(m_current, std::defer_lock);
-        std::unique_lock<std::mutex> locker2(m_current2, std::defer_lock);
-        std::lock(locker, locker2);
-        if (datas.count(frame)) {
-            return datas.at(frame);
+        auto head = datas.Head();
+        auto position = datas.Find(frame, head);
+        if (position != head) {
+            return datas.Slot(position).second;
         }
         LOGMSGC(ERROR) << "GetCommit(): The requested commit does not exist";
         return T();
     }
 
+    /** \brief Return the data in effect at a timepoint
+     *
+     * This is the most recent data published at or before frame.
+     *
+     * \param frame const frame_tp& the timepoint
+     * \return std::pair<frame_tp,T> the timepoint of the data and the data
+     *
+     */
+    std::pair<frame_tp,T> GetCommitAt(const frame_tp& frame) const {
+        auto head = datas.Head();
+        auto position = datas.UpperBound(frame, head);
+        if (position == datas.Tail(head)) {
+            LOGMSGC(ERROR) << "GetCommitAt(): The requested commit is out of history";
+            return datas.Slot(position);
+        }
+        return datas.Slot(position - 1);
+    }
+
     /** \brief Return the rebase point, if any
      *
      * A rebase point is a timepoint where data has been modified at some time after last_received,
@@ -254,17 +707,16 @@ public:
      */
     template<class U=const T>
     void Publish(U&& data, frame_tp frame) {
-        {
-            std::unique_lock<std::mutex> locker(m_current, std::defer_lock);
-            std::unique_lock<std::mutex> locker2(m_current2, std::defer_lock);
-            std::lock(locker, locker2);
-            current_frame = std::move(frame);
-            datas.erase(current_frame);
-            datas.emplace(std::make_pair(current_frame,std::forward<U>(data)));
-            datas.erase(datas.begin());
+        auto head = datas.Head();
+        if (datas.Slot(head - 1).first < frame) {
+            datas.Push(frame, std::forward<U>(data));
         }
-        ahead_request.notify_all();
-        ahead_request2.notify_all();
+        else {
+            std::pair<frame_tp,T> amended(frame, std::forward<U>(data));
+            datas.Amend(&amended, &amended + 1);
+        }
+        current_frame.store(frame, std::memory_order_release);
+        waiters.Notify(frame);
     };
 
     /** \brief Get the data of the last frame available - Not thread-safe
@@ -273,7 +725,12 @@ public:
      *
      */
     const T& GetHead() {
-        return datas.at(current_frame);
+        auto head = datas.Head();
+        auto position = datas.Find(current_frame.load(std::memory_order_relaxed), head);
+        if (position == head) {
+            throw std::out_of_range("AsyncFrameData::GetHead");
+        }
+        return datas.Slot(position).second;
     }
 
     /** \brief Update the data using an history object and checkout the most recent commit
@@ -285,16 +742,17 @@ public:
     frame_tp Rebase(HistoryMap<T>&& commits) {
         auto commit = commits.cbegin();
         auto it_end = commits.cend();
+        auto head_frame = current_frame.load(std::memory_order_relaxed);
         if (commit == it_end) {
-            return current_frame;
+            return head_frame;
         }
-        auto next_highest = std::max((--commits.cend())->first, current_frame);
-        if (commit->first <= current_frame) {
+        auto next_highest = std::max((--commits.cend())->first, head_frame);
+        if (commit->first <= head_frame) {
             // the 1st commit is before the max head
             // skip if a rebase point is ahead since we don't update backward
             for (auto it = rebase_timepoint.lower_bound(commit->first); it != rebase_timepoint.cend(); ++it) {
                 if (it->second > commit->first) {
-                    return current_frame;
+                    return head_frame;
                 }
             }
             // if we are ahead of the last rebase point but before the current head, update the rebase point
@@ -302,44 +760,28 @@ public:
             rebase_timepoint[next_highest] = commit->first - 1;
             rebase_timepoint.erase(rebase_timepoint.cbegin());
         }
-        for (; commit != it_end; ++commit) {
-            // replace the original or publish it
-            Amend(std::move(commit->second), std::move(commit->first));
+        // the frames already published are amended at once, the next ones are published
+        auto split = commit;
+        while (split != it_end && split->first <= head_frame) {
+            ++split;
         }
-        current_frame = next_highest;
-        return current_frame;
+        if (split != commit) {
+            datas.Amend(commit, split);
+        }
+        for (commit = split; commit != it_end; ++commit) {
+            Publish(commit->second, commit->first);
+        }
+        current_frame.store(next_highest, std::memory_order_release);
+        waiters.Notify(next_highest);
+        return next_highest;
     }
 
 private:
-    /** \brief Modify the data, in history or not
-     *
-     * \param data U&& the data
-     * \param frame const frame_tp& the timepoint to modify or to add
-     *
-     */
-    template<class U=const T>
-    void Amend(U&& data, const frame_tp& frame) {
-        {
-            std::unique_lock<std::mutex> locker(m_current, std::defer_lock);
-            std::unique_lock<std::mutex> locker2(m_current2, std::defer_lock);
-            std::lock(locker, locker2);
-            if (frame <= current_frame) {
-                datas.erase(frame);
-                datas.emplace(std::make_pair(frame,std::forward<U>(data)));
-                return;
-            }
-        }
-        Publish(std::forward<U>(data), frame);
-    };
-
-    content_map datas;
-    frame_tp current_frame;
+    content_ring datas;
+    std::atomic<frame_tp> current_frame;
     std::map<frame_tp,frame_tp> rebase_timepoint;
     mutable std::mutex rebase_m;
-    mutable std::mutex m_current;
-    mutable std::mutex m_current2;
-    mutable std::condition_variable ahead_request;
-    mutable std::condition_variable ahead_request2;
+    FrameWaiters<> waiters;
 };
 } // namespace trillek
 
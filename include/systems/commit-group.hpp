@@ -0,0 +1,150 @@
+#ifndef COMMIT_GROUP_HPP_INCLUDED
+#define COMMIT_GROUP_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include "trillek.hpp"
+#include "systems/rewindable-map.hpp"
+
+namespace trillek {
+
+/** \brief Publish several maps as a single commit
+ *
+ * Each map is committed independently, so a reader pulling the maps one by one
+ * may observe frame N on a map and frame N-1 on another.
+ *
+ * The group commits all the maps, then publishes the frame in an atomic epoch.
+ * Readers read the epoch first and pull every map up to the epoch, without taking
+ * any lock. The epoch only advances when all the maps committed the frame.
+ *
+ * The histories pulled are consistent as long as the FrameRing retains them: a
+ * frame modified after its publication is republished in fresh slots, and a window
+ * is recycled after a rebase followed by HistorySize commits. Readers must consume
+ * the histories before that.
+ *
+ * Maps must provide Commit(frame_tp) returning the frame committed, and
+ * Pull(frame_requested, last_received, rebase), e.g RewindableMap or Shared
+ * component containers.
+ *
+ * Commit() must be called by a single thread. Epoch() and Pull() are thread-safe.
+ */
+template<class... Maps>
+class CommitGroup final {
+public:
+    typedef std::tuple<decltype(std::declval<const Maps&>().Pull(frame_tp(), std::declval<frame_tp&>()))...> history_type;
+
+    /** \brief Constructor
+     *
+     * \param maps Maps&... the maps of the group
+     *
+     */
+    CommitGroup(Maps&... maps) : maps(maps...), epoch(-1) {};
+
+    // the maps are referenced, a group cannot be copied
+    CommitGroup(const CommitGroup&) = delete;
+    CommitGroup& operator=(const CommitGroup&) = delete;
+
+    /** \brief Commit all the maps and publish the frame
+     *
+     * The frame is not published if a map failed to commit it, e.g because it is rewinded.
+     *
+     * \param frame frame_tp the timepoint of the commit
+     * \return frame_tp the epoch, not equal to frame if a map failed
+     *
+     */
+    frame_tp Commit(frame_tp frame) {
+        if (CommitAll(frame, typename make_indices<sizeof...(Maps)>::type())) {
+            epoch.store(frame, std::memory_order_release);
+            return frame;
+        }
+        LOGMSGC(ERROR) << "CommitGroup: a map failed to commit frame " << frame;
+        return Epoch();
+    }
+
+    /** \brief Get the last frame committed by all the maps
+     *
+     * \return frame_tp the epoch
+     *
+     */
+    frame_tp Epoch() const {
+        return epoch.load(std::memory_order_acquire);
+    }
+
+    /** \brief Pull the history of all the maps up to the same frame
+     *
+     * The frame pulled is the current epoch. last_received is set to it.
+     * The histories returned can be injected in other maps using Push.
+     *
+     * The history of a map that was rebased before last_received starts at its
+     * rebase point. rebase is set to the oldest rebase point of the maps.
+     *
+     * The histories are empty before the first commit.
+     *
+     * \param last_received frame_tp& the last frame received by the caller
+     * \param rebase std::shared_ptr<frame_tp>& set to the rebase point, or empty
+     * \return history_type the histories in ]last_received, epoch], in the order of the maps
+     *
+     */
+    history_type Pull(frame_tp& last_received, std::shared_ptr<frame_tp>& rebase) const {
+        rebase.reset();
+        auto frame = Epoch();
+        if (frame < 0) {
+            return history_type();
+        }
+        if (frame < last_received) {
+            frame = last_received;
+        }
+        auto ret = PullAll(frame, last_received, rebase, typename make_indices<sizeof...(Maps)>::type());
+        last_received = frame;
+        return ret;
+    }
+
+    /** \brief Pull the history of all the maps up to the same frame
+     *
+     * See Pull(last_received, rebase).
+     *
+     */
+    history_type Pull(frame_tp& last_received) const {
+        std::shared_ptr<frame_tp> rebase;
+        return Pull(last_received, rebase);
+    }
+
+private:
+    template<size_t... I> struct indices {};
+    template<size_t N, size_t... I> struct make_indices : make_indices<N - 1, N - 1, I...> {};
+    template<size_t... I> struct make_indices<0, I...> { typedef indices<I...> type; };
+
+    template<size_t... I>
+    bool CommitAll(frame_tp frame, indices<I...>) {
+        // the braced list guarantees the maps are committed in order
+        bool committed[] = { true, (std::get<I>(maps).Commit(frame) == frame)... };
+        return std::all_of(std::begin(committed), std::end(committed), [](bool c) { return c; });
+    }
+
+    template<size_t... I>
+    history_type PullAll(frame_tp frame, frame_tp last_received, std::shared_ptr<frame_tp>& rebase, indices<I...>) const {
+        return history_type(Pull(std::get<I>(maps), frame, last_received, rebase)...);
+    }
+
+    template<class M>
+    static auto Pull(const M& map, frame_tp frame, frame_tp last_received, std::shared_ptr<frame_tp>& rebase)
+            -> decltype(map.Pull(frame, last_received)) {
+        std::shared_ptr<frame_tp> map_rebase;
+        auto ret = map.Pull(frame, last_received, map_rebase);
+        if (map_rebase && (! rebase || *map_rebase < *rebase)) {
+            rebase = std::move(map_rebase);
+        }
+        return ret;
+    }
+
+    std::tuple<Maps&...> maps;
+    std::atomic<frame_tp> epoch;
+};
+
+} // namespace trillek
+
+#endif // COMMIT_GROUP_HPP_INCLUDED
@@ -0,0 +1,336 @@
+#ifndef DELTA_HISTORY_HPP_INCLUDED
+#define DELTA_HISTORY_HPP_INCLUDED
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+#include <type_traits>
+#include "trillek.hpp"
+
+namespace trillek {
+
+/** \brief History of a map stored as binary deltas between frames
+ *
+ * Each frame is encoded in a single buffer containing the entries that changed since
+ * the previous frame:
+ * - an update is stored as the XOR of the old and the new value, with the runs of
+ * zero bytes compressed,
+ * - an insertion is stored with the new value,
+ * - a removal is stored with the old value.
+ *
+ * The encoding is symmetric, so that the history can be replayed in both directions
+ * from a known state. The history keeps the state of the most recent frame recorded,
+ * from which Snapshot() rebuilds the past states: it is the authoritative history of
+ * the map, independent of its uncommitted modifications.
+ *
+ * The total size of the buffers is bounded by a budget in bytes. When it is exceeded,
+ * the oldest frames are evicted first. The most recent frame is always kept.
+ *
+ * K and T must be trivially copyable, since they are stored byte per byte.
+ *
+ * Not thread-safe.
+ */
+template<class K, class T>
+class DeltaHistory final {
+    static_assert(std::is_trivially_copyable<K>::value, "DeltaHistory key must be trivially copyable");
+    static_assert(std::is_trivially_copyable<T>::value, "DeltaHistory value must be trivially copyable");
+
+    enum Operation : char { INSERT = 1, REMOVE = 2, UPDATE = 3 };
+    // maximal length of a run
+    static const size_t MAX_RUN = 0xFF;
+public:
+    typedef std::map<K,T> state_type;
+
+    /** \brief Constructor
+     *
+     * \param budget size_t the maximal size of the history in bytes
+     *
+     */
+    DeltaHistory(size_t budget = 1 << 20) : budget(budget), size(0) {};
+
+    /** \brief Record the modifications of a frame
+     *
+     * removed and added are the negative and positive commits of the frame,
+     * i.e maps with the old values and the new values. An element present in both is
+     * an update.
+     *
+     * value is a functor returning a const T& from a mapped value of M.
+     *
+     * The frame must be more recent than the frames already recorded, otherwise the
+     * frames not older are truncated before recording.
+     *
+     * \param frame frame_tp the timepoint of the frame
+     * \param removed const M& the old values
+     * \param added const M& the new values
+     * \param value F the accessor to the value
+     *
+     */
+    template<class M, class F>
+    void Record(frame_tp frame, const M& removed, const M& added, F value) {
+        if (! frames.empty() && frames.back().first >= frame) {
+            Truncate(frame - 1);
+        }
+        std::vector<char> buffer;
+        auto rem_it = removed.cbegin();
+        auto add_it = added.cbegin();
+        while (rem_it != removed.cend() || add_it != added.cend()) {
+            if (add_it == added.cend() || (rem_it != removed.cend() && rem_it->first < add_it->first)) {
+                PutFull(buffer, REMOVE, rem_it->first, value(rem_it->second));
+                ++rem_it;
+            }
+            else if (rem_it == removed.cend() || add_it->first < rem_it->first) {
+                PutFull(buffer, INSERT, add_it->first, value(add_it->second));
+                ++add_it;
+            }
+            else {
+                PutXor(buffer, add_it->first, value(rem_it->second), value(add_it->second));
+                ++rem_it;
+                ++add_it;
+            }
+        }
+        buffer.shrink_to_fit();
+        Apply(buffer, head, true);
+        size += buffer.size();
+        frames.emplace_back(frame, std::move(buffer));
+        Evict();
+    }
+
+    /** \brief Get the state of a past frame
+     *
+     * \param tp frame_tp the timepoint requested
+     * \param state state_type& receives the state at tp
+     * \return bool false if tp is older than the oldest frame
+     *
+     */
+    bool Snapshot(frame_tp tp, state_type& state) const {
+        state = head;
+        return Rewind(tp, state);
+    }
+
+    /** \brief Get the state of the most recent frame recorded
+     *
+     */
+    const state_type& Head() const {
+        return head;
+    }
+
+    /** \brief Undo and forget the frames more recent than a timepoint
+     *
+     * When tp is older than the oldest frame, all the frames are forgotten and the
+     * state is the one before the oldest frame: Reset() it.
+     *
+     * \param tp frame_tp the timepoint to keep
+     * \return bool false if tp is older than the oldest frame
+     *
+     */
+    bool Truncate(frame_tp tp) {
+        auto ret = frames.empty() || tp >= OldestFrame();
+        while (! frames.empty() && frames.back().first > tp) {
+            Apply(frames.back().second, head, false);
+            size -= frames.back().second.size();
+            frames.pop_back();
+        }
+        return ret;
+    }
+
+    /** \brief Forget the frames and restart the history from a state
+     *
+     * value is a functor returning a const T& from a mapped value of M.
+     *
+     * \param state const M& the state of the map
+     * \param value F the accessor to the value
+     *
+     */
+    template<class M, class F>
+    void Reset(const M& state, F value) {
+        Clear();
+        head.clear();
+        for (const auto& entry : state) {
+            head.emplace_hint(head.end(), entry.first, value(entry.second));
+        }
+    }
+
+    /** \brief Undo the frames more recent than a timepoint
+     *
+     * state must be the state of the map at the most recent frame recorded.
+     *
+     * \param tp frame_tp the timepoint requested
+     * \param state state_type& the state to modify
+     * \return bool false if tp is older than the oldest frame, state is then left untouched
+     *
+     */
+    bool Rewind(frame_tp tp, state_type& state) const {
+        if (! frames.empty() && tp < OldestFrame()) {
+            return false;
+        }
+        for (auto it = frames.crbegin(); it != frames.crend() && it->first > tp; ++it) {
+            Apply(it->second, state, false);
+        }
+        return true;
+    }
+
+    /** \brief Redo the frames in ]from, to]
+     *
+     * state must be the state of the map at timepoint from.
+     *
+     * \param from frame_tp the timepoint of the state
+     * \param to frame_tp the timepoint requested
+     * \param state state_type& the state to modify
+     *
+     */
+    void Forward(frame_tp from, frame_tp to, state_type& state) const {
+        for (const auto& f : frames) {
+            if (f.first > to) {
+                break;
+            }
+            if (f.first > from) {
+                Apply(f.second, state, true);
+            }
+        }
+    }
+
+    /** \brief Get the oldest timepoint that can be restored
+     *
+     * \return frame_tp the timepoint of the oldest frame recorded
+     *
+     */
+    frame_tp OldestFrame() const {
+        return frames.empty() ? 0 : frames.front().first;
+    }
+
+    /** \brief Get the number of frames recorded
+     *
+     */
+    size_t FrameCount() const {
+        return frames.size();
+    }
+
+    /** \brief Get the size of the history in bytes
+     *
+     */
+    size_t ByteSize() const {
+        return size;
+    }
+
+    /** \brief Set the budget in bytes
+     *
+     * The oldest frames are evicted immediately if the budget is exceeded.
+     *
+     * \param bytes size_t the new budget
+     *
+     */
+    void SetBudget(size_t bytes) {
+        budget = bytes;
+        Evict();
+    }
+
+    /** \brief Forget the frames, the state of the most recent frame is kept
+     *
+     */
+    void Clear() {
+        frames.clear();
+        size = 0;
+    }
+
+private:
+    void Evict() {
+        while (size > budget && frames.size() > 1) {
+            size -= frames.front().second.size();
+            frames.pop_front();
+        }
+    }
+
+    static void Put(std::vector<char>& buffer, const void* data, size_t length) {
+        auto bytes = static_cast<const char*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + length);
+    }
+
+    static void PutFull(std::vector<char>& buffer, Operation op, const K& key, const T& value) {
+        buffer.push_back(op);
+        Put(buffer, &key, sizeof(K));
+        Put(buffer, &value, sizeof(T));
+    }
+
+    /** \brief Encode the XOR of 2 values
+     *
+     * The delta is a sequence of (zero run length, literal length, literals),
+     * the lengths being stored on 1 byte.
+     *
+     */
+    static void PutXor(std::vector<char>& buffer, const K& key, const T& old_value, const T& new_value) {
+        char delta[sizeof(T)];
+        auto a = reinterpret_cast<const char*>(&old_value);
+        auto b = reinterpret_cast<const char*>(&new_value);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            delta[i] = a[i] ^ b[i];
+        }
+        buffer.push_back(UPDATE);
+        Put(buffer, &key, sizeof(K));
+        size_t i = 0;
+        while (i < sizeof(T)) {
+            size_t zeros = 0;
+            while (i < sizeof(T) && zeros < MAX_RUN && delta[i] == 0) {
+                ++zeros;
+                ++i;
+            }
+            size_t start = i;
+            while (i < sizeof(T) && i - start < MAX_RUN && (delta[i] != 0
+                    || (i + 1 < sizeof(T) && delta[i + 1] != 0))) {
+                ++i;
+            }
+            buffer.push_back(static_cast<char>(zeros));
+            buffer.push_back(static_cast<char>(i - start));
+            Put(buffer, delta + start, i - start);
+        }
+    }
+
+    /** \brief Apply a frame to a state
+     *
+     * \param buffer const std::vector<char>& the encoded frame
+     * \param state state_type& the state
+     * \param forward bool true to redo the frame, false to undo it
+     *
+     */
+    static void Apply(const std::vector<char>& buffer, state_type& state, bool forward) {
+        auto data = buffer.data();
+        auto end = data + buffer.size();
+        while (data < end) {
+            auto op = static_cast<Operation>(*data++);
+            K key;
+            std::memcpy(&key, data, sizeof(K));
+            data += sizeof(K);
+            if (op == UPDATE) {
+                auto value = reinterpret_cast<char*>(&state.at(key));
+                size_t i = 0;
+                while (i < sizeof(T)) {
+                    i += static_cast<unsigned char>(*data++);
+                    size_t literals = static_cast<unsigned char>(*data++);
+                    for (size_t j = 0; j < literals; ++j) {
+                        value[i++] ^= *data++;
+                    }
+                }
+                continue;
+            }
+            if ((op == INSERT) == forward) {
+                T value;
+                std::memcpy(&value, data, sizeof(T));
+                state[key] = value;
+            }
+            else {
+                state.erase(key);
+            }
+            data += sizeof(T);
+        }
+    }
+
+    std::deque<std::pair<frame_tp,std::vector<char>>> frames;
+    // the state of the most recent frame
+    state_type head;
+    size_t budget;
+    size_t size;
+};
+
+} // namespace trillek
+
+#endif // DELTA_HISTORY_HPP_INCLUDED
@@ -0,0 +1,267 @@
+#ifndef INTEREST_GRID_HPP_INCLUDED
+#define INTEREST_GRID_HPP_INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "trillek.hpp"
+
+namespace trillek {
+
+/** \brief Uniform grid of the positions of the entities
+ *
+ * The space is cut in cubic cells and each cell holds the list of the entities it contains.
+ * Only the cells that contain entities are allocated. A query visits the cells overlapping
+ * a sphere, so its cost depends on the density around the point and not on the size of the world.
+ *
+ * Not thread-safe.
+ */
+class InterestGrid final {
+public:
+    /** \brief Constructor
+     *
+     * \param cell_size float the size of a cell, in the order of the radius of the queries
+     *
+     */
+    InterestGrid(float cell_size = 64.0f) : cell_size(cell_size) {}
+
+    /** \brief Set the position of an entity
+     *
+     * \param entity id_t the entity
+     * \param position const glm::vec3& the position, usually Transform::GetTranslation()
+     *
+     */
+    void Update(id_t entity, const glm::vec3& position) {
+        auto cell = CellOf(position.x, position.y, position.z);
+        auto it = entities.find(entity);
+        if (it == entities.end()) {
+            it = entities.emplace(entity, Entry()).first;
+        }
+        else if (it->second.cell != cell) {
+            Unlink(entity, it->second);
+        }
+        else {
+            it->second.x = position.x;
+            it->second.y = position.y;
+            it->second.z = position.z;
+            return;
+        }
+        auto& list = cells[cell];
+        it->second.cell = cell;
+        it->second.index = list.size();
+        it->second.x = position.x;
+        it->second.y = position.y;
+        it->second.z = position.z;
+        list.push_back(entity);
+    }
+
+    /** \brief Remove an entity
+     *
+     * \param entity id_t the entity
+     *
+     */
+    void Remove(id_t entity) {
+        auto it = entities.find(entity);
+        if (it == entities.end()) {
+            return;
+        }
+        Unlink(entity, it->second);
+        entities.erase(it);
+    }
+
+    /** \brief Visit the entities in a sphere
+     *
+     * \param center const glm::vec3& the center
+     * \param radius float the radius
+     * \param f the function called as f(id_t entity, float squared_distance)
+     *
+     */
+    template<class F>
+    void Query(const glm::vec3& center, float radius, F f) const {
+        auto r2 = radius * radius;
+        auto x0 = Coordinate(center.x - radius), x1 = Coordinate(center.x + radius);
+        auto y0 = Coordinate(center.y - radius), y1 = Coordinate(center.y + radius);
+        auto z0 = Coordinate(center.z - radius), z1 = Coordinate(center.z + radius);
+        for (auto x = x0; x <= x1; ++x) {
+            for (auto y = y0; y <= y1; ++y) {
+                for (auto z = z0; z <= z1; ++z) {
+                    auto cell = cells.find(Key(x, y, z));
+                    if (cell == cells.end()) {
+                        continue;
+                    }
+                    for (auto entity : cell->second) {
+                        const auto& e = entities.at(entity);
+                        auto dx = e.x - center.x, dy = e.y - center.y, dz = e.z - center.z;
+                        auto d2 = dx * dx + dy * dy + dz * dz;
+                        if (d2 <= r2) {
+                            f(entity, d2);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /// Get the number of entities
+    size_t Size() const {
+        return entities.size();
+    }
+
+    /// Get the number of cells allocated
+    size_t Cells() const {
+        return cells.size();
+    }
+
+private:
+    struct Entry {
+        uint64_t cell;
+        size_t index;
+        float x, y, z;
+    };
+
+    int32_t Coordinate(float v) const {
+        return static_cast<int32_t>(std::floor(v / cell_size));
+    }
+
+    // 21 bits per coordinate
+    static uint64_t Key(int32_t x, int32_t y, int32_t z) {
+        return (uint64_t(uint32_t(x) & 0x1FFFFF) << 42) | (uint64_t(uint32_t(y) & 0x1FFFFF) << 21) | uint64_t(uint32_t(z) & 0x1FFFFF);
+    }
+
+    uint64_t CellOf(float x, float y, float z) const {
+        return Key(Coordinate(x), Coordinate(y), Coordinate(z));
+    }
+
+    /** \brief Remove an entity from the list of its cell
+     *
+     */
+    void Unlink(id_t, const Entry& e) {
+        auto cell = cells.find(e.cell);
+        auto& list = cell->second;
+        // the last entity of the list takes the place of the entity removed
+        list[e.index] = list.back();
+        entities.at(list[e.index]).index = e.index;
+        list.pop_back();
+        if (list.empty()) {
+            cells.erase(cell);
+        }
+    }
+
+    const float cell_size;
+    std::unordered_map<uint64_t,std::vector<id_t>> cells;
+    std::unordered_map<id_t,Entry> entities;
+};
+
+/** \brief An entity relevant for a client
+ */
+struct Relevance {
+    id_t entity;
+    float priority;
+};
+
+/** \brief Select the entities replicated to each client
+ *
+ * Each tick, the entities within the radius of a client are relevant. Their priority
+ * is their closeness (1 near the client, 0 at the radius) multiplied by the number of ticks
+ * they have been waiting. When more entities than the budget of the client are relevant,
+ * the entities with the highest priority are selected, the others keep waiting, so
+ * that all of them are replicated in turn. The client keeps the entities waiting: only the
+ * entities out of the radius are removed from it.
+ *
+ * Not thread-safe.
+ */
+class InterestManager final {
+public:
+    InterestManager(const InterestGrid& grid) : grid(grid) {}
+
+    /** \brief Set the point of view of a client
+     *
+     * \param client id_t the client
+     * \param position const glm::vec3& the position of the client
+     * \param radius float the radius of interest
+     * \param budget size_t the maximal number of entities selected per tick
+     *
+     */
+    void SetViewer(id_t client, const glm::vec3& position, float radius, size_t budget) {
+        auto& viewer = viewers[client];
+        viewer.x = position.x;
+        viewer.y = position.y;
+        viewer.z = position.z;
+        viewer.radius = radius;
+        viewer.budget = budget;
+    }
+
+    void RemoveClient(id_t client) {
+        viewers.erase(client);
+    }
+
+    /** \brief Compute the entities selected for a client in this tick
+     *
+     * \param client id_t the client
+     * \param selected std::vector<Relevance>& the entities selected, by decreasing priority
+     * \param keys std::vector<id_t>& the same entities sorted, the keys updated by SnapshotReplicator
+     * \param interest std::vector<id_t>* if not null, all the entities in the radius sorted, the keys
+     * kept by SnapshotReplicator
+     *
+     */
+    void Select(id_t client, std::vector<Relevance>& selected, std::vector<id_t>& keys, std::vector<id_t>* interest = nullptr) {
+        selected.clear();
+        keys.clear();
+        if (interest) {
+            interest->clear();
+        }
+        auto it = viewers.find(client);
+        if (it == viewers.end()) {
+            return;
+        }
+        auto& viewer = it->second;
+        std::unordered_map<id_t,uint32_t> waiting;
+        grid.Query(glm::vec3(viewer.x, viewer.y, viewer.z), viewer.radius, [&](id_t entity, float d2) {
+            auto closeness = viewer.radius > 0.0f ? 1.0f - std::sqrt(d2) / viewer.radius : 1.0f;
+            // a minimum so that the entities at the radius are not starved
+            closeness = std::max(closeness, 1.0f / 64);
+            auto ticks = viewer.waiting.count(entity) ? viewer.waiting[entity] + 1 : 1;
+            waiting.emplace(entity, ticks);
+            selected.push_back(Relevance{ entity, closeness * ticks });
+        });
+        std::sort(selected.begin(), selected.end(), [](const Relevance& a, const Relevance& b) {
+            return a.priority > b.priority || (a.priority == b.priority && a.entity < b.entity);
+        });
+        if (selected.size() > viewer.budget) {
+            selected.resize(viewer.budget);
+        }
+        for (const auto& r : selected) {
+            // selected entities start waiting again
+            waiting[r.entity] = 0;
+            keys.push_back(r.entity);
+        }
+        if (interest) {
+            interest->reserve(waiting.size());
+            for (const auto& entry : waiting) {
+                interest->push_back(entry.first);
+            }
+            std::sort(interest->begin(), interest->end());
+        }
+        // entities out of the radius are forgotten
+        viewer.waiting = std::move(waiting);
+        std::sort(keys.begin(), keys.end());
+    }
+
+private:
+    struct Viewer {
+        Viewer() : x(0), y(0), z(0), radius(0), budget(0) {}
+        float x, y, z;
+        float radius;
+        size_t budget;
+        std::unordered_map<id_t,uint32_t> waiting;
+    };
+
+    const InterestGrid& grid;
+    std::unordered_map<id_t,Viewer> viewers;
+};
+
+} // namespace trillek
+
+#endif // INTEREST_GRID_HPP_INCLUDED
@@ -2,6 +2,7 @@
 #define REWINDABLE_MAP_HPP_INCLUDED
 #include <iostream>
 #include "bitmap.hpp"
+#include "persistent-map.hpp"
 #include "memory/trillek-allocator.hpp"
 #include "systems/async-data.hpp"
 #include "transform.hpp"
@@ -25,18 +26,24 @@ using History = std::pair<HistoryMap<SharedContainerConst<L,W>>,HistoryMap<Share
  * K and V are the key and the value types of the map.
  * Timepoint is the type used for comparison of order of commits
  * HistorySize is the capacity of the history of commits.
+ * Persistent selects a PersistentMap as workspace map. Each commit then records the
+ * root of the map, checkout is O(1) and any commit in history can be read with Snapshot().
  */
-template<class K, class V, class Timepoint, int HistorySize>
+template<class K, class V, class Timepoint, int HistorySize, bool Persistent = false>
 class RewindableMap final {
 
     typedef TrillekAllocator<std::pair<const K,V>> allocator_type;
     typedef TrillekAllocator<std::pair<const K,const V>> const_allocator_type;
+    typedef std::integral_constant<bool,Persistent> persistent_tag;
 public:
+    typedef typename std::conditional<Persistent,PersistentMap<K,V>,SharedContainer<K,V>>::type workspace_type;
+
     /** \brief Default constructor
      *
      */
     RewindableMap() : rewinded(false), highest_timepoint(-1),
-                    head_timepoint(-1) {};
+                    head_timepoint(-1),
+                    roots(Persistent ? make_unique<AsyncFrameData<workspace_type,HistorySize>>() : nullptr) {};
 
     /** \brief Insert a new pair in the workspace map.
      *
@@ -91,6 +98,19 @@ public:
             LOGMSGC(ERROR) << "In rewindable map: attempt to remove an element when rewinded";
             return;
         }
+        // the index keeps the value of the last commit and the last value written,
+        // whatever the number of modifications in this frame
+        auto written = updated.find(key);
+        if (written != updated.end()) {
+            updated.erase(written);
+            update_bitmap[key] = false;
+            if (! removed.count(key)) {
+                // inserted in this frame
+                datas.erase(key);
+                bitmap[key] = false;
+                return;
+            }
+        }
         auto rkey = key;
         removed.insert(std::make_pair<const K, const V>(std::move(rkey), std::move(datas.at(key))));
         datas.erase(key);
@@ -117,6 +137,9 @@ public:
         forward_data.Publish(std::move(updated), tp);
         backward_bitmap.Publish(std::move(removed_bitmap), tp);
         forward_bitmap.Publish(std::move(update_bitmap), tp);
+        if (roots) {
+            roots->Publish(datas, tp);
+        }
         updated.clear();
         removed.clear();
         update_bitmap = BitMap<uint32_t>();
@@ -139,17 +162,24 @@ public:
             LOGMSGC(ERROR) << "In rewindable map: attempt to checkout an inexisting commit";
             return head_timepoint;
         }
-        if (tp < head_timepoint) {
-            Rewind(tp);
-        }
-        else {
-            if (rewinded) {
-                Forward(tp);
-            }
-        }
+        Checkout(tp, persistent_tag());
         return head_timepoint;
     }
 
+    /** \brief Get the state of the map at a timepoint. Thread-safe.
+     *
+     * Only available with a persistent workspace. The map returned shares
+     * its nodes with the history, no data is copied.
+     *
+     * \param tp const Timepoint& the timepoint requested
+     * \return workspace_type the map as it was at tp
+     *
+     */
+    workspace_type Snapshot(const Timepoint& tp) const {
+        static_assert(Persistent, "Snapshot() requires a persistent RewindableMap");
+        return roots->GetCommitAt(tp).second;
+    }
+
     /** \brief Import the history into the map.
      *
      * This works as a rebase on a git branch. This includes a checkout.
@@ -207,7 +237,7 @@ public:
      * \return const data_type& the map
      *
      */
-    const SharedContainer<K,V>& Map() {
+    const workspace_type& Map() {
         return datas;
     }
 
@@ -283,6 +313,62 @@ public:
     }
 
 private:
+    /** \brief Checkout by replaying the history
+     *
+     * \param tp const Timepoint& the timepoint where to go
+     *
+     */
+    void Checkout(const Timepoint& tp, std::false_type) {
+        if (tp < head_timepoint) {
+            Rewind(tp);
+        }
+        else {
+            if (rewinded) {
+                Forward(tp);
+            }
+        }
+    }
+
+    /** \brief Checkout by restoring the root recorded by a commit
+     *
+     * \param tp const Timepoint& the timepoint where to go
+     *
+     */
+    void Checkout(const Timepoint& tp, std::true_type) {
+        if (tp >= head_timepoint && ! rewinded) {
+            return;
+        }
+        auto commit = roots->GetCommitAt(tp);
+        datas = std::move(commit.second);
+        head_timepoint = tp < head_timepoint ? tp : commit.first;
+        rewinded = head_timepoint < highest_timepoint;
+    }
+
+    /** \brief Rebuild the roots recorded after a timepoint from the history
+     *
+     * \param from const Timepoint& the last timepoint that was not modified
+     *
+     */
+    void RebaseRoots(const Timepoint& from, std::true_type) {
+        auto removals = backward_data.GetHistoryData(highest_timepoint, from);
+        auto additions = forward_data.GetHistoryData(highest_timepoint, from);
+        auto state = roots->GetCommitAt(from).second;
+        std::map<frame_tp,workspace_type> rebased;
+        auto rem_it = removals.cbegin();
+        for (auto add_it = additions.cbegin(); add_it != additions.cend() && rem_it != removals.cend(); ++add_it, ++rem_it) {
+            for (const auto& entry : rem_it->second) {
+                state.erase(entry.first);
+            }
+            for (const auto& entry : add_it->second) {
+                state.assign(entry.first, entry.second);
+            }
+            rebased.emplace(add_it->first, state);
+        }
+        roots->Rebase(HistoryMap<workspace_type>(rebased));
+    }
+
+    void RebaseRoots(const Timepoint&, std::false_type) {}
+
     /** \brief Make the workspace map go backward in history
      *
      * \param tp const Timepoint& the timepoint where to go
@@ -329,7 +415,8 @@ private:
         auto add_it = additions.cbegin();
         auto rem_end = removals.cend();
         auto add_end = additions.cend();
-        if (rem_it == rem_end || add_it == add_end || rem_it->first != add_it->first || rem_end->first != add_end->first) {
+        if (rem_it == rem_end || add_it == add_end || rem_it->first != add_it->first
+                || std::prev(rem_end)->first != std::prev(add_end)->first) {
             return;
         }
         for (; add_it != add_end; ++add_it, ++rem_it) {
@@ -361,7 +448,8 @@ private:
         auto add_it = additions.cbegin();
         auto rem_end = removals.cend();
         auto add_end = additions.cend();
-        if (rem_it == rem_end || rem_it->first != add_it->first || rem_end->first != add_end->first) {
+        if (rem_it == rem_end || add_it == add_end || rem_it->first != add_it->first
+                || std::prev(rem_end)->first != std::prev(add_end)->first) {
             return;
         }
         if (rem_it->first <= head_timepoint) {
@@ -372,12 +460,13 @@ private:
         if (next_head > highest_timepoint) {
             highest_timepoint = next_head;
         }
+        RebaseRoots(head_timepoint, persistent_tag());
         rewinded = true;
         Checkout(highest_timepoint);
     }
 
     // the data
-    SharedContainer<K,V> datas;
+    workspace_type datas;
     // the bitmap of the data
     BitMap<uint32_t> bitmap;
     // modifications in index
@@ -398,6 +487,8 @@ private:
     // Bitmaps
     AsyncFrameData<BitMap<uint32_t>> forward_bitmap;
     AsyncFrameData<BitMap<uint32_t>> backward_bitmap;
+    // roots of the persistent workspace for each commit
+    std::unique_ptr<AsyncFrameData<workspace_type,HistorySize>> roots;
 };
 } // namespace trillek
 
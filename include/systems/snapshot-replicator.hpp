@@ -0,0 +1,441 @@
+#ifndef SNAPSHOT_REPLICATOR_HPP_INCLUDED
+#define SNAPSHOT_REPLICATOR_HPP_INCLUDED
+
+#include <cstring>
+#include <map>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "systems/delta-history.hpp"
+#include "util/bit-stream.hpp"
+
+namespace trillek {
+
+/** \brief Bit-packed encoding of the difference between 2 states of a map
+ *
+ * The encoding is:
+ * - the target frame (64 bits), a flag telling if there is a baseline (1 bit) and the baseline frame (64 bits),
+ * - the number of entries (gamma code),
+ * - for each entry, by increasing key: the operation (2 bits), the difference with the previous key (gamma code),
+ * and, except for a removal, the value as the XOR with the old value (zero for an insertion).
+ *
+ * The XOR is cut in 32-bit words. A word that did not change takes 1 bit, the others take 1 + 5 bits
+ * plus their significant bits, so that a small modification of a number takes a few bits.
+ *
+ * K must be an unsigned integer of at most 32 bits and T must be trivially copyable.
+ */
+template<class K, class T>
+class SnapshotDelta final {
+    static_assert(std::is_integral<K>::value && std::is_unsigned<K>::value && sizeof(K) <= 4,
+                  "SnapshotDelta key must be an unsigned integer of at most 32 bits");
+    static_assert(std::is_trivially_copyable<T>::value, "SnapshotDelta value must be trivially copyable");
+
+    enum Operation { INSERT = 1, REMOVE = 2, UPDATE = 3 };
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+public:
+    typedef std::map<K,T> state_type;
+
+    /** \brief Encode the difference between 2 states
+     *
+     * \param baseline const state_type* the state known by the receiver, nullptr to send a full state
+     * \param baseline_frame frame_tp the frame of the baseline
+     * \param current const state_type& the state to send
+     * \param frame frame_tp the frame of the state to send
+     * \param out util::BitWriter& the output
+     *
+     */
+    static void Encode(const state_type* baseline, frame_tp baseline_frame, const state_type& current,
+                       frame_tp frame, util::BitWriter& out) {
+        static const state_type empty;
+        const auto& base = baseline ? *baseline : empty;
+        out.Write64(static_cast<uint64_t>(frame));
+        out.Write(baseline ? 1 : 0, 1);
+        if (baseline) {
+            out.Write64(static_cast<uint64_t>(baseline_frame));
+        }
+        // first pass to count the entries
+        uint32_t count = 0;
+        Diff(base, current, [&count](Operation, const K&, const T*, const T*) { ++count; });
+        out.WriteGamma(count);
+        K previous = 0;
+        bool first = true;
+        Diff(base, current, [&](Operation op, const K& key, const T* old_value, const T* new_value) {
+            out.Write(op, 2);
+            out.WriteGamma(static_cast<uint32_t>(key - previous - (first ? 0 : 1)));
+            previous = key;
+            first = false;
+            if (op != REMOVE) {
+                PutXor(out, old_value, *new_value);
+            }
+        });
+    }
+
+    /** \brief Decode the header of a delta
+     *
+     * \param in util::BitReader& the input
+     * \param frame frame_tp& the frame of the state encoded
+     * \param has_baseline bool& true if the delta must be applied on a baseline
+     * \param baseline_frame frame_tp& the frame of the baseline
+     * \return bool false if the data is malformed
+     *
+     */
+    static bool DecodeHeader(util::BitReader& in, frame_tp& frame, bool& has_baseline, frame_tp& baseline_frame) {
+        frame = static_cast<frame_tp>(in.Read64());
+        has_baseline = in.Read(1) != 0;
+        baseline_frame = has_baseline ? static_cast<frame_tp>(in.Read64()) : 0;
+        return ! in.Error();
+    }
+
+    /** \brief Apply the entries of a delta on a state
+     *
+     * \param in util::BitReader& the input, after the header
+     * \param state state_type& the baseline, modified to become the state encoded
+     * \return bool false if the data is malformed or does not match the state
+     *
+     */
+    static bool DecodeEntries(util::BitReader& in, state_type& state) {
+        auto count = in.ReadGamma();
+        K previous = 0;
+        for (uint32_t i = 0; i < count && ! in.Error(); ++i) {
+            auto op = static_cast<Operation>(in.Read(2));
+            auto key = static_cast<K>(previous + in.ReadGamma() + (i ? 1 : 0));
+            previous = key;
+            if (op == REMOVE) {
+                if (! state.erase(key)) {
+                    return false;
+                }
+                continue;
+            }
+            auto it = state.find(key);
+            if ((op == UPDATE) != (it != state.end())) {
+                return false;
+            }
+            if (op == INSERT) {
+                T zero;
+                std::memset(static_cast<void*>(&zero), 0, sizeof(T));
+                it = state.emplace(key, zero).first;
+            }
+            ApplyXor(in, it->second);
+        }
+        return ! in.Error();
+    }
+
+private:
+    template<class F>
+    static void Diff(const state_type& base, const state_type& current, F f) {
+        auto old_it = base.cbegin();
+        auto new_it = current.cbegin();
+        while (old_it != base.cend() || new_it != current.cend()) {
+            if (new_it == current.cend() || (old_it != base.cend() && old_it->first < new_it->first)) {
+                f(REMOVE, old_it->first, &old_it->second, nullptr);
+                ++old_it;
+            }
+            else if (old_it == base.cend() || new_it->first < old_it->first) {
+                f(INSERT, new_it->first, nullptr, &new_it->second);
+                ++new_it;
+            }
+            else {
+                if (std::memcmp(&old_it->second, &new_it->second, sizeof(T))) {
+                    f(UPDATE, new_it->first, &old_it->second, &new_it->second);
+                }
+                ++old_it;
+                ++new_it;
+            }
+        }
+    }
+
+    static void ToWords(const T* value, uint32_t (&words)[WORDS]) {
+        std::memset(words, 0, sizeof(words));
+        if (value) {
+            std::memcpy(words, value, sizeof(T));
+        }
+    }
+
+    static void PutXor(util::BitWriter& out, const T* old_value, const T& new_value) {
+        uint32_t a[WORDS], b[WORDS];
+        ToWords(old_value, a);
+        ToWords(&new_value, b);
+        for (size_t i = 0; i < WORDS; ++i) {
+            auto delta = a[i] ^ b[i];
+            if (! delta) {
+                out.Write(0, 1);
+                continue;
+            }
+            unsigned int bits = 1;
+            while (bits < 32 && (delta >> bits)) {
+                ++bits;
+            }
+            out.Write(1, 1);
+            out.Write(bits - 1, 5);
+            out.Write(delta, bits);
+        }
+    }
+
+    static void ApplyXor(util::BitReader& in, T& value) {
+        uint32_t words[WORDS];
+        ToWords(&value, words);
+        for (size_t i = 0; i < WORDS; ++i) {
+            if (in.Read(1)) {
+                auto bits = static_cast<unsigned int>(in.Read(5)) + 1;
+                words[i] ^= static_cast<uint32_t>(in.Read(bits));
+            }
+        }
+        std::memcpy(&value, words, sizeof(T));
+    }
+};
+
+/** \brief Server side of the replication of a map to clients
+ *
+ * Each client receives the difference between the current state and the state of the last
+ * frame it acknowledged, rebuilt from the delta history of the map. If the client did not
+ * acknowledge a frame yet, or if its frame is older than the history, it receives a full state.
+ *
+ * For a Shared<C> component, the history is Shared<C>::History() and the current state
+ * is Shared<C>::Map().Map(), read after the commit of the frame.
+ *
+ * The baselines are rebuilt once per frame and shared by the clients that acknowledged the
+ * same frame.
+ *
+ * The state sent to a client can be limited by an InterestManager to the entities updated in this
+ * tick, among the entities of interest. The other entities of interest keep the value the client
+ * has, and an entity is removed from the client only when it leaves the interest set. The states
+ * sent are then kept until they are acknowledged, since they are the baselines of the client.
+ *
+ * Only the last MAX_UNACKNOWLEDGED frames sent can be a baseline: the client keeps as many states.
+ * A client that lost its baseline anyway asks for a full state, sent after Resync().
+ *
+ * Not thread-safe.
+ */
+template<class K, class T>
+class SnapshotReplicator final {
+public:
+    typedef std::map<K,T> state_type;
+
+    // the number of frames sent without acknowledgment after which the oldest are forgotten
+    static const size_t MAX_UNACKNOWLEDGED = 64;
+
+    /** \brief Constructor
+     *
+     * \param history const DeltaHistory<K,T>& the history of the map to replicate
+     *
+     */
+    SnapshotReplicator(const DeltaHistory<K,T>& history) : history(history), cache_frame(-1) {}
+
+    /** \brief Encode the state of a frame for a client
+     *
+     * The history must be recorded up to frame.
+     *
+     * \param client id_t the client
+     * \param frame frame_tp the current frame
+     * \param current const M& the current map
+     * \param value F the accessor returning a const T& from a mapped value of M
+     * \param out util::BitWriter& the output
+     * \param updated const std::vector<K>* the keys to update for this client, nullptr to send all of them
+     * \param interest const std::vector<K>* the sorted keys the client keeps, nullptr if they are the updated keys
+     *
+     */
+    template<class M, class F>
+    void Encode(id_t client, frame_tp frame, const M& current, F value, util::BitWriter& out,
+                const std::vector<K>* updated = nullptr, const std::vector<K>* interest = nullptr) {
+        if (frame != cache_frame) {
+            cache_frame = frame;
+            baselines.clear();
+            current_state.clear();
+            for (const auto& entry : current) {
+                current_state.emplace(entry.first, value(entry.second));
+            }
+        }
+        auto& c = clients[client];
+        c.last_sent = frame;
+        const state_type* baseline = nullptr;
+        auto sent = c.sent.find(c.acknowledged);
+        if (c.has_ack && sent != c.sent.end() && sent->second.filtered) {
+            // the state the client has
+            baseline = &sent->second.state;
+        }
+        else if (c.has_ack && sent != c.sent.end()) {
+            auto it = baselines.find(c.acknowledged);
+            if (it == baselines.end()) {
+                auto state = current_state;
+                if (history.Rewind(c.acknowledged, state)) {
+                    it = baselines.emplace(c.acknowledged, std::move(state)).first;
+                }
+            }
+            if (it != baselines.end()) {
+                baseline = &it->second;
+            }
+        }
+        if (updated) {
+            Sent record;
+            record.filtered = true;
+            if (interest) {
+                // the entities of interest that are not updated keep the last value sent
+                const auto& known = c.last_state.empty() && baseline ? *baseline : c.last_state;
+                for (const auto& key : *interest) {
+                    auto it = known.find(key);
+                    if (it != known.end() && current_state.count(key)) {
+                        record.state.emplace_hint(record.state.end(), key, it->second);
+                    }
+                }
+            }
+            for (const auto& key : *updated) {
+                auto it = current_state.find(key);
+                if (it != current_state.end()) {
+                    record.state[key] = it->second;
+                }
+            }
+            SnapshotDelta<K,T>::Encode(baseline, c.acknowledged, record.state, frame, out);
+            c.last_state = record.state;
+            c.sent[frame] = std::move(record);
+        }
+        else {
+            c.sent[frame].filtered = false;
+            c.last_state.clear();
+            SnapshotDelta<K,T>::Encode(baseline, c.acknowledged, current_state, frame, out);
+        }
+        while (c.sent.size() > MAX_UNACKNOWLEDGED) {
+            c.sent.erase(c.sent.begin());
+        }
+    }
+
+    /** \brief Record the acknowledgment of a frame by a client
+     *
+     * Frames that were not sent and frames older than the last acknowledgment are ignored.
+     *
+     * \param client id_t the client
+     * \param frame frame_tp the frame received by the client
+     *
+     */
+    void Acknowledge(id_t client, frame_tp frame) {
+        auto it = clients.find(client);
+        if (it == clients.end() || frame > it->second.last_sent || (it->second.has_ack && frame <= it->second.acknowledged)) {
+            return;
+        }
+        it->second.acknowledged = frame;
+        it->second.has_ack = true;
+        auto& sent = it->second.sent;
+        sent.erase(sent.begin(), sent.lower_bound(frame));
+    }
+
+    void RemoveClient(id_t client) {
+        clients.erase(client);
+    }
+
+    /** \brief Send a full state to a client at the next frame
+     *
+     * Called when the client reports that it cannot apply the deltas received.
+     *
+     * \param client id_t the client
+     *
+     */
+    void Resync(id_t client) {
+        auto it = clients.find(client);
+        if (it != clients.end()) {
+            it->second.has_ack = false;
+            it->second.sent.clear();
+        }
+    }
+
+private:
+    // a frame sent, with the state of the client when it is filtered
+    struct Sent {
+        Sent() : filtered(false) {}
+        bool filtered;
+        state_type state;
+    };
+
+    struct Client {
+        Client() : acknowledged(0), last_sent(0), has_ack(false) {}
+        frame_tp acknowledged;
+        frame_tp last_sent;
+        bool has_ack;
+        std::map<frame_tp,Sent> sent;
+        // the state of the last frame sent, when filtered
+        state_type last_state;
+    };
+
+    const DeltaHistory<K,T>& history;
+    std::unordered_map<id_t,Client> clients;
+    // the state of the current frame and the baselines built during this frame
+    frame_tp cache_frame;
+    state_type current_state;
+    std::map<frame_tp,state_type> baselines;
+};
+
+/** \brief Client side of the replication of a map
+ *
+ * The states received are kept for the last frames, since the server encodes each
+ * delta against the last acknowledgment it got, which may be older than the last state received.
+ * The depth is the number of frames that the server keeps unacknowledged. If the baseline of a
+ * delta is unknown anyway, Apply() fails and the client must ask the server for a full state.
+ *
+ * Not thread-safe.
+ */
+template<class K, class T>
+class SnapshotReplica final {
+public:
+    typedef std::map<K,T> state_type;
+
+    /** \brief Constructor
+     *
+     * \param depth size_t the number of states kept
+     *
+     */
+    SnapshotReplica(size_t depth = SnapshotReplicator<K,T>::MAX_UNACKNOWLEDGED) : depth(depth) {}
+
+    /** \brief Apply a delta received from the server
+     *
+     * \param data const char* the delta
+     * \param size size_t the size of the delta
+     * \param frame frame_tp& set to the frame received, to be acknowledged
+     * \return bool false if the data is malformed or if the baseline is not known anymore
+     *
+     */
+    bool Apply(const char* data, size_t size, frame_tp& frame) {
+        util::BitReader in(data, size);
+        bool has_baseline;
+        frame_tp baseline_frame;
+        if (! SnapshotDelta<K,T>::DecodeHeader(in, frame, has_baseline, baseline_frame)) {
+            return false;
+        }
+        state_type state;
+        if (has_baseline) {
+            auto it = states.find(baseline_frame);
+            if (it == states.end()) {
+                return false;
+            }
+            state = it->second;
+        }
+        if (! SnapshotDelta<K,T>::DecodeEntries(in, state)) {
+            return false;
+        }
+        states[frame] = std::move(state);
+        while (states.size() > depth) {
+            states.erase(states.begin());
+        }
+        return true;
+    }
+
+    /** \brief Get the most recent state received
+     *
+     */
+    const state_type& State() const {
+        static const state_type empty;
+        return states.empty() ? empty : states.crbegin()->second;
+    }
+
+    /** \brief Get the frame of the most recent state received
+     *
+     */
+    frame_tp Frame() const {
+        return states.empty() ? -1 : states.crbegin()->first;
+    }
+
+private:
+    const size_t depth;
+    std::map<frame_tp,state_type> states;
+};
+
+} // namespace trillek
+
+#endif // SNAPSHOT_REPLICATOR_HPP_INCLUDED
@@ -19,6 +19,13 @@
 #define NOEXCEPT
 #endif
 
+// [[deprecated]] will be in C++14
+#ifndef _MSC_VER
+#define DEPRECATED __attribute__((deprecated))
+#else
+#define DEPRECATED __declspec(deprecated)
+#endif
+
 // make_unique will be in C++14. Implemented here since we're using C++11.
 // VS2013 already implements it, GCC 4.9 will implement it
 // TODO: remove it when using GCC 4.9 and -std=c++1y
@@ -55,7 +62,19 @@ namespace trillek {
 // type of an entity #id
 typedef uint32_t id_t;
 
-template<class T, class Alloc>
+namespace memory {
+// subsystems for which the allocations are accounted, see AllocationTracker
+enum class AllocationTag : uint8_t {
+    GENERAL,
+    COMPONENT,
+    RESOURCE,
+    NETWORK,
+    SCRIPTING,
+    TAG_COUNT
+};
+}
+
+template<class T, class Alloc = std::allocator<T>, memory::AllocationTag Tag = memory::AllocationTag::GENERAL>
 class TrillekAllocator;
 
 // type of a list
@@ -0,0 +1,161 @@
+#ifndef BIT_STREAM_HPP_INCLUDED
+#define BIT_STREAM_HPP_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace trillek {
+namespace util {
+
+/** \brief Write values of any number of bits in a byte buffer
+ *
+ * The bits are packed from the least significant bit of each byte.
+ */
+class BitWriter final {
+public:
+    BitWriter() : bit_buffer(0), num_bits(0) {}
+
+    /** \brief Write the count least significant bits of value
+     *
+     * \param value uint64_t the value
+     * \param count unsigned int the number of bits, at most 32
+     *
+     */
+    void Write(uint64_t value, unsigned int count) {
+        if (count < 64) {
+            value &= (uint64_t(1) << count) - 1;
+        }
+        bit_buffer |= value << num_bits;
+        num_bits += count;
+        while (num_bits >= 8) {
+            bytes.push_back(static_cast<char>(bit_buffer & 0xFF));
+            bit_buffer >>= 8;
+            num_bits -= 8;
+        }
+    }
+
+    /** \brief Write a 64-bit value
+     *
+     */
+    void Write64(uint64_t value) {
+        Write(value & 0xFFFFFFFF, 32);
+        Write(value >> 32, 32);
+    }
+
+    /** \brief Write an unsigned value with the Elias gamma code
+     *
+     * Small values take few bits: 1 bit for 0, 3 bits for 1 and 2, etc.
+     *
+     * \param value uint32_t the value
+     *
+     */
+    void WriteGamma(uint32_t value) {
+        uint64_t v = uint64_t(value) + 1;
+        unsigned int length = 0;
+        while (v >> (length + 1)) {
+            ++length;
+        }
+        Write(0, length);
+        // the bits of v from the most significant one
+        for (unsigned int i = length + 1; i-- > 0;) {
+            Write((v >> i) & 1, 1);
+        }
+    }
+
+    /** \brief Get the bytes written, the last byte being padded with zeros
+     *
+     */
+    const std::vector<char>& Bytes() {
+        if (num_bits) {
+            bytes.push_back(static_cast<char>(bit_buffer & 0xFF));
+            bit_buffer = 0;
+            num_bits = 0;
+        }
+        return bytes;
+    }
+
+    /// Get the number of bits written
+    size_t BitSize() const {
+        return bytes.size() * 8 + num_bits;
+    }
+
+    void Clear() {
+        bytes.clear();
+        bit_buffer = 0;
+        num_bits = 0;
+    }
+
+private:
+    std::vector<char> bytes;
+    uint64_t bit_buffer;
+    unsigned int num_bits;
+};
+
+/** \brief Read the values written by a BitWriter
+ *
+ * Reading after the end returns zeros and sets the error flag.
+ */
+class BitReader final {
+public:
+    BitReader(const char* data, size_t size) : data(data), size(size), position(0), bit_buffer(0), num_bits(0), error(false) {}
+
+    /** \brief Read count bits
+     *
+     * \param count unsigned int the number of bits, at most 32
+     * \return uint64_t the value
+     *
+     */
+    uint64_t Read(unsigned int count) {
+        while (num_bits < count) {
+            if (position == size) {
+                error = true;
+                return 0;
+            }
+            bit_buffer |= uint64_t(static_cast<unsigned char>(data[position++])) << num_bits;
+            num_bits += 8;
+        }
+        auto value = count < 64 ? bit_buffer & ((uint64_t(1) << count) - 1) : bit_buffer;
+        bit_buffer = count < 64 ? bit_buffer >> count : 0;
+        num_bits -= count;
+        return value;
+    }
+
+    uint64_t Read64() {
+        auto low = Read(32);
+        return low | (Read(32) << 32);
+    }
+
+    uint32_t ReadGamma() {
+        unsigned int length = 0;
+        while (! Read(1)) {
+            if (error || ++length > 32) {
+                error = true;
+                return 0;
+            }
+        }
+        uint64_t v = 1;
+        for (unsigned int i = 0; i < length; ++i) {
+            v = (v << 1) | Read(1);
+        }
+        return static_cast<uint32_t>(v - 1);
+    }
+
+    /// Tell if the data was too short or malformed
+    bool Error() const {
+        return error;
+    }
+
+private:
+    const char* data;
+    size_t size;
+    size_t position;
+    uint64_t bit_buffer;
+    unsigned int num_bits;
+    bool error;
+};
+
+} // util
+} // trillek
+
+#endif // BIT_STREAM_HPP_INCLUDED
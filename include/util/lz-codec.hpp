@@ -0,0 +1,311 @@
+#ifndef LZ_CODEC_HPP_INCLUDED
+#define LZ_CODEC_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace trillek {
+namespace util {
+namespace algorithm {
+
+/** \brief Fast LZ77 codec for network payloads
+ *
+ * The format is a sequence of blocks, in the manner of LZ4:
+ * - a token: the number of literals in the high 4 bits, the length of the match minus 4 in the low 4 bits,
+ * a value of 15 being followed by bytes of 255 and a last byte < 255 that are added,
+ * - the literals,
+ * - the offset of the match on 2 bytes, little endian.
+ * The last block has only literals.
+ *
+ * The matches are searched with a single hash table of the positions of 4-byte sequences, without
+ * chain, which favours speed over ratio.
+ *
+ * A dictionary can be set: the data is then compressed as if it followed the dictionary, so that
+ * small messages find matches in it. It must be the same on both sides. Train() builds a dictionary
+ * from samples of the traffic.
+ *
+ * The size of the uncompressed data is not stored and must be provided to Decompress().
+ * The methods are const and thread-safe.
+ */
+class LZCodec final {
+    static const unsigned int HASH_BITS = 12;
+    static const size_t MIN_MATCH = 4;
+    static const size_t MAX_OFFSET = 0xFFFF;
+    // the last literals are not searched for matches
+    static const size_t LAST_LITERALS = 5;
+public:
+    /** \brief Constructor
+     *
+     * \param dictionary std::string the dictionary, of which the last 64 KiB are used
+     *
+     */
+    LZCodec(std::string dictionary = std::string()) {
+        if (dictionary.size() > MAX_OFFSET) {
+            dictionary.erase(0, dictionary.size() - MAX_OFFSET);
+        }
+        this->dictionary = std::move(dictionary);
+        std::fill(dictionary_table, dictionary_table + (1 << HASH_BITS), 0);
+        const auto dict = this->dictionary.data();
+        for (size_t i = 0; i + MIN_MATCH <= this->dictionary.size(); ++i) {
+            // positions are stored + 1, 0 meaning no position
+            dictionary_table[Hash(dict + i)] = static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    /** \brief Get the maximal size of the compressed data
+     *
+     * \param size size_t the size of the data
+     * \return size_t the size of the output buffer needed
+     *
+     */
+    static size_t Bound(size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    /** \brief Compress data
+     *
+     * \param in const char* the data
+     * \param size size_t the size of the data
+     * \param out char* the output buffer
+     * \param capacity size_t the size of the output buffer
+     * \return size_t the size of the compressed data, 0 if it does not fit in capacity
+     *
+     */
+    size_t Compress(const char* in, size_t size, char* out, size_t capacity) const {
+        // positions relative to the beginning of the dictionary, + 1
+        uint32_t table[1 << HASH_BITS];
+        std::memcpy(table, dictionary_table, sizeof(table));
+        const auto dict = dictionary.data();
+        const auto dict_size = dictionary.size();
+        // the byte at position p of the virtual buffer dictionary + input
+        auto at = [&](size_t p) -> const char* { return p < dict_size ? dict + p : in + (p - dict_size); };
+        auto op = out;
+        auto oend = out + capacity;
+        size_t anchor = 0;
+        size_t i = 0;
+        while (size >= LAST_LITERALS + MIN_MATCH && i <= size - LAST_LITERALS - MIN_MATCH) {
+            auto h = Hash(in + i);
+            auto candidate = table[h];
+            auto position = dict_size + i;
+            table[h] = static_cast<uint32_t>(position + 1);
+            if (! candidate || position - (candidate - 1) > MAX_OFFSET
+                    || ! Equal4(at(candidate - 1), in + i, candidate - 1, dict_size)) {
+                ++i;
+                continue;
+            }
+            auto ref = candidate - 1;
+            // extend the match, it may cross the end of the dictionary
+            size_t length = MIN_MATCH;
+            auto limit = size - LAST_LITERALS - i;
+            while (length < limit && *at(ref + length) == in[i + length]) {
+                ++length;
+            }
+            if (! PutSequence(op, oend, in + anchor, i - anchor, length, position - ref)) {
+                return 0;
+            }
+            i += length;
+            anchor = i;
+        }
+        if (! PutSequence(op, oend, in + anchor, size - anchor, 0, 0)) {
+            return 0;
+        }
+        return static_cast<size_t>(op - out);
+    }
+
+    /** \brief Decompress data
+     *
+     * \param in const char* the compressed data
+     * \param size size_t the size of the compressed data
+     * \param out char* the output buffer
+     * \param out_size size_t the size of the uncompressed data
+     * \return bool false if the data is malformed or does not have the size expected
+     *
+     */
+    bool Decompress(const char* in, size_t size, char* out, size_t out_size) const {
+        auto ip = reinterpret_cast<const uint8_t*>(in);
+        auto iend = ip + size;
+        size_t o = 0;
+        const auto dict_size = dictionary.size();
+        while (ip < iend) {
+            auto token = *ip++;
+            size_t literals = token >> 4;
+            if (literals == 15 && ! GetLength(ip, iend, literals)) {
+                return false;
+            }
+            if (static_cast<size_t>(iend - ip) < literals || out_size - o < literals) {
+                return false;
+            }
+            std::memcpy(out + o, ip, literals);
+            ip += literals;
+            o += literals;
+            if (ip == iend) {
+                // last block
+                break;
+            }
+            if (iend - ip < 2) {
+                return false;
+            }
+            size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+            ip += 2;
+            size_t length = token & 0x0F;
+            if (length == 15 && ! GetLength(ip, iend, length)) {
+                return false;
+            }
+            length += MIN_MATCH;
+            if (! offset || offset > o + dict_size || out_size - o < length) {
+                return false;
+            }
+            if (offset > o) {
+                // the match begins in the dictionary
+                auto from_dict = std::min(offset - o, length);
+                std::memcpy(out + o, dictionary.data() + dict_size - (offset - o), from_dict);
+                o += from_dict;
+                length -= from_dict;
+            }
+            // byte per byte, the match may overlap the output
+            for (auto src = out + o - offset; length; --length) {
+                out[o++] = *src++;
+            }
+        }
+        return o == out_size;
+    }
+
+    /** \brief Build a dictionary from samples of messages
+     *
+     * The substrings of 8 bytes found in the most samples are kept, the most frequent
+     * ones being put at the end, where the offsets are the smallest.
+     *
+     * \param samples const std::vector<std::string>& the samples
+     * \param size size_t the maximal size of the dictionary
+     * \return std::string the dictionary
+     *
+     */
+    static std::string Train(const std::vector<std::string>& samples, size_t size) {
+        const size_t SEGMENT = 8;
+        std::unordered_map<std::string,std::pair<size_t,size_t>> counts;     // segment -> (samples, last sample)
+        for (size_t s = 0; s < samples.size(); ++s) {
+            const auto& sample = samples[s];
+            for (size_t i = 0; i + SEGMENT <= sample.size(); ++i) {
+                auto& c = counts[sample.substr(i, SEGMENT)];
+                if (! c.first || c.second != s) {
+                    ++c.first;
+                    c.second = s;
+                }
+            }
+        }
+        std::vector<std::pair<size_t,std::string>> ranked;
+        for (auto& c : counts) {
+            if (c.second.first > 1) {
+                ranked.emplace_back(c.second.first, c.first);
+            }
+        }
+        std::sort(ranked.begin(), ranked.end(), [](const std::pair<size_t,std::string>& a, const std::pair<size_t,std::string>& b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+        std::string ret;
+        for (const auto& r : ranked) {
+            if (ret.size() + SEGMENT > size) {
+                break;
+            }
+            // overlapping segments are merged
+            if (ret.find(r.second) == std::string::npos) {
+                ret.insert(0, r.second);
+            }
+        }
+        return ret;
+    }
+
+    const std::string& Dictionary() const {
+        return dictionary;
+    }
+
+private:
+    static uint32_t Read32(const char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint32_t Hash(const char* p) {
+        return (Read32(p) * 2654435761U) >> (32 - HASH_BITS);
+    }
+
+    /** \brief Compare 4 bytes, the reference may cross the end of the dictionary
+     *
+     */
+    static bool Equal4(const char* ref, const char* p, size_t ref_position, size_t dict_size) {
+        if (ref_position + MIN_MATCH <= dict_size || ref_position >= dict_size) {
+            return Read32(ref) == Read32(p);
+        }
+        return false;
+    }
+
+    static bool PutLength(char*& op, const char* oend, size_t length) {
+        while (length >= 255) {
+            if (op == oend) {
+                return false;
+            }
+            *op++ = static_cast<char>(0xFF);
+            length -= 255;
+        }
+        if (op == oend) {
+            return false;
+        }
+        *op++ = static_cast<char>(length);
+        return true;
+    }
+
+    static bool GetLength(const uint8_t*& ip, const uint8_t* iend, size_t& length) {
+        uint8_t b;
+        do {
+            if (ip == iend) {
+                return false;
+            }
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    }
+
+    /** \brief Write literals followed by a match, or the last literals if length is 0
+     *
+     */
+    static bool PutSequence(char*& op, const char* oend, const char* literals, size_t count, size_t length, size_t offset) {
+        if (op == oend) {
+            return false;
+        }
+        auto token = op++;
+        auto match = length ? length - MIN_MATCH : 0;
+        *token = static_cast<char>(((count < 15 ? count : 15) << 4) | (match < 15 ? match : 15));
+        if (count >= 15 && ! PutLength(op, oend, count - 15)) {
+            return false;
+        }
+        if (static_cast<size_t>(oend - op) < count) {
+            return false;
+        }
+        std::memcpy(op, literals, count);
+        op += count;
+        if (! length) {
+            return true;
+        }
+        if (oend - op < 2) {
+            return false;
+        }
+        *op++ = static_cast<char>(offset & 0xFF);
+        *op++ = static_cast<char>(offset >> 8);
+        return match < 15 || PutLength(op, oend, match - 15);
+    }
+
+    std::string dictionary;
+    uint32_t dictionary_table[1 << HASH_BITS];
+};
+
+} // algorithm
+} // util
+} // trillek
+
+#endif // LZ_CODEC_HPP_INCLUDED
@@ -0,0 +1,473 @@
+#ifndef WIRE_FORMAT_HPP_INCLUDED
+#define WIRE_FORMAT_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace trillek {
+namespace util {
+namespace wire {
+
+/** \brief Declare the fields of a message structure, in the order of the schema
+ *
+ * The schema of a message is the list of its fields:
+ *
+ *     struct Login {
+ *         uint16_t version;
+ *         wire::Varint<uint64_t> id;
+ *         wire::Bytes name;
+ *         TRILLEK_WIRE_FIELDS(version, id, name)
+ *     };
+ *
+ * The encoding of a field depends on its type:
+ * - integers, enums and floating point numbers: fixed size, little endian,
+ * - Varint<T>: LEB128, zigzag for the signed types,
+ * - Bytes: a varint length followed by the bytes,
+ * - ArrayView<T>: a varint count followed by the elements of fixed size,
+ * - a structure declaring its fields: nested message.
+ *
+ * A message is a varint of the size of the rest, a varint of the number of fields, and the fields.
+ * The schema evolves by adding fields at the end only: a decoder skips the fields it does not
+ * know, and leaves the fields that were not sent to the values they had before decoding.
+ */
+#define TRILLEK_WIRE_FIELDS(...) \
+    template<class V> void WireFields(V& v) { v(__VA_ARGS__); } \
+    template<class V> void WireFields(V& v) const { v(__VA_ARGS__); } \
+    static constexpr size_t WireFieldCount() { return trillek::util::wire::detail::Count(#__VA_ARGS__); }
+
+/** \brief An integer encoded in a variable number of bytes
+ *
+ */
+template<class T>
+struct Varint {
+    static_assert(std::is_integral<T>::value, "Varint of a non integral type");
+    Varint(T value = T()) : value(value) {}
+    operator T() const {
+        return value;
+    }
+    T value;
+};
+
+/** \brief A view on bytes of the buffer, decoded without copy
+ *
+ * The buffer must remain valid while the view is used.
+ */
+struct Bytes {
+    Bytes() : data(nullptr), size(0) {}
+    Bytes(const char* data, size_t size) : data(data), size(size) {}
+    Bytes(const std::string& s) : data(s.data()), size(s.size()) {}
+    std::string ToString() const {
+        return std::string(data, size);
+    }
+    const char* data;
+    size_t size;
+};
+
+/** \brief A view on an array of fixed size elements of the buffer
+ *
+ * The elements are decoded on access, as they are not aligned and are little endian.
+ */
+template<class T>
+struct ArrayView {
+    static_assert(std::is_arithmetic<T>::value, "ArrayView of a non arithmetic type");
+    ArrayView() : data(nullptr), count(0) {}
+    ArrayView(const T* values, size_t count) : data(reinterpret_cast<const char*>(values)), count(count), native(true) {}
+    T operator[](size_t i) const;
+    size_t size() const {
+        return count;
+    }
+    const char* data;
+    size_t count;
+    // true if data points on an array of T in memory, false if it points in an encoded buffer
+    bool native = false;
+};
+
+namespace detail {
+
+// count the fields of the macro from its string
+constexpr size_t Count(const char* s, size_t n = 1) {
+    return ! *s ? n : Count(s + 1, n + (*s == ','));
+}
+
+template<class T>
+struct HasFields {
+    template<class U> static auto Test(U* u) -> decltype(u->WireFieldCount(), std::true_type());
+    template<class U> static std::false_type Test(...);
+    static const bool value = decltype(Test<T>(nullptr))::value;
+};
+
+template<class T, size_t S = sizeof(T)> struct UnsignedOf;
+template<class T> struct UnsignedOf<T,1> { typedef uint8_t type; };
+template<class T> struct UnsignedOf<T,2> { typedef uint16_t type; };
+template<class T> struct UnsignedOf<T,4> { typedef uint32_t type; };
+template<class T> struct UnsignedOf<T,8> { typedef uint64_t type; };
+
+template<class T>
+typename UnsignedOf<T>::type ToBits(T value) {
+    typename UnsignedOf<T>::type bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+template<class T>
+T FromBits(typename UnsignedOf<T>::type bits) {
+    T value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+template<class T>
+typename std::make_unsigned<T>::type ZigZag(T value, std::true_type) {
+    typedef typename std::make_unsigned<T>::type U;
+    return (static_cast<U>(value) << 1) ^ static_cast<U>(value >> (sizeof(T) * 8 - 1));
+}
+
+template<class T>
+T ZigZag(T value, std::false_type) {
+    return value;
+}
+
+template<class T>
+T UnZigZag(typename std::make_unsigned<T>::type value, std::true_type) {
+    return static_cast<T>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+template<class T>
+T UnZigZag(T value, std::false_type) {
+    return value;
+}
+
+inline size_t VarintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+} // detail
+
+/** \brief Write the fields in a buffer of the size computed by Sizer
+ *
+ */
+class Writer final {
+public:
+    Writer(char* out) : p(out) {}
+
+    template<class T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type Put(T value) {
+        PutFixed(detail::ToBits(value));
+    }
+
+    template<class T>
+    void Put(const Varint<T>& v) {
+        PutVarint(detail::ZigZag(v.value, std::is_signed<T>()));
+    }
+
+    void Put(const Bytes& b) {
+        PutVarint(b.size);
+        if (b.size) {
+            std::memcpy(p, b.data, b.size);
+        }
+        p += b.size;
+    }
+
+    template<class T>
+    void Put(const ArrayView<T>& a) {
+        PutVarint(a.count);
+        for (size_t i = 0; i < a.count; ++i) {
+            Put(a[i]);
+        }
+    }
+
+    template<class T>
+    typename std::enable_if<detail::HasFields<T>::value>::type Put(const T& message);
+
+    void PutVarint(uint64_t value) {
+        while (value >= 0x80) {
+            *p++ = static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        *p++ = static_cast<char>(value);
+    }
+
+    template<class... F>
+    void operator()(const F&... fields) {
+        int expand[] = { (Put(fields), 0)... };
+        (void) expand;
+    }
+
+    char* Position() const {
+        return p;
+    }
+
+private:
+    template<class U>
+    void PutFixed(U bits) {
+        for (size_t i = 0; i < sizeof(U); ++i) {
+            *p++ = static_cast<char>(bits >> (8 * i));
+        }
+    }
+
+    char* p;
+};
+
+/** \brief Compute the size of the encoded fields
+ *
+ */
+class Sizer final {
+public:
+    Sizer() : size(0) {}
+
+    template<class T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type Add(T) {
+        size += sizeof(T);
+    }
+
+    template<class T>
+    void Add(const Varint<T>& v) {
+        size += detail::VarintSize(detail::ZigZag(v.value, std::is_signed<T>()));
+    }
+
+    void Add(const Bytes& b) {
+        size += detail::VarintSize(b.size) + b.size;
+    }
+
+    template<class T>
+    void Add(const ArrayView<T>& a) {
+        size += detail::VarintSize(a.count) + a.count * sizeof(T);
+    }
+
+    template<class T>
+    typename std::enable_if<detail::HasFields<T>::value>::type Add(const T& message);
+
+    template<class... F>
+    void operator()(const F&... fields) {
+        int expand[] = { (Add(fields), 0)... };
+        (void) expand;
+    }
+
+    size_t size;
+};
+
+/** \brief Read the fields in place, with bounds checking
+ *
+ * After an error, the reads do nothing and Error() is true.
+ */
+class Reader final {
+public:
+    Reader(const char* data, size_t size) : p(data), end(data + size), error(false), remaining_fields(SIZE_MAX) {}
+
+    template<class T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type Get(T& value) {
+        typedef typename detail::UnsignedOf<T>::type U;
+        if (! Available(sizeof(U))) {
+            return;
+        }
+        U bits = 0;
+        for (size_t i = 0; i < sizeof(U); ++i) {
+            bits |= static_cast<U>(static_cast<uint8_t>(p[i])) << (8 * i);
+        }
+        p += sizeof(U);
+        value = detail::FromBits<T>(bits);
+    }
+
+    void Get(bool& value) {
+        uint8_t byte = 0;
+        Get(byte);
+        value = byte != 0;
+    }
+
+    template<class T>
+    void Get(Varint<T>& v) {
+        typedef typename std::make_unsigned<T>::type U;
+        uint64_t value;
+        if (! GetVarint(value) || value > static_cast<U>(~U(0))) {
+            error = true;
+            return;
+        }
+        v.value = detail::UnZigZag<T>(static_cast<U>(value), std::is_signed<T>());
+    }
+
+    void Get(Bytes& b) {
+        uint64_t size;
+        if (! GetVarint(size) || ! Available(size)) {
+            error = true;
+            return;
+        }
+        b.data = p;
+        b.size = static_cast<size_t>(size);
+        p += size;
+    }
+
+    template<class T>
+    void Get(ArrayView<T>& a) {
+        uint64_t count;
+        if (! GetVarint(count) || count > static_cast<uint64_t>(end - p) / sizeof(T)) {
+            error = true;
+            return;
+        }
+        a.data = p;
+        a.count = static_cast<size_t>(count);
+        a.native = false;
+        p += a.count * sizeof(T);
+    }
+
+    template<class T>
+    typename std::enable_if<detail::HasFields<T>::value>::type Get(T& message);
+
+    bool GetVarint(uint64_t& value) {
+        value = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            if (! Available(1)) {
+                return false;
+            }
+            auto b = static_cast<uint8_t>(*p++);
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (! (b & 0x80)) {
+                return true;
+            }
+        }
+        error = true;
+        return false;
+    }
+
+    template<class... F>
+    void operator()(F&... fields) {
+        int expand[] = { (GetField(fields), 0)... };
+        (void) expand;
+    }
+
+    bool Error() const {
+        return error;
+    }
+
+    const char* Position() const {
+        return p;
+    }
+
+    const char* End() const {
+        return end;
+    }
+
+private:
+    bool Available(uint64_t size) {
+        if (error || static_cast<uint64_t>(end - p) < size) {
+            error = true;
+            return false;
+        }
+        return true;
+    }
+
+    // the fields that were not sent keep their values
+    template<class T>
+    void GetField(T& field) {
+        if (! remaining_fields) {
+            return;
+        }
+        --remaining_fields;
+        Get(field);
+    }
+
+    const char* p;
+    const char* end;
+    bool error;
+    size_t remaining_fields;
+};
+
+template<class T>
+T ArrayView<T>::operator[](size_t i) const {
+    if (native) {
+        return reinterpret_cast<const T*>(data)[i];
+    }
+    T value;
+    Reader(data + i * sizeof(T), sizeof(T)).Get(value);
+    return value;
+}
+
+template<class T>
+typename std::enable_if<detail::HasFields<T>::value>::type Sizer::Add(const T& message) {
+    Sizer fields;
+    message.WireFields(fields);
+    auto content = detail::VarintSize(T::WireFieldCount()) + fields.size;
+    size += detail::VarintSize(content) + content;
+}
+
+template<class T>
+typename std::enable_if<detail::HasFields<T>::value>::type Writer::Put(const T& message) {
+    Sizer fields;
+    message.WireFields(fields);
+    PutVarint(detail::VarintSize(T::WireFieldCount()) + fields.size);
+    PutVarint(T::WireFieldCount());
+    message.WireFields(*this);
+}
+
+template<class T>
+typename std::enable_if<detail::HasFields<T>::value>::type Reader::Get(T& message) {
+    uint64_t size, count;
+    if (! GetVarint(size) || ! Available(size)) {
+        error = true;
+        return;
+    }
+    Reader fields(p, static_cast<size_t>(size));
+    if (! fields.GetVarint(count)) {
+        error = true;
+        return;
+    }
+    fields.remaining_fields = static_cast<size_t>(count);
+    message.WireFields(fields);
+    // the unknown fields at the end are skipped
+    error = fields.error;
+    p += size;
+}
+
+/** \brief Get the size of an encoded message
+ *
+ */
+template<class T>
+size_t EncodedSize(const T& message) {
+    Sizer sizer;
+    sizer.Add(message);
+    return sizer.size;
+}
+
+/** \brief Encode a message
+ *
+ * \param message const T& the message
+ * \param out char* the buffer of EncodedSize(message) bytes
+ * \return size_t the size written
+ *
+ */
+template<class T>
+size_t Encode(const T& message, char* out) {
+    Writer writer(out);
+    writer.Put(message);
+    return static_cast<size_t>(writer.Position() - out);
+}
+
+/** \brief Decode a message in place
+ *
+ * The Bytes and ArrayView fields point in the buffer.
+ *
+ * \param message T& the message
+ * \param data const char* the buffer
+ * \param size size_t the size of the buffer
+ * \return bool false if the data is truncated or malformed
+ *
+ */
+template<class T>
+bool Decode(T& message, const char* data, size_t size) {
+    Reader reader(data, size);
+    reader.Get(message);
+    return ! reader.Error();
+}
+
+} // wire
+} // util
+} // trillek
+
+#endif // WIRE_FORMAT_HPP_INCLUDED
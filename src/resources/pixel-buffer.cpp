@@ -144,7 +144,7 @@ bool PixelBuffer::Create(uint32_t width, uint32_t height, uint32_t bitspersample
     bufferpitch = (bitspersample * imagepixelsize);
     bufferpitch = width * ((bufferpitch >> 3) + ((bufferpitch & 0x7) ? 1 : 0));
 
-    blockptr = std::unique_ptr<uint8_t[]>(new uint8_t[bufferpitch * height]);
+    blockptr = memory::HugePageAllocator::MakeArray<uint8_t,memory::AllocationTag::RESOURCE>(bufferpitch * height);
     if(!blockptr) {
         writelock.unlock();
         return false;
@@ -8,6 +8,7 @@
 
 #include "systems/system-base.hpp"
 #include "trillek-game.hpp"
+#include "memory/frame-arena.hpp"
 
 #if defined(_MSC_VER)
 #include "os.hpp"
@@ -119,6 +120,8 @@ void TrillekScheduler::DayWork(const scheduler_tp& now, SystemBase* system) {
                         // a new frame has begun : let's run the system
                         handleEvents_functor(next_frame_tp.time_since_epoch().count());
                         runBatch_functor();
+                        // transient data of the frame is released in bulk
+                        memory::FrameArena::ThreadArena().Reset();
                         next_frame_tp += one_frame;
                     }
                     // reacquire the lock of the blocking point
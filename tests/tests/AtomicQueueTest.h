@@ -7,9 +7,15 @@
 
 class AtomicQueueTest: public ::testing::Test {
 public:
-    AtomicQueueTest() {};
+    AtomicQueueTest() : allocated_size(AllocatedSize()) {};
+
+    static int64_t AllocatedSize() {
+        return trillek::memory::AllocationTracker::LiveBytes(trillek::memory::AllocationTag::GENERAL);
+    }
 protected:
     trillek::AtomicQueue<uint32_t> q;
+    // memory allocated by other tests
+    const int64_t allocated_size;
 };
 
 using trillek::AtomicQueue;
@@ -31,7 +37,7 @@ TEST_F(AtomicQueueTest, AtomicQueueOneElement) {
     ASSERT_EQ(i, 1) << "Queue popped  wrong value";
     ASSERT_TRUE(q.Empty()) << "Queue is not empty";
     ASSERT_TRUE(q.Poll().empty()) << "Polled queue gives elements";
-    ASSERT_EQ(gAllocatedSize, 0) << "Allocated size is not null";
+    ASSERT_EQ(AllocatedSize(), allocated_size) << "Allocated size is not null";
 }
 
 TEST_F(AtomicQueueTest, AtomicQueuePoll) {
@@ -47,7 +53,7 @@ TEST_F(AtomicQueueTest, AtomicQueuePoll) {
     ASSERT_EQ(ret.front(), 2) << "Second element from Poll has wrong value";
     ret.pop_front();
     ASSERT_TRUE(ret.empty()) << "Returned list from Poll() has more than 2 elements";
-    ASSERT_EQ(gAllocatedSize, 0) << "Allocated size is not null";
+    ASSERT_EQ(AllocatedSize(), allocated_size) << "Allocated size is not null";
 }
 
 TEST_F(AtomicQueueTest, AtomicQueuePop) {
@@ -62,7 +68,7 @@ TEST_F(AtomicQueueTest, AtomicQueuePop) {
     ASSERT_EQ(i, 2) << "Pop()  wrong value";
     ASSERT_TRUE(q.Empty()) << "Queue is not empty";
     ASSERT_TRUE(q.Poll().empty()) << "Empty queue gives elements";
-    ASSERT_EQ(gAllocatedSize, 0) << "Allocated size is not null";
+    ASSERT_EQ(AllocatedSize(), allocated_size) << "Allocated size is not null";
 }
 
 TEST_F(AtomicQueueTest, AtomicQueueCopyList) {
@@ -82,7 +88,7 @@ TEST_F(AtomicQueueTest, AtomicQueueCopyList) {
 }
 
 TEST_F(AtomicQueueTest, AtomicQueueMoveList) {
-    auto alloc_backup = gAllocatedSize;
+    auto alloc_backup = AllocatedSize();
     std::list<uint32_t, TrillekAllocator<uint32_t>> a{1,2,3,4,5};
     q.PushList(std::move(a));
     ASSERT_FALSE(q.Empty()) << "Queue is empty";
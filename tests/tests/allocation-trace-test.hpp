@@ -0,0 +1,129 @@
+#ifndef ALLOCATION_TRACE_TEST_HPP_INCLUDED
+#define ALLOCATION_TRACE_TEST_HPP_INCLUDED
+
+#include <list>
+#include <sstream>
+#include <string>
+#include "memory/allocation-trace.hpp"
+#include "memory/fifo-allocator.hpp"
+#include "memory/stream-allocator.hpp"
+#include "memory/thread-cache-allocator.hpp"
+#include "memory/trillek-allocator.hpp"
+#include "gtest/gtest.h"
+
+class AllocationTraceTest : public ::testing::Test {
+public:
+    AllocationTraceTest() :
+        frame(trillek::memory::AllocationTrace::Generate(trillek::memory::TracePattern::FRAME, 20000, 42)),
+        mixed(trillek::memory::AllocationTrace::Generate(trillek::memory::TracePattern::MIXED, 20000, 42)) {}
+protected:
+    void Record(const std::string& name, const trillek::memory::ReplayReport& report) {
+        RecordProperty(name + "_kops_per_second", static_cast<int>(report.operations_per_second / 1000));
+        RecordProperty(name + "_footprint_kB", static_cast<int>(report.peak_footprint_bytes / 1024));
+        RecordProperty(name + "_fragmentation_percent", static_cast<int>(report.fragmentation * 100));
+    }
+
+    trillek::memory::AllocationTrace frame;
+    trillek::memory::AllocationTrace mixed;
+};
+
+namespace trillek {
+    TEST_F(AllocationTraceTest, Record) {
+        memory::AllocationTrace trace;
+        std::vector<int> before(10);
+        trace.Start();
+        {
+            std::list<int,TrillekAllocator<int>> l{1, 2};
+            before.clear();
+            before.shrink_to_fit();
+        }
+        trace.Stop();
+        std::list<int,TrillekAllocator<int>> after{3};
+        // 2 nodes allocated and deallocated
+        ASSERT_EQ(4, trace.Events().size());
+        EXPECT_TRUE(trace.Events()[0].allocate);
+        EXPECT_FALSE(trace.Events()[3].allocate);
+        EXPECT_EQ(trace.Events()[0].size, trace.Events()[3].size);
+    }
+    TEST_F(AllocationTraceTest, Generate) {
+        auto again = memory::AllocationTrace::Generate(memory::TracePattern::MIXED, 20000, 42);
+        ASSERT_EQ(mixed.Events().size(), again.Events().size());
+        EXPECT_EQ(40000, again.Events().size());
+        for (size_t i = 0; i < again.Events().size(); ++i) {
+            ASSERT_EQ(mixed.Events()[i].id, again.Events()[i].id);
+            ASSERT_EQ(mixed.Events()[i].size, again.Events()[i].size);
+        }
+        EXPECT_TRUE(frame.IsFifo());
+        EXPECT_FALSE(mixed.IsFifo());
+    }
+    TEST_F(AllocationTraceTest, SaveLoad) {
+        std::stringstream ss;
+        mixed.Save(ss);
+        memory::AllocationTrace loaded;
+        ASSERT_TRUE(loaded.Load(ss));
+        ASSERT_EQ(mixed.Events().size(), loaded.Events().size());
+        EXPECT_EQ(mixed.PeakLiveBytes(), loaded.PeakLiveBytes());
+        std::stringstream bad("a 0 16\nd 1\n");
+        EXPECT_FALSE(loaded.Load(bad));
+    }
+    TEST_F(AllocationTraceTest, Replay) {
+        memory::MallocAllocator heap;
+        auto report = mixed.Replay(heap);
+        EXPECT_EQ(0, report.failures);
+        EXPECT_EQ(mixed.Events().size(), report.operations);
+        EXPECT_EQ(mixed.PeakLiveBytes(), report.peak_live_bytes);
+        memory::FIFOAllocator<1 << 16> fifo;
+        report = frame.Replay(fifo);
+        EXPECT_EQ(0, report.failures);
+        EXPECT_EQ(frame.PeakLiveBytes(), report.peak_live_bytes);
+    }
+    TEST_F(AllocationTraceTest, Compare) {
+        TrillekAllocator<char> tracked;
+        auto& cached = memory::ThreadCacheAllocator::Instance();
+        memory::FIFOAllocator<1 << 16> fifo;
+        auto ring = make_unique<memory::StreamAllocator<1 << 20,true>>();
+        // the heap is measured from the construction of the allocator
+        memory::MallocAllocator heap;
+        auto frame_heap = frame.Replay(heap);
+        auto frame_tracked = frame.Replay(tracked);
+        auto frame_cached = frame.Replay(cached);
+        auto frame_fifo = frame.Replay(fifo);
+        auto frame_ring = frame.Replay(*ring);
+        Record("frame_heap", frame_heap);
+        Record("frame_tracked", frame_tracked);
+        Record("frame_thread_cache", frame_cached);
+        Record("frame_fifo", frame_fifo);
+        Record("frame_ring", frame_ring);
+        for (const auto& report : { frame_heap, frame_tracked, frame_cached, frame_fifo, frame_ring }) {
+            EXPECT_EQ(0, report.failures);
+            EXPECT_EQ(frame.PeakLiveBytes(), report.peak_live_bytes);
+        }
+        // the ring reserves its whole buffer, the FIFO chain grows with the live blocks,
+        // the thread cache carves a slab per size class and rounds the sizes up
+        EXPECT_LE(1 << 20, frame_ring.peak_footprint_bytes);
+        EXPECT_LE(frame_fifo.peak_live_bytes, frame_fifo.peak_footprint_bytes);
+        EXPECT_LT(frame_fifo.peak_footprint_bytes, frame_ring.peak_footprint_bytes);
+        EXPECT_LT(frame_fifo.peak_footprint_bytes, frame_cached.peak_footprint_bytes);
+        EXPECT_LT(frame_fifo.fragmentation, frame_cached.fragmentation);
+
+        memory::MallocAllocator mixed_heap_alloc;
+        auto mixed_heap = mixed.Replay(mixed_heap_alloc);
+        auto mixed_tracked = mixed.Replay(tracked);
+        auto mixed_cached = mixed.Replay(cached);
+        auto mixed_ring = mixed.Replay(*ring);
+        Record("mixed_heap", mixed_heap);
+        Record("mixed_tracked", mixed_tracked);
+        Record("mixed_thread_cache", mixed_cached);
+        Record("mixed_ring", mixed_ring);
+        for (const auto& report : { mixed_heap, mixed_tracked, mixed_cached }) {
+            EXPECT_EQ(0, report.failures);
+            EXPECT_EQ(mixed.PeakLiveBytes(), report.peak_live_bytes);
+        }
+        EXPECT_LT(0, mixed_cached.fragmentation);
+        // a ring only reclaims the blocks released in order: the mixed pattern exhausts it
+        EXPECT_LT(0, mixed_ring.failures);
+        EXPECT_GT(mixed.PeakLiveBytes(), mixed_ring.peak_live_bytes);
+    }
+}
+
+#endif // ALLOCATION_TRACE_TEST_HPP_INCLUDED
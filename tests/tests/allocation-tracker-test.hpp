@@ -0,0 +1,68 @@
+#ifndef ALLOCATION_TRACKER_TEST_HPP_INCLUDED
+#define ALLOCATION_TRACKER_TEST_HPP_INCLUDED
+
+#include <thread>
+#include "memory/trillek-allocator.hpp"
+#include "gtest/gtest.h"
+
+class AllocationTrackerTest : public ::testing::Test {
+public:
+    template<class T> using ScriptAllocator = trillek::TrillekAllocator<T,std::allocator<T>,trillek::memory::AllocationTag::SCRIPTING>;
+};
+
+namespace trillek {
+    TEST_F(AllocationTrackerTest, Tags) {
+        auto general = memory::AllocationTracker::LiveBytes(memory::AllocationTag::GENERAL);
+        auto scripting = memory::AllocationTracker::LiveBytes(memory::AllocationTag::SCRIPTING);
+        {
+            std::vector<int,ScriptAllocator<int>> v;
+            v.reserve(100);
+            EXPECT_EQ(scripting + 400, memory::AllocationTracker::LiveBytes(memory::AllocationTag::SCRIPTING));
+            EXPECT_EQ(general, memory::AllocationTracker::LiveBytes(memory::AllocationTag::GENERAL));
+        }
+        EXPECT_EQ(scripting, memory::AllocationTracker::LiveBytes(memory::AllocationTag::SCRIPTING));
+        EXPECT_STREQ("scripting", memory::AllocationTracker::TagName(memory::AllocationTag::SCRIPTING));
+    }
+    TEST_F(AllocationTrackerTest, Rebind) {
+        auto scripting = memory::AllocationTracker::LiveBytes(memory::AllocationTag::SCRIPTING);
+        std::list<int,ScriptAllocator<int>> l{1, 2, 3};
+        EXPECT_LT(scripting, memory::AllocationTracker::LiveBytes(memory::AllocationTag::SCRIPTING));
+    }
+    TEST_F(AllocationTrackerTest, Peak) {
+        auto before = memory::AllocationTracker::Stats(memory::AllocationTag::SCRIPTING);
+        {
+            // released before the next call to Stats()
+            std::vector<int,ScriptAllocator<int>> v;
+            v.reserve(100000);
+        }
+        auto stats = memory::AllocationTracker::Stats(memory::AllocationTag::SCRIPTING);
+        EXPECT_EQ(before.live_bytes, stats.live_bytes);
+        EXPECT_LE(before.live_bytes + 400000, stats.peak_bytes);
+    }
+    TEST_F(AllocationTrackerTest, CrossThreads) {
+        auto before = memory::AllocationTracker::Stats(memory::AllocationTag::SCRIPTING);
+        std::vector<std::unique_ptr<std::vector<int,ScriptAllocator<int>>>> vectors(4);
+        std::vector<std::thread> threads;
+        for (auto& v : vectors) {
+            threads.emplace_back([&v]() {
+                v = make_unique<std::vector<int,ScriptAllocator<int>>>();
+                v->reserve(1000);
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        auto stats = memory::AllocationTracker::Stats(memory::AllocationTag::SCRIPTING);
+        EXPECT_EQ(before.live_bytes + 16000, stats.live_bytes);
+        EXPECT_EQ(before.allocations + 4, stats.allocations);
+        EXPECT_LE(stats.live_bytes, stats.peak_bytes);
+        // the memory is released by the main thread
+        vectors.clear();
+        stats = memory::AllocationTracker::Stats(memory::AllocationTag::SCRIPTING);
+        EXPECT_EQ(before.live_bytes, stats.live_bytes);
+        EXPECT_LE(before.live_bytes + 16000, stats.peak_bytes);
+        EXPECT_EQ(0, stats.bytes_per_second);
+    }
+}
+
+#endif // ALLOCATION_TRACKER_TEST_HPP_INCLUDED
@@ -0,0 +1,162 @@
+#ifndef ASYNC_DATA_TEST_HPP_INCLUDED
+#define ASYNC_DATA_TEST_HPP_INCLUDED
+
+#include <iterator>
+#include <thread>
+#include "systems/async-data.hpp"
+#include "gtest/gtest.h"
+
+class AsyncFrameDataTest : public ::testing::Test {
+public:
+    void Publish(int from, int to) {
+        for (auto i = from; i <= to; ++i) {
+            data.Publish(i * 10, i);
+        }
+    }
+protected:
+    trillek::AsyncFrameData<int,8> data;
+};
+
+namespace trillek {
+    TEST_F(AsyncFrameDataTest, Capacity) {
+        EXPECT_EQ(32, (FrameRing<int,8>::Capacity()));
+        EXPECT_EQ(128, (FrameRing<int,30>::Capacity()));
+    }
+    TEST_F(AsyncFrameDataTest, PopSync) {
+        Publish(1, 5);
+        frame_tp last = 0;
+        auto history = data.PopSync(3, last);
+
+        EXPECT_EQ(3, last);
+        auto it = history.cbegin();
+        for (auto i = 1; i <= 3; ++i, ++it) {
+            ASSERT_FALSE(it == history.cend());
+            EXPECT_EQ(i, it->first);
+            EXPECT_EQ(i * 10, it->second);
+        }
+        EXPECT_TRUE(it == history.cend());
+
+        history = data.PopSync(5, last);
+        EXPECT_EQ(5, last);
+        EXPECT_EQ(4, history.cbegin()->first);
+        EXPECT_EQ(5, (--history.cend())->first);
+    }
+    TEST_F(AsyncFrameDataTest, PopSyncNothingNew) {
+        Publish(1, 5);
+        frame_tp last = 5;
+        auto history = data.PopSync(5, last);
+
+        EXPECT_EQ(5, last);
+        EXPECT_TRUE(history.cbegin() == history.cend());
+    }
+    TEST_F(AsyncFrameDataTest, BoundedHistory) {
+        Publish(1, 100);
+
+        EXPECT_EQ(1000, data.GetHead());
+        EXPECT_EQ(930, data.GetCommit(93));
+        EXPECT_EQ(0, data.GetCommit(92));
+
+        // a stalled consumer only gets the frames retained
+        frame_tp last = 0;
+        auto history = data.PopSync(100, last);
+        EXPECT_EQ(100, last);
+        EXPECT_EQ(93, history.cbegin()->first);
+    }
+    TEST_F(AsyncFrameDataTest, Republish) {
+        Publish(1, 5);
+        frame_tp last = 0;
+        auto before = data.PopSync(5, last);
+        data.Publish(42, 5);
+
+        EXPECT_EQ(42, data.GetHead());
+        EXPECT_EQ(40, data.GetCommit(4));
+        // the history handed out before is not modified
+        EXPECT_EQ(50, std::prev(before.cend())->second);
+        last = 3;
+        auto after = data.PopSync(5, last);
+        ASSERT_EQ(2, std::distance(after.cbegin(), after.cend()));
+        EXPECT_EQ(40, after.cbegin()->second);
+        EXPECT_EQ(42, std::prev(after.cend())->second);
+    }
+    TEST_F(AsyncFrameDataTest, ReverseHistory) {
+        Publish(1, 5);
+        auto history = data.GetReverseHistoryData(2, 4);
+        auto it = history.crbegin();
+        for (auto i = 4; i > 2; --i, ++it) {
+            ASSERT_FALSE(it == history.crend());
+            EXPECT_EQ(i, it->first);
+        }
+        EXPECT_TRUE(it == history.crend());
+    }
+    TEST_F(AsyncFrameDataTest, RebaseInsert) {
+        data.Publish(10, 1);
+        data.Publish(30, 3);
+        std::map<frame_tp,int> commits{{2, 20}, {3, 33}};
+
+        EXPECT_EQ(3, data.Rebase(HistoryMap<int>(commits)));
+        EXPECT_EQ(10, data.GetCommit(1));
+        EXPECT_EQ(20, data.GetCommit(2));
+        EXPECT_EQ(33, data.GetCommit(3));
+    }
+    TEST_F(AsyncFrameDataTest, RebaseKeepsWindows) {
+        Publish(1, 20);
+        frame_tp last = 10;
+        auto window = data.PopSync(20, last);
+        ASSERT_EQ(13, window.cbegin()->first);
+        // the amendments of a rebase are republished at once
+        std::map<frame_tp,int> commits{{14, 1}, {15, 2}, {16, 3}, {17, 4}, {21, 210}};
+        EXPECT_EQ(21, data.Rebase(HistoryMap<int>(commits)));
+        EXPECT_EQ(3, data.GetCommit(16));
+        EXPECT_EQ(200, data.GetCommit(20));
+        // the window stays valid during HistorySize publications
+        Publish(22, 28);
+        auto it = window.cbegin();
+        for (auto i = 13; i <= 20; ++i, ++it) {
+            ASSERT_FALSE(it == window.cend());
+            EXPECT_EQ(i, it->first);
+            EXPECT_EQ(i * 10, it->second);
+        }
+        EXPECT_TRUE(it == window.cend());
+        EXPECT_EQ(280, data.GetHead());
+    }
+    TEST_F(AsyncFrameDataTest, WaitPublication) {
+        Publish(1, 5);
+        frame_tp last6 = 5;
+        frame_tp last7 = 5;
+        std::thread waiter6([&]() { data.PopSync(6, last6); });
+        std::thread waiter7([&]() { data.PopSync(7, last7); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        data.Publish(60, 6);
+        waiter6.join();
+        EXPECT_EQ(6, last6);
+        data.Publish(70, 7);
+        waiter7.join();
+        EXPECT_EQ(7, last7);
+    }
+    TEST_F(AsyncFrameDataTest, WaitMoreThanSlots) {
+        Publish(1, 5);
+        std::vector<frame_tp> last(20, 5);
+        std::vector<std::thread> waiters;
+        for (auto& l : last) {
+            waiters.emplace_back([&]() { data.PopSync(6, l); });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        data.Publish(60, 6);
+        for (auto& t : waiters) {
+            t.join();
+        }
+        for (auto& l : last) {
+            EXPECT_EQ(6, l);
+        }
+    }
+    TEST_F(AsyncFrameDataTest, WaitStalledPublisher) {
+        Publish(1, 5);
+        frame_tp last = 5;
+        auto history = data.PopSync(6, last);
+
+        EXPECT_EQ(5, last);
+        EXPECT_TRUE(history.cbegin() == history.cend());
+    }
+}
+
+#endif // ASYNC_DATA_TEST_HPP_INCLUDED
@@ -0,0 +1,144 @@
+#ifndef COMMIT_GROUP_TEST_HPP_INCLUDED
+#define COMMIT_GROUP_TEST_HPP_INCLUDED
+
+#include <chrono>
+#include <thread>
+#include "systems/commit-group.hpp"
+#include "gtest/gtest.h"
+
+class CommitGroupTest : public ::testing::Test {
+public:
+    typedef trillek::RewindableMap<unsigned int,int,int64_t,50> map_type;
+
+    void SetUp() override {
+        transform.Insert(1, 0);
+        velocity.Insert(1, 0);
+        group.Commit(0);
+    }
+
+    void Update(int64_t frame) {
+        transform.Update(1, static_cast<int>(frame));
+        velocity.Update(1, static_cast<int>(frame));
+        group.Commit(frame);
+    }
+protected:
+    map_type transform;
+    map_type velocity;
+    trillek::CommitGroup<map_type,map_type> group{transform, velocity};
+};
+
+namespace trillek {
+    TEST_F(CommitGroupTest, Epoch) {
+        EXPECT_EQ(0, group.Epoch());
+        Update(1);
+        EXPECT_EQ(1, group.Epoch());
+    }
+    TEST_F(CommitGroupTest, Pull) {
+        Update(1);
+        Update(2);
+        frame_tp last = 0;
+        auto histories = group.Pull(last);
+        EXPECT_EQ(2, last);
+
+        const auto& additions = std::get<1>(histories).second;
+        EXPECT_EQ(1, additions.cbegin()->first);
+        EXPECT_EQ(2, (--additions.cend())->first);
+        EXPECT_EQ(2, (--additions.cend())->second.at(1));
+
+        histories = group.Pull(last);
+        EXPECT_EQ(2, last);
+        EXPECT_TRUE(std::get<0>(histories).second.cbegin() == std::get<0>(histories).second.cend());
+    }
+    TEST_F(CommitGroupTest, BeforeFirstCommit) {
+        map_type a, b;
+        CommitGroup<map_type,map_type> empty(a, b);
+        frame_tp last = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto histories = empty.Pull(last);
+        // no wait for a frame that is not published
+        EXPECT_GT(std::chrono::milliseconds(400), std::chrono::steady_clock::now() - start);
+        EXPECT_EQ(0, last);
+        EXPECT_TRUE(std::get<0>(histories).second.cbegin() == std::get<0>(histories).second.cend());
+        EXPECT_TRUE(std::get<1>(histories).first.cbegin() == std::get<1>(histories).first.cend());
+    }
+    TEST_F(CommitGroupTest, FailedCommit) {
+        Update(1);
+        Update(2);
+        velocity.Checkout(1);
+        transform.Update(1, 3);
+        EXPECT_EQ(2, group.Commit(3));
+        EXPECT_EQ(2, group.Epoch());
+        frame_tp last = 1;
+        auto histories = group.Pull(last);
+        EXPECT_EQ(2, last);
+        EXPECT_EQ(2, (--std::get<0>(histories).second.cend())->first);
+    }
+    TEST_F(CommitGroupTest, Rebase) {
+        Update(1);
+        Update(2);
+        frame_tp last = 0;
+        group.Pull(last);
+        // frames 1 and 2 of transform are replaced
+        map_type other;
+        other.Insert(1, 0);
+        other.Commit(0);
+        other.Update(1, 10);
+        other.Commit(1);
+        other.Update(1, 20);
+        other.Commit(2);
+        frame_tp other_last = 0;
+        auto imported = other.Pull(2, other_last);
+        transform.Push(std::move(imported.first), std::move(imported.second));
+        EXPECT_EQ(20, transform.Map().at(1));
+
+        last = 1;
+        std::shared_ptr<frame_tp> rebase;
+        auto histories = group.Pull(last, rebase);
+        ASSERT_TRUE(rebase);
+        EXPECT_EQ(0, *rebase);
+        EXPECT_EQ(2, last);
+        const auto& additions = std::get<0>(histories).second;
+        EXPECT_EQ(1, additions.cbegin()->first);
+        EXPECT_EQ(10, additions.cbegin()->second.at(1));
+        EXPECT_EQ(2, std::get<1>(histories).second.cbegin()->first);
+    }
+    TEST_F(CommitGroupTest, ConsistentReaders) {
+        std::atomic<bool> done(false);
+        std::thread writer([&]() {
+            // readers must consume a frame before it leaves the history window
+            for (int64_t f = 1; f <= 500; ++f) {
+                Update(f);
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            done = true;
+        });
+        std::vector<std::thread> readers;
+        std::atomic<int> mismatches(0);
+        for (auto r = 0; r < 3; ++r) {
+            readers.emplace_back([&]() {
+                frame_tp last = 0;
+                while (! done) {
+                    auto histories = group.Pull(last);
+                    const auto& t = std::get<0>(histories).second;
+                    const auto& v = std::get<1>(histories).second;
+                    if (t.cbegin() == t.cend()) {
+                        continue;
+                    }
+                    auto t_last = --t.cend();
+                    auto v_last = --v.cend();
+                    if (t_last->first != last || v_last->first != last
+                            || t_last->second.at(1) != v_last->second.at(1)) {
+                        ++mismatches;
+                    }
+                }
+            });
+        }
+        writer.join();
+        for (auto& t : readers) {
+            t.join();
+        }
+        EXPECT_EQ(0, mismatches);
+    }
+}
+
+#endif // COMMIT_GROUP_TEST_HPP_INCLUDED
@@ -0,0 +1,95 @@
+#ifndef DATAGRAM_BATCH_TEST_HPP_INCLUDED
+#define DATAGRAM_BATCH_TEST_HPP_INCLUDED
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include "controllers/network/datagram-batch.hpp"
+#include "gtest/gtest.h"
+
+class DatagramBatchTest : public ::testing::Test {
+public:
+    DatagramBatchTest() : batch(8) {
+        for (auto i = 0; i < 2; ++i) {
+            fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+            fcntl(fds[i], F_SETFL, O_NONBLOCK);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(fds[i], reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            socklen_t len = sizeof(addresses[i]);
+            getsockname(fds[i], reinterpret_cast<sockaddr*>(&addresses[i]), &len);
+        }
+    }
+
+    ~DatagramBatchTest() {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+protected:
+    int fds[2];
+    sockaddr_in addresses[2];
+    trillek::network::DatagramBatch batch;
+};
+
+namespace trillek {
+    TEST_F(DatagramBatchTest, SendReceive) {
+        std::vector<std::string> datagrams;
+        for (auto i = 0; i < 12; ++i) {
+            datagrams.push_back("datagram " + std::to_string(i));
+        }
+        for (auto& d : datagrams) {
+            batch.Queue(d.data(), d.size(), reinterpret_cast<sockaddr*>(&addresses[1]), sizeof(addresses[1]));
+        }
+        auto metrics = std::make_shared<network::ConnectionMetrics>();
+        batch.SetMetrics(metrics.get());
+        EXPECT_EQ(12, batch.Queued());
+        EXPECT_EQ(12, batch.Flush(fds[0]));
+        EXPECT_EQ(12, metrics->Snapshot().packets_sent);
+        EXPECT_EQ(0, batch.Queued());
+        // capacity of the batch is 8
+        ASSERT_EQ(8, batch.Receive(fds[1]));
+        for (size_t i = 0; i < batch.Received(); ++i) {
+            EXPECT_EQ(datagrams[i], std::string(batch.Data(i), batch.Size(i)));
+            auto source = reinterpret_cast<const sockaddr_in*>(batch.Source(i));
+            EXPECT_EQ(addresses[0].sin_port, source->sin_port);
+        }
+        auto taken = batch.Take(0);
+        EXPECT_EQ(datagrams[0], std::string(taken.data(), datagrams[0].size()));
+        ASSERT_EQ(4, batch.Receive(fds[1]));
+        EXPECT_EQ(datagrams[8], std::string(batch.Data(0), batch.Size(0)));
+        EXPECT_EQ(12, metrics->Snapshot().packets_received);
+        EXPECT_EQ(0, batch.Receive(fds[1]));
+        // the buffer taken is still valid
+        EXPECT_EQ(datagrams[0], std::string(taken.data(), datagrams[0].size()));
+    }
+    TEST_F(DatagramBatchTest, SteadyState) {
+        const std::string datagram(1000, 'x');
+        auto& pool = memory::ThreadCacheAllocator::Instance();
+        size_t slabs = 0;
+        for (auto cycle = 0; cycle < 200; ++cycle) {
+            if (cycle == 10) {
+                slabs = pool.Slabs();
+            }
+            for (auto i = 0; i < 8; ++i) {
+                batch.Queue(datagram.data(), datagram.size(), reinterpret_cast<sockaddr*>(&addresses[1]), sizeof(addresses[1]));
+            }
+            ASSERT_EQ(8, batch.Flush(fds[0]));
+            ASSERT_EQ(8, batch.Receive(fds[1]));
+            // the buffers are handled by another thread and released there
+            std::vector<network::DatagramBatch::vector_type> taken;
+            for (size_t i = 0; i < batch.Received(); ++i) {
+                taken.push_back(batch.Take(i));
+            }
+            std::thread handler([&taken]() { taken.clear(); });
+            handler.join();
+        }
+        EXPECT_EQ(slabs, pool.Slabs());
+    }
+}
+
+#endif // DATAGRAM_BATCH_TEST_HPP_INCLUDED
@@ -0,0 +1,140 @@
+#ifndef DELTA_HISTORY_TEST_HPP_INCLUDED
+#define DELTA_HISTORY_TEST_HPP_INCLUDED
+
+#include "systems/delta-history.hpp"
+#include "systems/rewindable-map.hpp"
+#include "gtest/gtest.h"
+
+struct DeltaHistoryValue {
+    float position[3];
+    float orientation[4];
+    uint32_t id;
+
+    bool operator==(const DeltaHistoryValue& other) const {
+        return std::memcmp(this, &other, sizeof(DeltaHistoryValue)) == 0;
+    }
+};
+
+class DeltaHistoryTest : public ::testing::Test {
+public:
+    static DeltaHistoryValue Value(uint32_t id, float x) {
+        return DeltaHistoryValue{{x, 2.0f * x, 0.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, id};
+    }
+
+    void Commit(int64_t frame) {
+        rmap.Commit(frame);
+        history.Record(frame, rmap.GetLastNegativeCommit(), rmap.GetLastPositiveCommit(),
+            [](const DeltaHistoryValue& v) -> const DeltaHistoryValue& { return v; });
+        states[frame] = std::map<unsigned int,DeltaHistoryValue>(rmap.Map().cbegin(), rmap.Map().cend());
+    }
+
+    void Play(int64_t frames) {
+        for (unsigned int i = 0; i < 100; ++i) {
+            rmap.Insert(i, Value(i, 0.0f));
+        }
+        Commit(0);
+        for (int64_t f = 1; f <= frames; ++f) {
+            // a few entities move every frame
+            for (unsigned int i = 0; i < 5; ++i) {
+                auto id = static_cast<unsigned int>((f * 7 + i * 13) % 100);
+                if (rmap.Map().count(id)) {
+                    rmap.Update(id, Value(id, static_cast<float>(f)));
+                }
+            }
+            if (f % 3 == 0) {
+                rmap.Remove(static_cast<unsigned int>(f));
+            }
+            if (f % 5 == 0) {
+                rmap.Insert(static_cast<unsigned int>(100 + f), Value(100 + f, 1.0f));
+            }
+            Commit(f * 10);
+        }
+    }
+
+    std::map<unsigned int,DeltaHistoryValue> Current() {
+        return std::map<unsigned int,DeltaHistoryValue>(rmap.Map().cbegin(), rmap.Map().cend());
+    }
+protected:
+    trillek::RewindableMap<unsigned int,DeltaHistoryValue,int64_t,50> rmap;
+    trillek::DeltaHistory<unsigned int,DeltaHistoryValue> history;
+    std::map<int64_t,std::map<unsigned int,DeltaHistoryValue>> states;
+};
+
+namespace trillek {
+    TEST_F(DeltaHistoryTest, Rewind) {
+        Play(40);
+        for (int64_t f = 400; f >= 0; f -= 10) {
+            auto state = Current();
+            EXPECT_TRUE(history.Rewind(f, state));
+            EXPECT_EQ(states[f], state);
+        }
+    }
+    TEST_F(DeltaHistoryTest, Forward) {
+        Play(40);
+        auto state = Current();
+        ASSERT_TRUE(history.Rewind(50, state));
+        history.Forward(50, 250, state);
+        EXPECT_EQ(states[250], state);
+        history.Forward(250, 400, state);
+        EXPECT_EQ(Current(), state);
+    }
+    TEST_F(DeltaHistoryTest, Compact) {
+        for (unsigned int i = 0; i < 100; ++i) {
+            rmap.Insert(i, Value(i, 0.0f));
+        }
+        Commit(0);
+        auto initial = history.ByteSize();
+        for (int64_t f = 1; f <= 40; ++f) {
+            rmap.Update(static_cast<unsigned int>(f), Value(static_cast<unsigned int>(f), 1.0f));
+            Commit(f * 10);
+        }
+        // only the position changed, the delta is smaller than the value
+        EXPECT_LT(history.ByteSize() - initial, 40 * sizeof(DeltaHistoryValue));
+    }
+    TEST_F(DeltaHistoryTest, Budget) {
+        history.SetBudget(1000);
+        Play(40);
+        EXPECT_LE(history.ByteSize(), 1000);
+        EXPECT_LT(history.FrameCount(), 41);
+        EXPECT_EQ(400, history.OldestFrame() + 10 * (history.FrameCount() - 1));
+
+        auto oldest = history.OldestFrame();
+        auto state = Current();
+        EXPECT_TRUE(history.Rewind(oldest, state));
+        EXPECT_EQ(states[oldest], state);
+        state = Current();
+        EXPECT_FALSE(history.Rewind(oldest - 10, state));
+        EXPECT_EQ(Current(), state);
+    }
+    TEST_F(DeltaHistoryTest, Snapshot) {
+        Play(40);
+        // the uncommitted modifications are not in the history
+        rmap.Remove(1);
+        rmap.Insert(1000, Value(1000, 1.0f));
+        EXPECT_EQ(states[400], history.Head());
+        std::map<unsigned int,DeltaHistoryValue> state;
+        for (int64_t f = 400; f >= 0; f -= 50) {
+            EXPECT_TRUE(history.Snapshot(f, state));
+            EXPECT_EQ(states[f], state);
+        }
+    }
+    TEST_F(DeltaHistoryTest, Truncate) {
+        Play(40);
+        EXPECT_TRUE(history.Truncate(200));
+        EXPECT_EQ(21, history.FrameCount());
+        EXPECT_EQ(states[200], history.Head());
+        // a frame older than the last one recorded truncates the history
+        std::map<unsigned int,DeltaHistoryValue> removed, added;
+        removed[2] = states[140].at(2);
+        added[2] = Value(2, 5.0f);
+        history.Record(150, removed, added, [](const DeltaHistoryValue& v) -> const DeltaHistoryValue& { return v; });
+        EXPECT_EQ(16, history.FrameCount());
+        EXPECT_EQ(Value(2, 5.0f), history.Head().at(2));
+        EXPECT_FALSE(history.Truncate(-10));
+        EXPECT_EQ(0, history.FrameCount());
+        history.Reset(states[400], [](const DeltaHistoryValue& v) -> const DeltaHistoryValue& { return v; });
+        EXPECT_EQ(states[400], history.Head());
+    }
+}
+
+#endif // DELTA_HISTORY_TEST_HPP_INCLUDED
@@ -0,0 +1,182 @@
+#ifndef DISPATCH_TABLE_TEST_HPP_INCLUDED
+#define DISPATCH_TABLE_TEST_HPP_INCLUDED
+
+#include <thread>
+#include <vector>
+#include "controllers/network/message.hpp"
+#include "controllers/network/packet-handler.hpp"
+#include "gtest/gtest.h"
+
+namespace dispatch_test {
+
+// a message that knows the connection it came from, as Message does
+struct Packet {
+    int value;
+    std::shared_ptr<trillek::network::ConnectionMetrics> metrics;
+};
+
+inline std::shared_ptr<trillek::network::ConnectionMetrics> MetricsOf(const Packet& packet) {
+    return packet.metrics;
+}
+
+} // dispatch_test
+
+namespace trillek {
+    typedef network::packet_handler::DispatchTable<int> IntDispatchTable;
+
+    TEST(DispatchTableTest, QueuedAndInline) {
+        IntDispatchTable table;
+        std::vector<int> queued, inlined;
+        table.Register(GAME_MSG, 1, [&queued](std::shared_ptr<int> msg) { queued.push_back(*msg); });
+        table.Register(NET_MSG, 2, [&inlined](std::shared_ptr<int> msg) { inlined.push_back(*msg); }, true);
+        for (auto i = 0; i < 10; ++i) {
+            EXPECT_TRUE(table.Dispatch(GAME_MSG, 1, std::make_shared<int>(i)));
+            EXPECT_TRUE(table.Dispatch(NET_MSG, 2, std::make_shared<int>(100 + i)));
+        }
+        // the inline handler runs at once, the queued one when processed
+        EXPECT_EQ(10, inlined.size());
+        EXPECT_TRUE(queued.empty());
+        EXPECT_EQ(10, table.ProcessAll());
+        ASSERT_EQ(10, queued.size());
+        for (auto i = 0; i < 10; ++i) {
+            EXPECT_EQ(i, queued[i]);
+            EXPECT_EQ(100 + i, inlined[i]);
+        }
+        EXPECT_FALSE(table.Dispatch(WORLD_MSG, 7, std::make_shared<int>(0)));
+        EXPECT_EQ(1, table.Unrouted());
+        auto stats = table.Statistics(GAME_MSG, 1);
+        EXPECT_EQ(10, stats.dispatched);
+        EXPECT_EQ(10, stats.max_batch);
+        EXPECT_EQ(0, stats.handled_inline);
+        EXPECT_EQ(10, table.Statistics(NET_MSG, 2).handled_inline);
+    }
+    TEST(DispatchTableTest, Batch) {
+        IntDispatchTable table;
+        std::vector<int> a, b;
+        table.Register(GAME_MSG, 1, [&a](std::shared_ptr<int> msg) { a.push_back(*msg); });
+        table.Register(GAME_MSG, 2, [&b](std::shared_ptr<int> msg) { b.push_back(*msg); });
+        IntDispatchTable::Batch batch;
+        for (auto i = 0; i < 100; ++i) {
+            batch.Add(GAME_MSG, static_cast<uint8_t>(1 + i % 3), std::make_shared<int>(i));
+        }
+        // a third of the messages have no handler
+        EXPECT_EQ(67, table.DispatchBatch(batch));
+        EXPECT_EQ(0, batch.Size());
+        EXPECT_EQ(33, table.Unrouted());
+        table.ProcessAll();
+        ASSERT_EQ(34, a.size());
+        ASSERT_EQ(33, b.size());
+        // the order of each type is kept
+        for (size_t i = 0; i < a.size(); ++i) {
+            EXPECT_EQ(static_cast<int>(3 * i), a[i]);
+        }
+    }
+    TEST(DispatchTableTest, Decoder) {
+        IntDispatchTable table;
+        std::vector<int> queued, inlined;
+        table.Register(GAME_MSG, 1, [&queued](std::shared_ptr<int> msg) { queued.push_back(*msg); });
+        table.Register(NET_MSG, 2, [&inlined](std::shared_ptr<int> msg) { inlined.push_back(*msg); }, true);
+        // the negative messages are malformed, the others are expanded
+        table.SetDecoder([](std::shared_ptr<int> msg) {
+            return *msg < 0 ? std::shared_ptr<int>() : std::make_shared<int>(*msg * 10);
+        });
+        EXPECT_TRUE(table.Dispatch(GAME_MSG, 1, std::make_shared<int>(1)));
+        EXPECT_FALSE(table.Dispatch(GAME_MSG, 1, std::make_shared<int>(-1)));
+        IntDispatchTable::Batch batch;
+        for (auto i = 2; i < 6; ++i) {
+            batch.Add(GAME_MSG, 1, std::make_shared<int>(i % 2 ? i : -i));
+            batch.Add(NET_MSG, 2, std::make_shared<int>(i % 2 ? -i : i));
+        }
+        EXPECT_EQ(4, table.DispatchBatch(batch));
+        EXPECT_EQ(5, table.Rejected());
+        table.ProcessAll();
+        EXPECT_EQ(std::vector<int>({ 10, 30, 50 }), queued);
+        EXPECT_EQ(std::vector<int>({ 20, 40 }), inlined);
+        EXPECT_EQ(3, table.Statistics(GAME_MSG, 1).dispatched);
+    }
+    TEST(DispatchTableTest, Metrics) {
+        network::packet_handler::DispatchTable<dispatch_test::Packet> table;
+        auto metrics = std::make_shared<network::ConnectionMetrics>();
+        int sum = 0;
+        table.Register(GAME_MSG, 1, [&sum](std::shared_ptr<dispatch_test::Packet> msg) { sum += msg->value; });
+        table.Register(NET_MSG, 2, [&sum](std::shared_ptr<dispatch_test::Packet> msg) { sum += msg->value; }, true);
+        for (auto i = 0; i < 5; ++i) {
+            table.Dispatch(GAME_MSG, 1, std::make_shared<dispatch_test::Packet>(dispatch_test::Packet{ 1, metrics }));
+        }
+        table.Dispatch(NET_MSG, 2, std::make_shared<dispatch_test::Packet>(dispatch_test::Packet{ 10, metrics }));
+        EXPECT_EQ(5, metrics->Snapshot().queue_depth);
+        // the messages without a connection are not counted
+        table.Dispatch(GAME_MSG, 1, std::make_shared<dispatch_test::Packet>(dispatch_test::Packet{ 100, nullptr }));
+        EXPECT_EQ(6, table.ProcessAll());
+        EXPECT_EQ(115, sum);
+        auto snapshot = metrics->Snapshot();
+        EXPECT_EQ(0, snapshot.queue_depth);
+        EXPECT_EQ(5, snapshot.max_queue_depth);
+        EXPECT_EQ(5, snapshot.type_messages[GAME_MSG]);
+        EXPECT_EQ(1, snapshot.type_messages[NET_MSG]);
+    }
+    TEST(DispatchTableTest, PolledQueue) {
+        // the handlers that poll their queue, as PacketHandler::Process<Major,Minor>() does
+        IntDispatchTable table;
+        auto& queue = table.Queue(CPU_MSG, 3);
+        EXPECT_TRUE(table.Dispatch(CPU_MSG, 3, std::make_shared<int>(5)));
+        EXPECT_EQ(&queue, &table.Queue(CPU_MSG, 3));
+        auto list = queue.Poll();
+        ASSERT_EQ(1, list.size());
+        EXPECT_EQ(5, *list.front());
+        EXPECT_EQ(0, table.Process(CPU_MSG, 3));
+    }
+    TEST(DispatchTableTest, LegacyQueue) {
+        // the code written for PacketQueue still finds the queue of the default table
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+        auto& legacy = network::packet_handler::PacketQueue<CPU_MSG,4>::input_queue;
+#pragma GCC diagnostic pop
+        auto& table = network::packet_handler::MessageDispatchTable::Default();
+        EXPECT_EQ(&table.Queue(CPU_MSG, 4), &legacy);
+        network::packet_handler::PacketHandler handler;
+        auto& queue = handler.GetQueue<CPU_MSG,4>();
+        EXPECT_EQ(&legacy, &queue);
+    }
+    TEST(DispatchTableTest, Concurrent) {
+        IntDispatchTable table;
+        std::atomic<int> sum(0);
+        for (auto minor = 0; minor < 16; ++minor) {
+            table.Register(GAME_MSG, static_cast<uint8_t>(minor), [&sum](std::shared_ptr<int> msg) { sum += *msg; });
+        }
+        const int per_thread = 20000;
+        std::atomic<bool> done(false);
+        std::thread worker([&]() {
+            while (! done) {
+                table.ProcessAll();
+            }
+            table.ProcessAll();
+        });
+        std::vector<std::thread> io;
+        for (auto t = 0; t < 2; ++t) {
+            io.emplace_back([&table, t, per_thread]() {
+                IntDispatchTable::Batch batch;
+                for (auto i = 0; i < per_thread; ++i) {
+                    batch.Add(GAME_MSG, static_cast<uint8_t>((i + t) % 16), std::make_shared<int>(1));
+                    if (batch.Size() == 64) {
+                        table.DispatchBatch(batch);
+                    }
+                }
+                table.DispatchBatch(batch);
+            });
+        }
+        for (auto& t : io) {
+            t.join();
+        }
+        done = true;
+        worker.join();
+        EXPECT_EQ(2 * per_thread, sum.load());
+        uint64_t dispatched = 0;
+        for (auto minor = 0; minor < 16; ++minor) {
+            dispatched += table.Statistics(GAME_MSG, static_cast<uint8_t>(minor)).dispatched;
+        }
+        EXPECT_EQ(2 * per_thread, dispatched);
+    }
+}
+
+#endif // DISPATCH_TABLE_TEST_HPP_INCLUDED
@@ -0,0 +1,69 @@
+#ifndef FRAME_ARENA_TEST_HPP_INCLUDED
+#define FRAME_ARENA_TEST_HPP_INCLUDED
+
+#include <thread>
+#include "memory/frame-arena.hpp"
+#include "gtest/gtest.h"
+
+class FrameArenaTest : public ::testing::Test {
+public:
+    template<class T> using ArenaAllocator = trillek::TrillekAllocator<T,trillek::memory::FrameArena>;
+
+    FrameArenaTest() : arena(256) {}
+protected:
+    trillek::memory::FrameArena arena;
+};
+
+namespace trillek {
+    TEST_F(FrameArenaTest, Bump) {
+        auto a = static_cast<char*>(arena.allocate(10));
+        auto b = static_cast<char*>(arena.allocate(20));
+        EXPECT_EQ(a + 16, b);
+        EXPECT_EQ(0, reinterpret_cast<size_t>(a) % 16);
+        EXPECT_EQ(48, arena.Used());
+        arena.deallocate(a, 10);
+        EXPECT_EQ(48, arena.Used());
+    }
+    TEST_F(FrameArenaTest, Reset) {
+        auto a = arena.allocate(100);
+        arena.allocate(100);
+        arena.Reset();
+        EXPECT_EQ(0, arena.Used());
+        EXPECT_EQ(224, arena.HighWater());
+        EXPECT_EQ(a, arena.allocate(100));
+    }
+    TEST_F(FrameArenaTest, Overflow) {
+        arena.allocate(200);
+        auto p = arena.allocate(100);
+        EXPECT_FALSE(arena.Owns(p));
+        EXPECT_EQ(1, arena.OverflowCount());
+        arena.Reset();
+        // the arena grows to the high-water mark
+        EXPECT_EQ(0, arena.OverflowCount());
+        EXPECT_EQ(320, arena.Capacity());
+        arena.allocate(200);
+        EXPECT_TRUE(arena.Owns(arena.allocate(100)));
+    }
+    TEST_F(FrameArenaTest, Container) {
+        ArenaAllocator<int> alloc(&arena);
+        std::vector<int,ArenaAllocator<int>> v(alloc);
+        v.reserve(10);
+        for (auto i = 0; i < 10; ++i) {
+            v.push_back(i);
+        }
+        EXPECT_TRUE(arena.Owns(v.data()));
+        EXPECT_EQ(9, v.back());
+    }
+    TEST_F(FrameArenaTest, ThreadArena) {
+        auto& mine = memory::FrameArena::ThreadArena();
+        memory::FrameArena* other = nullptr;
+        std::thread t([&]() { other = &memory::FrameArena::ThreadArena(); });
+        t.join();
+        EXPECT_NE(&mine, other);
+        std::vector<int,ArenaAllocator<int>> v(memory::FrameArena::Allocator<int>());
+        v.push_back(1);
+        EXPECT_TRUE(mine.Owns(v.data()));
+    }
+}
+
+#endif // FRAME_ARENA_TEST_HPP_INCLUDED
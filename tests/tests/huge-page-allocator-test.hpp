@@ -0,0 +1,64 @@
+#ifndef HUGE_PAGE_ALLOCATOR_TEST_HPP_INCLUDED
+#define HUGE_PAGE_ALLOCATOR_TEST_HPP_INCLUDED
+
+#include <cstring>
+#include "memory/huge-page-allocator.hpp"
+#include "gtest/gtest.h"
+
+class HugePageAllocatorTest : public ::testing::Test {
+public:
+    HugePageAllocatorTest() : alloc(trillek::memory::HugePageAllocator::Instance()) {}
+protected:
+    trillek::memory::HugePageAllocator& alloc;
+};
+
+namespace trillek {
+    TEST_F(HugePageAllocatorTest, Small) {
+        auto regions = alloc.Regions();
+        auto p = alloc.allocate(1000);
+        EXPECT_EQ(regions, alloc.Regions());
+        alloc.deallocate(p, 1000);
+    }
+    TEST_F(HugePageAllocatorTest, Region) {
+        auto regions = alloc.Regions();
+        auto mapped = alloc.MappedBytes();
+        auto backed = alloc.HugeRegions() + alloc.FallbackRegions();
+        const size_t size = 3 * memory::HugePageAllocator::HUGE_PAGE_SIZE / 2;
+        auto p = static_cast<char*>(alloc.allocate(size));
+        EXPECT_EQ(regions + 1, alloc.Regions());
+        EXPECT_EQ(mapped + 2 * memory::HugePageAllocator::HUGE_PAGE_SIZE, alloc.MappedBytes());
+        EXPECT_EQ(backed + 1, alloc.HugeRegions() + alloc.FallbackRegions());
+        EXPECT_EQ(0, reinterpret_cast<size_t>(p) % memory::HugePageAllocator::HUGE_PAGE_SIZE);
+        std::memset(p, 0xAB, size);
+        EXPECT_EQ(static_cast<char>(0xAB), p[size - 1]);
+        alloc.deallocate(p, size);
+        EXPECT_EQ(regions, alloc.Regions());
+        EXPECT_EQ(mapped, alloc.MappedBytes());
+    }
+    TEST_F(HugePageAllocatorTest, Container) {
+        auto regions = alloc.Regions();
+        {
+            std::vector<int,TrillekAllocator<int,memory::HugePageAllocator>> v(memory::HugePageAllocator::Allocator<int>());
+            for (auto i = 0; i < 1000000; ++i) {
+                v.push_back(i);
+            }
+            EXPECT_EQ(999999, v.back());
+            EXPECT_EQ(regions + 1, alloc.Regions());
+        }
+        EXPECT_EQ(regions, alloc.Regions());
+    }
+    TEST_F(HugePageAllocatorTest, Array) {
+        auto live = memory::AllocationTracker::LiveBytes(memory::AllocationTag::RESOURCE);
+        {
+            auto a = memory::HugePageAllocator::MakeArray<uint8_t,memory::AllocationTag::RESOURCE>(1 << 22);
+            a[(1 << 22) - 1] = 1;
+            EXPECT_EQ(live + (1 << 22), memory::AllocationTracker::LiveBytes(memory::AllocationTag::RESOURCE));
+            auto b = std::move(a);
+            EXPECT_FALSE(a);
+            EXPECT_EQ(1, b[(1 << 22) - 1]);
+        }
+        EXPECT_EQ(live, memory::AllocationTracker::LiveBytes(memory::AllocationTag::RESOURCE));
+    }
+}
+
+#endif // HUGE_PAGE_ALLOCATOR_TEST_HPP_INCLUDED
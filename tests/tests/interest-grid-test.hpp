@@ -0,0 +1,199 @@
+#ifndef INTEREST_GRID_TEST_HPP_INCLUDED
+#define INTEREST_GRID_TEST_HPP_INCLUDED
+
+#include <random>
+#include <set>
+#include "systems/interest-grid.hpp"
+#include "systems/rewindable-map.hpp"
+#include "systems/snapshot-replicator.hpp"
+#include "gtest/gtest.h"
+
+class InterestGridTest : public ::testing::Test {
+public:
+    InterestGridTest() : grid(10.0f), rng(3) {
+        std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+        for (trillek::id_t i = 0; i < 2000; ++i) {
+            positions[i] = glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng));
+            grid.Update(i, positions[i]);
+        }
+    }
+
+    std::set<trillek::id_t> BruteForce(const glm::vec3& c, float radius) {
+        std::set<trillek::id_t> ret;
+        for (const auto& p : positions) {
+            auto dx = p.second.x - c.x, dy = p.second.y - c.y, dz = p.second.z - c.z;
+            if (dx * dx + dy * dy + dz * dz <= radius * radius) {
+                ret.insert(p.first);
+            }
+        }
+        return ret;
+    }
+
+protected:
+    trillek::InterestGrid grid;
+    std::map<trillek::id_t,glm::vec3> positions;
+    std::mt19937 rng;
+};
+
+namespace trillek {
+    TEST_F(InterestGridTest, Query) {
+        std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+        for (auto i = 0; i < 20; ++i) {
+            glm::vec3 c(coordinate(rng), coordinate(rng), coordinate(rng));
+            // move and remove a few entities
+            positions[i] = c;
+            grid.Update(i, c);
+            positions.erase(100 + i);
+            grid.Remove(100 + i);
+            std::set<id_t> found;
+            grid.Query(c, 25.0f, [&found](id_t entity, float) { found.insert(entity); });
+            EXPECT_EQ(BruteForce(c, 25.0f), found);
+        }
+        EXPECT_EQ(positions.size(), grid.Size());
+    }
+    TEST_F(InterestGridTest, Budget) {
+        InterestManager interest(grid);
+        glm::vec3 c(0.0f, 0.0f, 0.0f);
+        auto relevant = BruteForce(c, 40.0f);
+        ASSERT_LT(20, relevant.size());
+        interest.SetViewer(1, c, 40.0f, 20);
+        std::vector<Relevance> selected;
+        std::vector<id_t> keys;
+        std::set<id_t> seen;
+        for (auto tick = 0; tick < 200; ++tick) {
+            interest.Select(1, selected, keys);
+            ASSERT_EQ(20, selected.size());
+            ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+            for (auto k : keys) {
+                ASSERT_TRUE(relevant.count(k));
+                seen.insert(k);
+            }
+        }
+        // every relevant entity is replicated in turn
+        EXPECT_EQ(relevant, seen);
+        // the nearest entities are selected first
+        interest.SetViewer(2, c, 40.0f, 1);
+        interest.Select(2, selected, keys);
+        float nearest = 1e9f;
+        id_t nearest_id = 0;
+        for (auto id : relevant) {
+            auto& p = positions[id];
+            auto d = p.x * p.x + p.y * p.y + p.z * p.z;
+            if (d < nearest) {
+                nearest = d;
+                nearest_id = id;
+            }
+        }
+        EXPECT_EQ(nearest_id, selected[0].entity);
+    }
+    TEST_F(InterestGridTest, Replicate) {
+        RewindableMap<unsigned int,glm::vec3,int64_t,50> rmap;
+        DeltaHistory<unsigned int,glm::vec3> history;
+        SnapshotReplicator<unsigned int,glm::vec3> replicator(history);
+        SnapshotReplica<unsigned int,glm::vec3> replica;
+        InterestManager interest(grid);
+        auto identity = [](const glm::vec3& v) -> const glm::vec3& { return v; };
+        for (const auto& p : positions) {
+            rmap.Insert(p.first, p.second);
+        }
+        std::vector<Relevance> selected;
+        std::vector<id_t> keys, in_range;
+        size_t total = 0;
+        for (int64_t f = 0; f < 50; ++f) {
+            // the client and some entities move
+            glm::vec3 viewer(static_cast<float>(f) * 2.0f - 50.0f, 0.0f, 0.0f);
+            for (id_t i = 0; i < 50; ++i) {
+                auto p = positions[i];
+                p.x += 1.0f;
+                positions[i] = p;
+                grid.Update(i, p);
+                rmap.Update(i, p);
+            }
+            rmap.Commit(f);
+            history.Record(f, rmap.GetLastNegativeCommit(), rmap.GetLastPositiveCommit(), identity);
+            interest.SetViewer(0, viewer, 30.0f, 100);
+            interest.Select(0, selected, keys, &in_range);
+            std::vector<unsigned int> updated(keys.begin(), keys.end()), kept(in_range.begin(), in_range.end());
+            util::BitWriter out;
+            replicator.Encode(0, f, rmap.Map(), identity, out, &updated, &kept);
+            total += out.Bytes().size();
+            frame_tp received;
+            ASSERT_TRUE(replica.Apply(out.Bytes().data(), out.Bytes().size(), received));
+            // within the budget, all the entities of interest are updated
+            ASSERT_EQ(in_range, keys);
+            ASSERT_EQ(keys.size(), replica.State().size());
+            for (auto k : keys) {
+                ASSERT_EQ(0, std::memcmp(&rmap.Map().at(k), &replica.State().at(k), sizeof(glm::vec3)));
+            }
+            if (f % 3) {
+                replicator.Acknowledge(0, received);
+            }
+        }
+        // far less than the whole world each frame
+        EXPECT_LT(total, 50 * positions.size() * sizeof(glm::vec3) / 10);
+    }
+    TEST_F(InterestGridTest, Starved) {
+        RewindableMap<unsigned int,glm::vec3,int64_t,50> rmap;
+        DeltaHistory<unsigned int,glm::vec3> history;
+        SnapshotReplicator<unsigned int,glm::vec3> replicator(history);
+        SnapshotReplica<unsigned int,glm::vec3> replica;
+        InterestManager interest(grid);
+        auto identity = [](const glm::vec3& v) -> const glm::vec3& { return v; };
+        for (const auto& p : positions) {
+            rmap.Insert(p.first, p.second);
+        }
+        glm::vec3 c(0.0f, 0.0f, 0.0f);
+        auto relevant = BruteForce(c, 40.0f);
+        ASSERT_LT(40, relevant.size());
+        // the entities of interest outnumber the budget
+        interest.SetViewer(0, c, 40.0f, 20);
+        std::vector<Relevance> selected;
+        std::vector<id_t> keys, in_range;
+        // the value of each entity when it was last sent
+        std::map<unsigned int,glm::vec3> last_sent;
+        auto replicate = [&](int64_t f) {
+            rmap.Commit(f);
+            history.Record(f, rmap.GetLastNegativeCommit(), rmap.GetLastPositiveCommit(), identity);
+            interest.Select(0, selected, keys, &in_range);
+            std::vector<unsigned int> updated(keys.begin(), keys.end()), kept(in_range.begin(), in_range.end());
+            util::BitWriter out;
+            replicator.Encode(0, f, rmap.Map(), identity, out, &updated, &kept);
+            frame_tp received;
+            ASSERT_TRUE(replica.Apply(out.Bytes().data(), out.Bytes().size(), received));
+            for (auto k : keys) {
+                last_sent[k] = rmap.Map().at(k);
+            }
+            if (f % 3) {
+                replicator.Acknowledge(0, received);
+            }
+        };
+        size_t previous = 0;
+        for (int64_t f = 0; f < 100; ++f) {
+            // every entity of interest changes, but only the budget is sent
+            for (auto id : relevant) {
+                auto p = rmap.Map().at(id);
+                p.y += 0.001f;
+                rmap.Update(id, p);
+            }
+            replicate(f);
+            // an entity of interest is never removed from the client, even when starved
+            EXPECT_LE(previous, replica.State().size());
+            previous = replica.State().size();
+            for (const auto& entry : replica.State()) {
+                ASSERT_TRUE(relevant.count(entry.first));
+                ASSERT_EQ(0, std::memcmp(&last_sent.at(entry.first), &entry.second, sizeof(glm::vec3)));
+            }
+        }
+        EXPECT_EQ(relevant.size(), replica.State().size());
+        // an entity leaving the radius is removed
+        auto leaving = *relevant.begin();
+        glm::vec3 far(1000.0f, 0.0f, 0.0f);
+        grid.Update(leaving, far);
+        rmap.Update(leaving, far);
+        replicate(100);
+        EXPECT_EQ(relevant.size() - 1, replica.State().size());
+        EXPECT_EQ(0, replica.State().count(leaving));
+    }
+}
+
+#endif // INTEREST_GRID_TEST_HPP_INCLUDED
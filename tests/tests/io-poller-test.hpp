@@ -0,0 +1,84 @@
+#ifndef IO_POLLER_TEST_HPP_INCLUDED
+#define IO_POLLER_TEST_HPP_INCLUDED
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include "controllers/network/io-poller.hpp"
+#include "gtest/gtest.h"
+
+class IOPollerTest : public ::testing::Test {
+public:
+    IOPollerTest() : events(16) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        poller.Initialize();
+    }
+
+    ~IOPollerTest() {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+protected:
+    int fds[2];
+    trillek::network::IOPoller poller;
+    std::vector<trillek::network::IOPoller::event_type> events;
+};
+
+namespace trillek {
+    TEST_F(IOPollerTest, Dispatch) {
+        int tag;
+        poller.Create(fds[0], &tag);
+        EXPECT_EQ(0, poller.Poll(events));
+        ASSERT_EQ(1, write(fds[1], "a", 1));
+        ASSERT_EQ(1, poller.Poll(events));
+        EXPECT_EQ(fds[0], network::IOPoller::Socket(events[0]));
+        EXPECT_EQ(&tag, network::IOPoller::UserData(events[0]));
+        EXPECT_FALSE(network::IOPoller::IsEof(events[0]));
+        // disabled until Watch() is called
+        ASSERT_EQ(1, write(fds[1], "b", 1));
+        EXPECT_EQ(0, poller.Poll(events));
+        poller.Watch(fds[0]);
+        // pending data triggers a new event
+        EXPECT_EQ(1, poller.Poll(events));
+        poller.Delete(fds[0]);
+    }
+    TEST_F(IOPollerTest, Permanent) {
+        poller.CreatePermanent(fds[0]);
+        ASSERT_EQ(1, write(fds[1], "a", 1));
+        ASSERT_EQ(1, poller.Poll(events));
+        EXPECT_EQ(fds[0], network::IOPoller::Socket(events[0]));
+        ASSERT_EQ(1, write(fds[1], "b", 1));
+        EXPECT_EQ(1, poller.Poll(events));
+        poller.Unwatch(fds[0]);
+        ASSERT_EQ(1, write(fds[1], "c", 1));
+        EXPECT_EQ(0, poller.Poll(events));
+        poller.Delete(fds[0]);
+    }
+    TEST_F(IOPollerTest, Batch) {
+        int pairs[4][2];
+        for (auto& p : pairs) {
+            socketpair(AF_UNIX, SOCK_STREAM, 0, p);
+            poller.Create(p[0]);
+            ASSERT_EQ(1, write(p[1], "a", 1));
+        }
+        close(pairs[3][1]);
+        EXPECT_EQ(4, poller.Poll(events));
+        auto eof = 0;
+        for (auto i = 0; i < 4; ++i) {
+            if (network::IOPoller::IsEof(events[i])) {
+                ++eof;
+                EXPECT_EQ(pairs[3][0], network::IOPoller::Socket(events[i]));
+            }
+        }
+        EXPECT_EQ(1, eof);
+        for (auto& p : pairs) {
+            poller.Delete(p[0]);
+            close(p[0]);
+            if (&p != &pairs[3]) {
+                close(p[1]);
+            }
+        }
+    }
+}
+
+#endif // IO_POLLER_TEST_HPP_INCLUDED
@@ -0,0 +1,218 @@
+#ifndef LZ_CODEC_TEST_HPP_INCLUDED
+#define LZ_CODEC_TEST_HPP_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include "controllers/network/payload-compressor.hpp"
+#include "util/lz-codec.hpp"
+#include "gtest/gtest.h"
+
+/** \brief Samples of the traffic of the network messages
+ *
+ */
+class LZCodecTest : public ::testing::Test {
+public:
+    LZCodecTest() : rng(11) {}
+
+    // a resource description sent to a client
+    std::string Resource(int i) {
+        std::ostringstream ss;
+        ss << "{\"resources\":[{\"type\":\"mesh\",\"name\":\"mesh_" << i << "\",\"path\":\"assets/models/object_"
+           << rng() % 100 << ".obj\",\"transform\":{\"position\":[" << rng() % 1000 << "," << rng() % 1000
+           << ",0],\"scale\":[1,1,1]}},{\"type\":\"texture\",\"name\":\"texture_" << i
+           << "\",\"path\":\"assets/textures/material_" << rng() % 50 << ".png\"}]}";
+        return ss.str();
+    }
+
+    // a text mode screen of 80x25 cells of 2 bytes, as sent for a virtual display
+    std::string Screen() {
+        std::string ret(80 * 25 * 2, 0);
+        for (size_t i = 0; i < ret.size(); i += 2) {
+            ret[i] = ' ';
+            ret[i + 1] = 0x07;
+        }
+        const char* lines[] = { "TR3200 monitor ready", "> load 0x1000", "> run", "Hello, world!" };
+        for (int l = 0; l < 4; ++l) {
+            for (size_t c = 0; lines[l][c]; ++c) {
+                ret[(l * 80 + c) * 2] = lines[l][c];
+            }
+        }
+        return ret;
+    }
+
+    // a world snapshot: entity ids and transforms, most of them at rest
+    std::string Snapshot() {
+        std::string ret;
+        for (uint32_t id = 0; id < 64; ++id) {
+            float values[8] = { static_cast<float>(id * 4), 0.0f, static_cast<float>(rng() % 4), 0.0f, 0.0f, 0.0f, 1.0f, 1.0f };
+            ret.append(reinterpret_cast<const char*>(&id), sizeof(id));
+            ret.append(reinterpret_cast<const char*>(values), sizeof(values));
+        }
+        return ret;
+    }
+
+    // compress and expand the samples, and return the compression ratio
+    double Ratio(const std::vector<std::string>& samples, const trillek::util::algorithm::LZCodec& codec) {
+        size_t in = 0, out = 0;
+        std::vector<char> buffer, back;
+        for (const auto& s : samples) {
+            buffer.resize(trillek::util::algorithm::LZCodec::Bound(s.size()));
+            auto size = codec.Compress(s.data(), s.size(), buffer.data(), buffer.size());
+            EXPECT_LT(0, size);
+            in += s.size();
+            out += size;
+            back.resize(s.size());
+            EXPECT_TRUE(codec.Decompress(buffer.data(), size, back.data(), back.size()));
+            EXPECT_EQ(s, std::string(back.data(), back.size()));
+        }
+        return out ? static_cast<double>(in) / out : 0;
+    }
+
+    // measure the speed of the codec on the samples, and add it to the properties of the test
+    void Throughput(const std::string& name, const std::vector<std::string>& samples,
+                    const trillek::util::algorithm::LZCodec& codec) {
+        const auto rounds = 20;
+        size_t in = 0, out = 0;
+        std::vector<std::vector<char>> compressed(samples.size());
+        auto start = std::chrono::steady_clock::now();
+        for (auto r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < samples.size(); ++i) {
+                compressed[i].resize(trillek::util::algorithm::LZCodec::Bound(samples[i].size()));
+                auto size = codec.Compress(samples[i].data(), samples[i].size(), compressed[i].data(), compressed[i].size());
+                compressed[i].resize(size);
+                in += samples[i].size();
+                out += size;
+            }
+        }
+        auto middle = std::chrono::steady_clock::now();
+        std::vector<char> back;
+        for (auto r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < samples.size(); ++i) {
+                back.resize(samples[i].size());
+                ASSERT_TRUE(codec.Decompress(compressed[i].data(), compressed[i].size(), back.data(), back.size()));
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto rate = [in](std::chrono::steady_clock::duration d) {
+            auto seconds = std::max(std::chrono::duration<double>(d).count(), 1e-9);
+            return static_cast<int>(in / seconds / 1e6);
+        };
+        RecordProperty(name + "_compress_MBps", rate(middle - start));
+        RecordProperty(name + "_decompress_MBps", rate(end - middle));
+        RecordProperty(name + "_ratio_percent", static_cast<int>(out ? 100 * in / out : 0));
+    }
+
+protected:
+    std::mt19937 rng;
+};
+
+namespace trillek {
+    TEST_F(LZCodecTest, RoundTrip) {
+        util::algorithm::LZCodec codec;
+        std::vector<std::string> inputs = { "", "a", "abcd", "abcdabcdabcdabcdabcdabcd", std::string(100000, 'x'), Screen(), Resource(1) };
+        std::string random(5000, 0);
+        for (auto& c : random) {
+            c = static_cast<char>(rng());
+        }
+        inputs.push_back(random);
+        for (const auto& s : inputs) {
+            std::vector<char> buffer(util::algorithm::LZCodec::Bound(s.size()));
+            auto size = codec.Compress(s.data(), s.size(), buffer.data(), buffer.size());
+            ASSERT_LT(0, size);
+            std::vector<char> back(s.size() + 1);
+            ASSERT_TRUE(codec.Decompress(buffer.data(), size, back.data(), s.size()));
+            EXPECT_EQ(s, std::string(back.data(), s.size()));
+            // a wrong size or truncated data is rejected
+            EXPECT_FALSE(codec.Decompress(buffer.data(), size, back.data(), s.size() + 1));
+            if (size > 1) {
+                EXPECT_FALSE(codec.Decompress(buffer.data(), size - 1, back.data(), s.size()));
+            }
+        }
+        // the output buffer is too small
+        std::vector<char> small(10);
+        EXPECT_EQ(0, codec.Compress(random.data(), random.size(), small.data(), small.size()));
+    }
+    TEST_F(LZCodecTest, Dictionary) {
+        std::vector<std::string> training;
+        for (auto i = 0; i < 200; ++i) {
+            training.push_back(Resource(i));
+        }
+        util::algorithm::LZCodec plain;
+        util::algorithm::LZCodec trained(util::algorithm::LZCodec::Train(training, 4096));
+        EXPECT_LT(0, trained.Dictionary().size());
+        EXPECT_GE(4096, trained.Dictionary().size());
+        auto message = Resource(1000);
+        std::vector<char> a(util::algorithm::LZCodec::Bound(message.size())), b(a.size());
+        auto plain_size = plain.Compress(message.data(), message.size(), a.data(), a.size());
+        auto trained_size = trained.Compress(message.data(), message.size(), b.data(), b.size());
+        EXPECT_LT(trained_size * 4, plain_size * 3);
+        std::vector<char> back(message.size());
+        ASSERT_TRUE(trained.Decompress(b.data(), trained_size, back.data(), back.size()));
+        EXPECT_EQ(message, std::string(back.data(), back.size()));
+        // the dictionary must be the same on both sides
+        EXPECT_FALSE(plain.Decompress(b.data(), trained_size, back.data(), back.size()));
+    }
+    TEST_F(LZCodecTest, Payload) {
+        util::algorithm::LZCodec codec;
+        network::PayloadCompressor compressor(codec);
+        auto screen = Screen();
+        std::vector<char> body(sizeof(uint32_t) + util::algorithm::LZCodec::Bound(screen.size()));
+        uint32_t original = static_cast<uint32_t>(screen.size());
+        std::memcpy(body.data(), &original, sizeof(original));
+        auto size = codec.Compress(screen.data(), screen.size(), body.data() + sizeof(original), body.size() - sizeof(original));
+        ASSERT_EQ(screen.size(), network::PayloadCompressor::OriginalSize(body.data(), size + sizeof(original)));
+        std::vector<char> back(screen.size());
+        ASSERT_TRUE(compressor.Decompress(body.data(), size + sizeof(original), back.data()));
+        EXPECT_EQ(screen, std::string(back.data(), back.size()));
+        network::msg_hdr header{};
+        header.flags = MSG_FLAG_COMPRESSED;
+        EXPECT_TRUE(network::PayloadCompressor::IsCompressed(&header));
+        EXPECT_EQ(0, network::PayloadCompressor::OriginalSize(body.data(), 2));
+    }
+    TEST_F(LZCodecTest, Ratios) {
+        std::vector<std::string> resources, screens, snapshots, training;
+        for (auto i = 0; i < 200; ++i) {
+            resources.push_back(Resource(i));
+            snapshots.push_back(Snapshot());
+            training.push_back(Resource(10000 + i));
+            training.push_back(Snapshot());
+        }
+        for (auto i = 0; i < 20; ++i) {
+            screens.push_back(Screen());
+        }
+        util::algorithm::LZCodec plain;
+        util::algorithm::LZCodec trained(util::algorithm::LZCodec::Train(training, 16384));
+        // the dictionary helps most on the short resource descriptions
+        auto resources_ratio = Ratio(resources, plain);
+        EXPECT_LT(1.1, resources_ratio);
+        EXPECT_LT(1.4 * resources_ratio, Ratio(resources, trained));
+        EXPECT_LT(20, Ratio(screens, plain));
+        auto snapshots_ratio = Ratio(snapshots, plain);
+        EXPECT_LT(2, snapshots_ratio);
+        EXPECT_LT(snapshots_ratio, Ratio(snapshots, trained));
+    }
+    TEST_F(LZCodecTest, Speed) {
+        std::vector<std::string> resources, screens, snapshots, training;
+        for (auto i = 0; i < 200; ++i) {
+            resources.push_back(Resource(i));
+            snapshots.push_back(Snapshot());
+            training.push_back(Resource(10000 + i));
+            training.push_back(Snapshot());
+        }
+        for (auto i = 0; i < 20; ++i) {
+            screens.push_back(Screen());
+        }
+        util::algorithm::LZCodec plain;
+        util::algorithm::LZCodec trained(util::algorithm::LZCodec::Train(training, 16384));
+        // the speeds are reported in the test results, they are not asserted
+        Throughput("resources", resources, plain);
+        Throughput("resources_trained", resources, trained);
+        Throughput("screens", screens, plain);
+        Throughput("snapshots", snapshots, plain);
+        Throughput("snapshots_trained", snapshots, trained);
+    }
+}
+
+#endif // LZ_CODEC_TEST_HPP_INCLUDED
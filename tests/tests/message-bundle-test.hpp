@@ -0,0 +1,98 @@
+#ifndef MESSAGE_BUNDLE_TEST_HPP_INCLUDED
+#define MESSAGE_BUNDLE_TEST_HPP_INCLUDED
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include "controllers/network/message-bundle.hpp"
+#include "controllers/network/send-queue.hpp"
+#include "controllers/network/stream-ring.hpp"
+#include "gtest/gtest.h"
+
+namespace trillek {
+    // a checksum standing for the VMAC tag
+    static void BundleTestHasher(uint8_t* tag, const uint8_t* data, size_t size) {
+        uint8_t sum[4] = {};
+        for (size_t i = 0; i < size; ++i) {
+            sum[i % 4] ^= data[i];
+        }
+        std::memcpy(tag, sum, 4);
+    }
+
+    TEST(MessageBundleTest, Pack) {
+        network::MessageBundler bundler(4, 200);
+        std::string body(50, 'b');
+        for (auto i = 0; i < 10; ++i) {
+            EXPECT_TRUE(bundler.Queue(GAME_MSG, static_cast<uint8_t>(i), body.data(), body.size()));
+        }
+        EXPECT_FALSE(bundler.Queue(GAME_MSG, 0, std::string(200, 'x').data(), 200));
+        EXPECT_EQ(10, bundler.Queued());
+        // 3 records of 54 bytes per bundle
+        EXPECT_EQ(4, bundler.Bundles());
+        std::vector<network::MessageBundler::bundle_type> sent;
+        EXPECT_EQ(4, bundler.Flush(123, BundleTestHasher, [&](network::MessageBundler::bundle_type b) {
+            sent.push_back(std::move(b));
+        }));
+        EXPECT_EQ(0, bundler.Bundles());
+        uint8_t minor = 0;
+        for (auto& b : sent) {
+            EXPECT_LE(b->size(), 200);
+            auto frame = reinterpret_cast<const network::Frame*>(b->data());
+            EXPECT_EQ(b->size() - sizeof(network::Frame_hdr), frame->fheader.length);
+            EXPECT_TRUE(network::MessageBundler::IsBundle(&frame->mheader));
+            EXPECT_EQ(123, frame->mheader.timestamp);
+            EXPECT_TRUE(network::MessageBundler::Unpack(b->data() + sizeof(network::Frame), b->size() - sizeof(network::Frame) - 4,
+                [&](uint8_t major, uint8_t m, const char* data, size_t size) {
+                    EXPECT_EQ(GAME_MSG, major);
+                    EXPECT_EQ(minor++, m);
+                    EXPECT_EQ(body, std::string(data, size));
+                }));
+        }
+        EXPECT_EQ(10, minor);
+        std::string bad(6, 0);
+        bad[0] = 10;
+        EXPECT_FALSE(network::MessageBundler::Unpack(bad.data(), bad.size(), [](uint8_t, uint8_t, const char*, size_t) {}));
+    }
+
+    TEST(MessageBundleTest, Stream) {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        network::MessageBundler bundler(4);
+        network::SendQueue queue;
+        for (uint32_t i = 0; i < 50; ++i) {
+            bundler.Queue(WORLD_MSG, 1, &i, sizeof(i));
+        }
+        // a single bundle replaces 50 frames
+        EXPECT_EQ(1, bundler.Flush(7, BundleTestHasher, [&](network::MessageBundler::bundle_type b) {
+            auto data = b->data();
+            auto size = b->size();
+            queue.Push(std::move(b), data, size, nullptr, 0);
+        }));
+        EXPECT_LT(0, queue.Flush(fds[0]));
+        network::StreamRing ring(4096);
+        EXPECT_LT(0, ring.Receive(fds[1]));
+        network::FrameView view;
+        ASSERT_EQ(network::FrameStatus::COMPLETE, ring.NextFrame(view));
+        uint8_t tag[4];
+        BundleTestHasher(tag, reinterpret_cast<const uint8_t*>(view.data + sizeof(network::Frame_hdr)),
+                         view.size - sizeof(network::Frame_hdr) - 4);
+        EXPECT_EQ(0, std::memcmp(tag, view.Tag(4), 4));
+        ASSERT_TRUE(network::MessageBundler::IsBundle(view.Header()));
+        uint32_t expected = 0;
+        EXPECT_TRUE(network::MessageBundler::Unpack(view.Body(), view.BodySize(4),
+            [&](uint8_t major, uint8_t minor, const char* data, size_t size) {
+                ASSERT_EQ(sizeof(uint32_t), size);
+                uint32_t value;
+                std::memcpy(&value, data, size);
+                EXPECT_EQ(expected++, value);
+            }));
+        EXPECT_EQ(50, expected);
+        ring.Release(view);
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
+
+#endif // MESSAGE_BUNDLE_TEST_HPP_INCLUDED
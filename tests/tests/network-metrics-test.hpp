@@ -0,0 +1,98 @@
+#ifndef NETWORK_METRICS_TEST_HPP_INCLUDED
+#define NETWORK_METRICS_TEST_HPP_INCLUDED
+
+#include <thread>
+#include <vector>
+#include "controllers/network/network-metrics.hpp"
+#include "gtest/gtest.h"
+
+namespace trillek {
+    TEST(NetworkMetricsTest, Buckets) {
+        size_t previous = 0;
+        for (uint64_t v = 0; v < 1000000; v += 1 + v / 100) {
+            auto bucket = network::HistogramSnapshot::Bucket(v);
+            EXPECT_LE(previous, bucket);
+            previous = bucket;
+            auto max = network::HistogramSnapshot::BucketMax(bucket);
+            EXPECT_LE(v, max);
+            EXPECT_LE(max - v, v / 8);
+        }
+        auto last = network::HistogramSnapshot::Bucket(~uint64_t(0));
+        EXPECT_EQ(network::HistogramSnapshot::BUCKETS - 1, last);
+        EXPECT_EQ(~uint64_t(0), network::HistogramSnapshot::BucketMax(last));
+    }
+    TEST(NetworkMetricsTest, Percentiles) {
+        network::LogHistogram histogram;
+        EXPECT_EQ(0, histogram.Snapshot().Percentile(0.5));
+        for (uint64_t v = 1; v <= 10000; ++v) {
+            histogram.Record(v);
+        }
+        auto snapshot = histogram.Snapshot();
+        EXPECT_EQ(10000, snapshot.Count());
+        EXPECT_EQ(10000, snapshot.Max());
+        EXPECT_DOUBLE_EQ(5000.5, snapshot.Mean());
+        EXPECT_NEAR(5000, snapshot.Percentile(0.5), 5000 / 8);
+        EXPECT_NEAR(9900, snapshot.Percentile(0.99), 9900 / 8);
+        EXPECT_EQ(10000, snapshot.Percentile(1.0));
+    }
+    TEST(NetworkMetricsTest, Concurrent) {
+        auto metrics = std::make_shared<network::ConnectionMetrics>();
+        std::vector<std::thread> threads;
+        for (auto t = 0; t < 4; ++t) {
+            threads.emplace_back([&metrics, t]() {
+                for (auto i = 0; i < 100000; ++i) {
+                    metrics->Received(100);
+                    metrics->Queued();
+                    metrics->Processed(static_cast<uint8_t>(t), 2);
+                    metrics->RoundTrip(static_cast<uint64_t>(i % 1000));
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        auto snapshot = metrics->Snapshot();
+        EXPECT_EQ(400000, snapshot.packets_received);
+        EXPECT_EQ(40000000, snapshot.bytes_received);
+        EXPECT_EQ(0, snapshot.queue_depth);
+        EXPECT_LE(1, snapshot.max_queue_depth);
+        EXPECT_GE(4, snapshot.max_queue_depth);
+        EXPECT_EQ(800000, snapshot.processing_time);
+        EXPECT_EQ(100000, snapshot.type_messages[3]);
+        EXPECT_EQ(400000, snapshot.rtt.Count());
+        EXPECT_EQ(999, snapshot.rtt.Max());
+    }
+    TEST(NetworkMetricsTest, Server) {
+        network::NetworkMetrics server;
+        auto a = std::make_shared<network::ConnectionMetrics>();
+        auto b = std::make_shared<network::ConnectionMetrics>();
+        server.Register(1, a);
+        server.Register(2, b);
+        a->Sent(1000);
+        a->Processed(10, 50);
+        b->Sent(500);
+        b->Processed(9, 500);
+        b->Retransmitted(3);
+        b->Reassembled(40);
+        server.Unattributed().AuthenticationFailed();
+        std::vector<network::MetricsSnapshot> connections;
+        auto total = server.Snapshot(&connections);
+        EXPECT_EQ(2, connections.size());
+        EXPECT_EQ(1500, total.bytes_sent);
+        EXPECT_EQ(2, total.packets_sent);
+        EXPECT_EQ(3, total.retransmissions);
+        EXPECT_EQ(1, total.authentication_failures);
+        EXPECT_EQ(550, total.processing_time);
+        EXPECT_EQ(500, total.type_time[9]);
+        EXPECT_EQ(1, total.reassembly_time.Count());
+        // the connection eating the most time comes first
+        auto top = server.TopConnections(1);
+        ASSERT_EQ(1, top.size());
+        EXPECT_EQ(2, top[0].id);
+        // a closed connection is forgotten
+        b.reset();
+        EXPECT_EQ(1000, server.Snapshot().bytes_sent);
+    }
+}
+
+#endif // NETWORK_METRICS_TEST_HPP_INCLUDED
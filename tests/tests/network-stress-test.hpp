@@ -0,0 +1,514 @@
+#ifndef NETWORK_STRESS_TEST_HPP_INCLUDED
+#define NETWORK_STRESS_TEST_HPP_INCLUDED
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "controllers/network/reliable-channel.hpp"
+#include "controllers/network/stream-ring.hpp"
+#include "gtest/gtest.h"
+
+/** \brief In-process load test of the network stack
+ *
+ * N clients are connected to a server by socket pairs: a stream pair, on which the frames are
+ * reassembled by a StreamRing as on a TCP connection, and a datagram pair carrying a ReliableChannel.
+ * The datagrams go through an impairment queue adding latency, jitter, reordering, loss and
+ * corruption.
+ *
+ * Each client authenticates with a challenge on the stream, then sends messages on both paths
+ * as fast as the sockets accept them. Once authenticated, every frame and datagram carries a tag
+ * checked by the server before dispatch, the stream tags using a counter as nonce as the VMAC
+ * stream hasher does. The tag function stands in for VMAC, which needs Crypto++.
+ *
+ * The server checks that each message is received once and that the ordered messages
+ * are in order, and measures the latency from the send to the dispatch.
+ */
+namespace stress {
+
+using trillek::network::Frame;
+using trillek::network::Frame_hdr;
+using trillek::network::msg_hdr;
+using trillek::network::ReliableChannel;
+
+// minor types of the NET_MSG messages of the handshake
+const uint8_t AUTH_INIT = 1;
+const uint8_t AUTH_CHALLENGE = 2;
+const uint8_t AUTH_RESPONSE = 3;
+const uint8_t AUTH_ACCEPTED = 4;
+
+// the messages of the load
+const uint8_t LOAD_STREAM = 1;
+const uint8_t LOAD_DATAGRAM = 2;
+
+inline uint64_t Now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/** \brief Keyed tag of VMAC_SIZE bytes, FNV-1a over the key, the nonce and the data
+ *
+ */
+inline void Tag(uint8_t* digest, uint64_t key, uint64_t nonce, const char* data, size_t size) {
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](uint8_t b) { h = (h ^ b) * 1099511628211ULL; };
+    for (size_t i = 0; i < 8; ++i) {
+        mix(static_cast<uint8_t>(key >> (8 * i)));
+        mix(static_cast<uint8_t>(nonce >> (8 * i)));
+    }
+    for (size_t i = 0; i < size; ++i) {
+        mix(static_cast<uint8_t>(data[i]));
+    }
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    std::memcpy(digest, &h, VMAC_SIZE);
+}
+
+/// The body of a load message
+struct Payload {
+    uint32_t client;
+    uint32_t sequence;
+    uint64_t time;
+};
+
+/// Settings of a run
+struct Settings {
+    size_t clients = 16;
+    // messages per client and per path
+    size_t messages = 2000;
+    size_t body_size = 64;
+    // impairment of the datagrams, in percent and microseconds
+    unsigned int loss = 5;
+    unsigned int corruption = 1;
+    uint64_t latency = 2000;
+    uint64_t jitter = 2000;
+    uint64_t timeout = 30000000;
+};
+
+/// Results of a run
+struct Report {
+    size_t received = 0;
+    size_t bytes = 0;
+    size_t duplicates = 0;
+    size_t out_of_order = 0;
+    size_t rejected_tags = 0;
+    size_t unauthenticated = 0;
+    size_t retransmissions = 0;
+    size_t authenticated = 0;
+    double seconds = 0;
+    std::vector<uint64_t> latencies;
+
+    uint64_t Percentile(double p) {
+        if (latencies.empty()) {
+            return 0;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    }
+
+    /// Add the throughput and the latency percentiles to the properties of the test
+    void Record() {
+        auto elapsed = seconds > 0 ? seconds : 1e-6;
+        ::testing::Test::RecordProperty("messages_per_second", static_cast<int>(received / elapsed));
+        ::testing::Test::RecordProperty("kilobytes_per_second", static_cast<int>(bytes / elapsed / 1e3));
+        ::testing::Test::RecordProperty("latency_p50_us", static_cast<int>(Percentile(0.5)));
+        ::testing::Test::RecordProperty("latency_p99_us", static_cast<int>(Percentile(0.99)));
+        ::testing::Test::RecordProperty("latency_p999_us", static_cast<int>(Percentile(0.999)));
+        ::testing::Test::RecordProperty("retransmissions", static_cast<int>(retransmissions));
+    }
+};
+
+/** \brief One direction of a stream connection, with partial writes
+ *
+ */
+class StreamEnd {
+public:
+    StreamEnd(int fd) : fd(fd), ring(1 << 16), send_nonce(0), receive_nonce(0) {}
+
+    ~StreamEnd() {
+        close(fd);
+    }
+
+    void Queue(uint8_t major, uint8_t minor, const char* body, size_t size, const uint64_t* key) {
+        Frame frame{};
+        frame.fheader.length = static_cast<uint32_t>(sizeof(msg_hdr) + size + (key ? VMAC_SIZE : 0));
+        frame.mheader.type_major = major;
+        frame.mheader.type_minor = minor;
+        auto start = output.size();
+        output.append(reinterpret_cast<const char*>(&frame), sizeof(frame));
+        output.append(body, size);
+        if (key) {
+            uint8_t tag[VMAC_SIZE];
+            Tag(tag, *key, send_nonce++, &output[start + sizeof(Frame_hdr)], sizeof(msg_hdr) + size);
+            output.append(reinterpret_cast<const char*>(tag), VMAC_SIZE);
+        }
+    }
+
+    /** \brief Write the queued data, in chunks of random sizes to split the frames
+     *
+     */
+    void Flush(std::mt19937& rng) {
+        while (written < output.size()) {
+            auto chunk = std::min<size_t>(output.size() - written, 1 + rng() % 4096);
+            auto ret = write(fd, output.data() + written, chunk);
+            if (ret <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(ret);
+        }
+        if (written == output.size() || written > (1 << 20)) {
+            output.erase(0, written);
+            written = 0;
+        }
+    }
+
+    /** \brief Read the frames received and call f(view, tag_ok) for each of them
+     *
+     */
+    template<class F>
+    void Poll(const uint64_t* key, F f) {
+        while (ring.Free() && ring.Receive(fd) > 0) {}
+        trillek::network::FrameView view;
+        while (ring.NextFrame(view) == trillek::network::FrameStatus::COMPLETE) {
+            bool tag_ok = true;
+            size_t tag_size = key ? VMAC_SIZE : 0;
+            if (view.size < sizeof(Frame) + tag_size) {
+                tag_ok = false;
+            }
+            else if (key) {
+                uint8_t tag[VMAC_SIZE];
+                Tag(tag, *key, receive_nonce++, view.data + sizeof(Frame_hdr), view.size - sizeof(Frame_hdr) - VMAC_SIZE);
+                tag_ok = std::memcmp(tag, view.Tag(VMAC_SIZE), VMAC_SIZE) == 0;
+            }
+            f(view, tag_size, tag_ok);
+            ring.Release(view);
+        }
+    }
+
+    bool Idle() const {
+        return output.empty();
+    }
+
+private:
+    int fd;
+    trillek::network::StreamRing ring;
+    std::string output;
+    size_t written = 0;
+    uint64_t send_nonce;
+    uint64_t receive_nonce;
+};
+
+/** \brief Impairment of the datagrams sent on a socket
+ *
+ */
+class ImpairedLink {
+public:
+    ImpairedLink(int fd, const Settings& settings, unsigned int seed) : fd(fd), settings(settings), rng(seed) {}
+
+    ~ImpairedLink() {
+        close(fd);
+    }
+
+    void Send(uint64_t now, const char* data, size_t size) {
+        if (rng() % 100 < settings.loss) {
+            return;
+        }
+        std::string datagram(data, size);
+        if (rng() % 100 < settings.corruption) {
+            datagram[rng() % size] ^= static_cast<char>(1 << (rng() % 8));
+        }
+        auto delay = settings.latency + (settings.jitter ? rng() % settings.jitter : 0);
+        queue.emplace(now + delay, std::move(datagram));
+    }
+
+    /// Write the datagrams that are due, they are reordered by the jitter
+    void Flush(uint64_t now) {
+        while (! queue.empty() && queue.begin()->first <= now) {
+            const auto& d = queue.begin()->second;
+            if (write(fd, d.data(), d.size()) < 0) {
+                // the socket buffer is full: dropped as by a router
+            }
+            queue.erase(queue.begin());
+        }
+    }
+
+    template<class F>
+    void Poll(F f) {
+        char buffer[2048];
+        ssize_t size;
+        while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+            f(buffer, static_cast<size_t>(size));
+        }
+    }
+
+private:
+    int fd;
+    const Settings& settings;
+    std::mt19937 rng;
+    std::multimap<uint64_t,std::string> queue;
+};
+
+// append a tag to a datagram of the reliable channel
+inline void SendDatagram(ImpairedLink& link, uint64_t now, uint64_t key, const char* data, size_t size) {
+    std::string datagram(data, size);
+    uint8_t tag[VMAC_SIZE];
+    Tag(tag, key, 0, data, size);
+    datagram.append(reinterpret_cast<const char*>(tag), VMAC_SIZE);
+    link.Send(now, datagram.data(), datagram.size());
+}
+
+inline bool CheckDatagram(uint64_t key, const char* data, size_t size) {
+    if (size < VMAC_SIZE) {
+        return false;
+    }
+    uint8_t tag[VMAC_SIZE];
+    Tag(tag, key, 0, data, size - VMAC_SIZE);
+    return std::memcmp(tag, data + size - VMAC_SIZE, VMAC_SIZE) == 0;
+}
+
+/** \brief A client and its connection on the server side
+ *
+ */
+struct Connection {
+    Connection(uint32_t id, const Settings& settings, int stream[2], int datagram[2]) :
+        id(id), key(0x9E3779B97F4A7C15ULL * (id + 1)), client_stream(stream[0]), server_stream(stream[1]),
+        client_link(datagram[0], settings, id * 2 + 1), server_link(datagram[1], settings, id * 2 + 2),
+        rng(id), authenticated(false), server_authenticated(false), nonce(0),
+        stream_sent(0), datagram_sent(0), stream_expected(0), datagram_expected(0) {}
+
+    const uint32_t id;
+    // the key shared after the handshake
+    const uint64_t key;
+    StreamEnd client_stream;
+    StreamEnd server_stream;
+    ImpairedLink client_link;
+    ImpairedLink server_link;
+    ReliableChannel client_channel;
+    ReliableChannel server_channel;
+    std::mt19937 rng;
+    bool authenticated;
+    bool server_authenticated;
+    uint64_t nonce;
+    uint32_t stream_sent;
+    uint32_t datagram_sent;
+    uint32_t stream_expected;
+    uint32_t datagram_expected;
+};
+
+/** \brief The harness
+ *
+ */
+class Harness {
+public:
+    Harness(const Settings& settings) : settings(settings) {
+        for (uint32_t i = 0; i < settings.clients; ++i) {
+            int stream[2], datagram[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, stream) || socketpair(AF_UNIX, SOCK_DGRAM, 0, datagram)) {
+                break;
+            }
+            for (auto fd : { stream[0], stream[1], datagram[0], datagram[1] }) {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+            }
+            connections.emplace_back(new Connection(i, settings, stream, datagram));
+        }
+    }
+
+    Report Run() {
+        Report report;
+        for (auto& c : connections) {
+            // the client starts the handshake
+            c->client_stream.Queue(NET_MSG, AUTH_INIT, reinterpret_cast<const char*>(&c->id), sizeof(c->id), nullptr);
+        }
+        auto start = Now();
+        for (auto now = start; now - start < settings.timeout; now = Now()) {
+            bool done = true;
+            for (auto& c : connections) {
+                ClientStep(*c, now);
+                ServerStep(*c, now, report);
+                done = done && c->stream_expected == settings.messages && c->datagram_expected == settings.messages
+                       && c->client_channel.Idle();
+            }
+            if (done) {
+                break;
+            }
+        }
+        report.seconds = (Now() - start) / 1e6;
+        for (auto& c : connections) {
+            report.retransmissions += c->client_channel.Retransmissions();
+            report.authenticated += c->server_authenticated;
+        }
+        return report;
+    }
+
+private:
+    void ClientStep(Connection& c, uint64_t now) {
+        c.client_stream.Poll(c.authenticated ? &c.key : nullptr, [&](const trillek::network::FrameView& view, size_t, bool) {
+            auto header = view.Header();
+            if (header->type_major != NET_MSG) {
+                return;
+            }
+            if (header->type_minor == AUTH_CHALLENGE && view.BodySize(0) == sizeof(uint64_t)) {
+                uint64_t challenge;
+                std::memcpy(&challenge, view.Body(), sizeof(challenge));
+                uint8_t response[VMAC_SIZE];
+                Tag(response, c.key, challenge, nullptr, 0);
+                c.client_stream.Queue(NET_MSG, AUTH_RESPONSE, reinterpret_cast<const char*>(response), VMAC_SIZE, nullptr);
+            }
+            else if (header->type_minor == AUTH_ACCEPTED) {
+                c.authenticated = true;
+            }
+        });
+        if (c.authenticated) {
+            std::string body(settings.body_size, static_cast<char>(c.id));
+            // a few messages per step, so that all the clients progress together
+            for (auto i = 0; i < 8 && c.stream_sent < settings.messages; ++i) {
+                Payload payload{ c.id, c.stream_sent++, now };
+                std::memcpy(&body[0], &payload, sizeof(payload));
+                c.client_stream.Queue(TEST_MSG, LOAD_STREAM, body.data(), body.size(), &c.key);
+            }
+            for (auto i = 0; i < 8 && c.datagram_sent < settings.messages; ++i) {
+                Payload payload{ c.id, c.datagram_sent++, now };
+                std::memcpy(&body[0], &payload, sizeof(payload));
+                c.client_channel.Send(ReliableChannel::Mode::ORDERED, body.data(), body.size());
+            }
+        }
+        c.client_stream.Flush(c.rng);
+        c.client_channel.Update(now, [&](const char* d, size_t s) { SendDatagram(c.client_link, now, c.key, d, s); });
+        c.client_link.Flush(now);
+        c.client_link.Poll([&](const char* d, size_t s) {
+            if (CheckDatagram(c.key, d, s)) {
+                c.client_channel.Receive(now, d, s - VMAC_SIZE);
+            }
+        });
+    }
+
+    void ServerStep(Connection& c, uint64_t now, Report& report) {
+        c.server_stream.Poll(c.server_authenticated ? &c.key : nullptr, [&](const trillek::network::FrameView& view, size_t tag_size, bool tag_ok) {
+            if (! tag_ok) {
+                ++report.rejected_tags;
+                return;
+            }
+            Dispatch(c, view.Header()->type_major, view.Header()->type_minor, view.Body(), view.BodySize(tag_size), now, report);
+        });
+        c.server_stream.Flush(c.rng);
+        c.server_link.Poll([&](const char* d, size_t s) {
+            if (! c.server_authenticated) {
+                ++report.unauthenticated;
+                return;
+            }
+            if (! CheckDatagram(c.key, d, s)) {
+                ++report.rejected_tags;
+                return;
+            }
+            c.server_channel.Receive(now, d, s - VMAC_SIZE);
+        });
+        ReliableChannel::Mode mode;
+        std::string data;
+        while (c.server_channel.Pop(mode, data)) {
+            Dispatch(c, TEST_MSG, LOAD_DATAGRAM, data.data(), data.size(), now, report);
+        }
+        c.server_channel.Update(now, [&](const char* d, size_t s) { SendDatagram(c.server_link, now, c.key, d, s); });
+        c.server_link.Flush(now);
+    }
+
+    /** \brief Route a message to its handler
+     *
+     */
+    void Dispatch(Connection& c, uint8_t major, uint8_t minor, const char* body, size_t size, uint64_t now, Report& report) {
+        switch (major) {
+        case NET_MSG:
+            HandleAuthentication(c, minor, body, size);
+            break;
+        case TEST_MSG:
+            if (! c.server_authenticated) {
+                ++report.unauthenticated;
+                break;
+            }
+            HandleLoad(c, minor == LOAD_STREAM ? c.stream_expected : c.datagram_expected, body, size, now, report);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void HandleAuthentication(Connection& c, uint8_t minor, const char* body, size_t size) {
+        if (minor == AUTH_INIT && size == sizeof(uint32_t)) {
+            c.nonce = (static_cast<uint64_t>(c.rng()) << 32) | c.rng();
+            c.server_stream.Queue(NET_MSG, AUTH_CHALLENGE, reinterpret_cast<const char*>(&c.nonce), sizeof(c.nonce), nullptr);
+        }
+        else if (minor == AUTH_RESPONSE && size == VMAC_SIZE && ! c.server_authenticated) {
+            uint8_t expected[VMAC_SIZE];
+            Tag(expected, c.key, c.nonce, nullptr, 0);
+            if (std::memcmp(expected, body, VMAC_SIZE) == 0) {
+                c.server_stream.Queue(NET_MSG, AUTH_ACCEPTED, nullptr, 0, nullptr);
+                c.server_authenticated = true;
+            }
+        }
+    }
+
+    void HandleLoad(Connection& c, uint32_t& expected, const char* body, size_t size, uint64_t now, Report& report) {
+        Payload payload;
+        if (size < sizeof(payload)) {
+            return;
+        }
+        std::memcpy(&payload, body, sizeof(payload));
+        if (payload.client != c.id || payload.sequence < expected) {
+            ++report.duplicates;
+            return;
+        }
+        if (payload.sequence > expected) {
+            ++report.out_of_order;
+        }
+        expected = payload.sequence + 1;
+        ++report.received;
+        report.bytes += size;
+        report.latencies.push_back(now - payload.time);
+    }
+
+    const Settings& settings;
+    std::vector<std::unique_ptr<Connection>> connections;
+};
+
+} // stress
+
+namespace trillek {
+    TEST(NetworkStressTest, Clean) {
+        stress::Settings settings;
+        settings.loss = 0;
+        settings.corruption = 0;
+        settings.jitter = 0;
+        stress::Harness harness(settings);
+        auto report = harness.Run();
+        report.Record();
+        EXPECT_EQ(settings.clients, report.authenticated);
+        EXPECT_EQ(2 * settings.clients * settings.messages, report.received);
+        EXPECT_EQ(0, report.duplicates);
+        EXPECT_EQ(0, report.out_of_order);
+        EXPECT_EQ(0, report.rejected_tags);
+        EXPECT_EQ(0, report.unauthenticated);
+    }
+    TEST(NetworkStressTest, Impaired) {
+        stress::Settings settings;
+        stress::Harness harness(settings);
+        auto report = harness.Run();
+        report.Record();
+        EXPECT_EQ(settings.clients, report.authenticated);
+        // every message arrives once and in order despite the loss, the reordering and the corruption
+        EXPECT_EQ(2 * settings.clients * settings.messages, report.received);
+        EXPECT_EQ(0, report.duplicates);
+        EXPECT_EQ(0, report.out_of_order);
+        EXPECT_LT(0, report.rejected_tags);
+        EXPECT_LT(0, report.retransmissions);
+        EXPECT_GT(settings.timeout / 1e6, report.seconds);
+    }
+}
+
+#endif // NETWORK_STRESS_TEST_HPP_INCLUDED
@@ -0,0 +1,144 @@
+#ifndef PERSISTENT_MAP_TEST_HPP_INCLUDED
+#define PERSISTENT_MAP_TEST_HPP_INCLUDED
+
+#include <random>
+#include "persistent-map.hpp"
+#include "systems/rewindable-map.hpp"
+#include "gtest/gtest.h"
+
+class PersistentMapTest : public ::testing::Test {
+public:
+    void SetUp() override {
+        rmap.Insert(1,std::string("one"));
+        rmap.Insert(2,std::string("two"));
+        rmap.Insert(3,std::string("three"));
+        rmap.Insert(4,std::string("four"));
+        rmap.Insert(5,std::string("five"));
+    }
+
+    void Commit() {
+        rmap.Commit(0);
+        rmap.Update(2,std::string("one"));
+        rmap.Update(1,std::string("two"));
+        rmap.Update(5,std::string("three"));
+        rmap.Remove(4);
+        rmap.Commit(100);
+        rmap.Update(2,std::string("three"));
+        rmap.Update(3,std::string("two"));
+        rmap.Update(5,std::string("one"));
+        rmap.Insert(4, std::string("six"));
+        rmap.Commit(200);
+    }
+
+    template<class M>
+    void ExpectEqual(const std::map<unsigned int, std::string>& ref, const M& map) {
+        EXPECT_EQ(ref.size(), map.size());
+        auto it = map.cbegin();
+        for (auto& entry : ref) {
+            ASSERT_FALSE(it == map.cend());
+            EXPECT_EQ(entry.first, it->first);
+            EXPECT_EQ(entry.second, it->second);
+            ++it;
+        }
+        EXPECT_TRUE(it == map.cend());
+    }
+protected:
+    std::map<unsigned int, std::string> refmap0{{1,"one"},{2,"two"},{3,"three"},{4,"four"},{5,"five"}};
+    std::map<unsigned int, std::string> refmap100{{1,"two"},{2,"one"},{3,"three"},{5,"three"}};
+    std::map<unsigned int, std::string> refmap200{{1,"two"},{2,"three"},{3,"two"},{4,"six"},{5,"one"}};
+
+    trillek::RewindableMap<unsigned int,std::string,int64_t,50,true> rmap;
+};
+
+namespace trillek {
+    TEST_F(PersistentMapTest, RandomOperations) {
+        std::default_random_engine random(42);
+        PersistentMap<int,int> map;
+        std::map<int,int> witness;
+        for (auto i = 0; i < 5000; ++i) {
+            auto key = static_cast<int>(random() % 500);
+            if (random() % 3) {
+                map.assign(key, i);
+                witness[key] = i;
+            }
+            else {
+                EXPECT_EQ(witness.erase(key), map.erase(key));
+            }
+        }
+        ASSERT_EQ(witness.size(), map.size());
+        auto it = map.cbegin();
+        for (auto& entry : witness) {
+            EXPECT_EQ(entry.first, it->first);
+            EXPECT_EQ(entry.second, it->second);
+            EXPECT_EQ(entry.second, map.at(entry.first));
+            ++it;
+        }
+        EXPECT_TRUE(it == map.cend());
+    }
+    TEST_F(PersistentMapTest, StructuralSharing) {
+        PersistentMap<int,int> map;
+        for (auto i = 0; i < 100; ++i) {
+            map.assign(i, i);
+        }
+        auto snapshot = map;
+        EXPECT_TRUE(snapshot.SameVersion(map));
+        map.erase(50);
+        map.assign(10, 1000);
+        map.insert(std::make_pair(11, 1000));
+
+        EXPECT_FALSE(snapshot.SameVersion(map));
+        EXPECT_EQ(100, snapshot.size());
+        EXPECT_EQ(50, snapshot.at(50));
+        EXPECT_EQ(10, snapshot.at(10));
+        EXPECT_EQ(99, map.size());
+        EXPECT_EQ(0, map.count(50));
+        EXPECT_EQ(1000, map.at(10));
+        EXPECT_EQ(11, map.at(11));
+    }
+    TEST_F(PersistentMapTest, Rewind) {
+        Commit();
+        EXPECT_EQ(100, rmap.Checkout(100));
+        ExpectEqual(refmap100, rmap.Map());
+        EXPECT_EQ(0, rmap.Checkout(0));
+        ExpectEqual(refmap0, rmap.Map());
+    }
+    TEST_F(PersistentMapTest, Forward) {
+        Commit();
+        EXPECT_EQ(0, rmap.Checkout(0));
+        EXPECT_EQ(100, rmap.Checkout(150));
+        ExpectEqual(refmap100, rmap.Map());
+        rmap.Insert(6, std::string("six"));
+        EXPECT_EQ(0, rmap.Map().count(6));
+        EXPECT_EQ(200, rmap.Checkout(200));
+        ExpectEqual(refmap200, rmap.Map());
+    }
+    TEST_F(PersistentMapTest, Snapshot) {
+        Commit();
+        ExpectEqual(refmap0, rmap.Snapshot(0));
+        ExpectEqual(refmap100, rmap.Snapshot(150));
+        ExpectEqual(refmap200, rmap.Snapshot(200));
+        ExpectEqual(refmap200, rmap.Map());
+    }
+    TEST_F(PersistentMapTest, Rebase) {
+        Commit();
+        int64_t last = -1;
+        std::shared_ptr<int64_t> rebase;
+        auto history = rmap.Pull(200, last, rebase);
+
+        trillek::RewindableMap<unsigned int,std::string,int64_t,50,true> dest;
+        dest.Commit(0);
+        dest.Insert(1, "one from origin");
+        dest.Commit(100);
+        dest.Insert(7, "seven from origin");
+        dest.Commit(300);
+
+        EXPECT_EQ(300, dest.Push(history.first, history.second));
+        ExpectEqual(refmap100, dest.Snapshot(100));
+        ExpectEqual(refmap200, dest.Snapshot(200));
+        auto refmap300 = refmap200;
+        refmap300.emplace(7, "seven from origin");
+        ExpectEqual(refmap300, dest.Map());
+    }
+}
+
+#endif // PERSISTENT_MAP_TEST_HPP_INCLUDED
@@ -0,0 +1,209 @@
+#ifndef RELIABLE_CHANNEL_TEST_HPP_INCLUDED
+#define RELIABLE_CHANNEL_TEST_HPP_INCLUDED
+
+#include <queue>
+#include <random>
+#include "controllers/network/reliable-channel.hpp"
+#include "gtest/gtest.h"
+
+/** \brief A simulated link with latency, jitter, loss and a bottleneck
+ *
+ */
+class SimulatedLink {
+public:
+    SimulatedLink(uint64_t latency, uint64_t jitter, unsigned int loss, size_t bytes_per_ms, size_t queue_limit, unsigned int seed) :
+        latency(latency), jitter(jitter), loss(loss), bytes_per_ms(bytes_per_ms), queue_limit(queue_limit),
+        busy_until(0), dropped(0), rng(seed) {}
+
+    void Send(uint64_t now, const char* data, size_t size) {
+        // the bottleneck drops the datagrams when its queue is full
+        if (busy_until > now && (busy_until - now) * bytes_per_ms / 1000 > queue_limit) {
+            ++dropped;
+            return;
+        }
+        if (rng() % 100 < loss) {
+            return;
+        }
+        busy_until = std::max(busy_until, now) + size * 1000 / bytes_per_ms;
+        auto arrival = busy_until + latency + (jitter ? rng() % jitter : 0);
+        in_transit.push(Datagram{ arrival, std::string(data, size) });
+    }
+
+    template<class F>
+    void Deliver(uint64_t now, F f) {
+        while (! in_transit.empty() && in_transit.top().arrival <= now) {
+            f(in_transit.top().data);
+            in_transit.pop();
+        }
+    }
+
+    size_t Dropped() const {
+        return dropped;
+    }
+
+private:
+    struct Datagram {
+        uint64_t arrival;
+        std::string data;
+        bool operator<(const Datagram& other) const {
+            return arrival > other.arrival;
+        }
+    };
+
+    uint64_t latency, jitter;
+    unsigned int loss;
+    size_t bytes_per_ms, queue_limit;
+    uint64_t busy_until;
+    size_t dropped;
+    std::mt19937 rng;
+    std::priority_queue<Datagram> in_transit;
+};
+
+class ReliableChannelTest : public ::testing::Test {
+public:
+    /** \brief Send count messages from a to b, return the time it took in microseconds
+     *
+     */
+    uint64_t Transfer(SimulatedLink& ab, SimulatedLink& ba, size_t count, size_t size, uint64_t deadline) {
+        return Transfer(a, b, ab, ba, count, size, deadline);
+    }
+
+    uint64_t Transfer(trillek::network::ReliableChannel& a, trillek::network::ReliableChannel& b,
+                      SimulatedLink& ab, SimulatedLink& ba, size_t count, size_t size, uint64_t deadline) {
+        std::vector<std::string> ordered, unordered;
+        size_t sent = 0;
+        uint64_t now = 0;
+        max_in_flight = 0;
+        for (; now < deadline; now += 1000) {
+            // the application produces messages faster than the link can carry them
+            for (auto i = 0; i < 20 && sent < count; ++i, ++sent) {
+                std::string message(size, static_cast<char>('a' + sent % 26));
+                std::memcpy(&message[0], &sent, sizeof(sent));
+                a.Send(sent % 2 ? trillek::network::ReliableChannel::Mode::UNORDERED : trillek::network::ReliableChannel::Mode::ORDERED,
+                       message.data(), message.size());
+            }
+            a.Update(now, [&](const char* d, size_t s) { ab.Send(now, d, s); });
+            b.Update(now, [&](const char* d, size_t s) { ba.Send(now, d, s); });
+            max_in_flight = std::max(max_in_flight, a.InFlight());
+            ab.Deliver(now, [&](const std::string& d) { EXPECT_TRUE(b.Receive(now, d.data(), d.size())); });
+            ba.Deliver(now, [&](const std::string& d) { EXPECT_TRUE(a.Receive(now, d.data(), d.size())); });
+            trillek::network::ReliableChannel::Mode mode;
+            std::string data;
+            while (b.Pop(mode, data)) {
+                (mode == trillek::network::ReliableChannel::Mode::ORDERED ? ordered : unordered).push_back(data);
+            }
+            if (sent == count && a.Idle() && ordered.size() + unordered.size() == count) {
+                break;
+            }
+        }
+        // ordered messages are in order, all messages are received once
+        EXPECT_EQ((count + 1) / 2, ordered.size());
+        EXPECT_EQ(count / 2, unordered.size());
+        for (size_t i = 0; i < ordered.size(); ++i) {
+            size_t id;
+            std::memcpy(&id, ordered[i].data(), sizeof(id));
+            EXPECT_EQ(2 * i, id);
+        }
+        std::set<size_t> ids;
+        for (const auto& m : unordered) {
+            size_t id;
+            std::memcpy(&id, m.data(), sizeof(id));
+            EXPECT_EQ(1, id % 2);
+            EXPECT_TRUE(ids.insert(id).second);
+        }
+        return now;
+    }
+
+protected:
+    trillek::network::ReliableChannel a;
+    trillek::network::ReliableChannel b;
+    size_t max_in_flight;
+};
+
+namespace trillek {
+    TEST_F(ReliableChannelTest, Lossless) {
+        // the link is faster than the application
+        SimulatedLink ab(10000, 0, 0, 10000, 100000, 1), ba(10000, 0, 0, 10000, 100000, 2);
+        auto metrics = std::make_shared<network::ConnectionMetrics>();
+        a.SetMetrics(metrics.get());
+        auto time = Transfer(ab, ba, 2000, 200, 60000000);
+        EXPECT_EQ(0, ab.Dropped());
+        EXPECT_EQ(0, a.Retransmissions());
+        // the latency, plus up to a tick in each direction
+        EXPECT_LE(20000, a.Rtt());
+        EXPECT_GT(30000, a.Rtt());
+        auto snapshot = metrics->Snapshot();
+        EXPECT_LT(0, snapshot.rtt.Count());
+        EXPECT_LE(20000, snapshot.rtt.Percentile(0.5));
+        EXPECT_EQ(0, snapshot.retransmissions);
+        // close to the 100 ms taken by the application to produce the messages
+        EXPECT_GT(250000, time);
+    }
+    TEST_F(ReliableChannelTest, LossAndReordering) {
+        SimulatedLink ab(20000, 15000, 10, 1000, 100000, 3), ba(20000, 15000, 10, 1000, 100000, 4);
+        auto metrics = std::make_shared<network::ConnectionMetrics>();
+        a.SetMetrics(metrics.get());
+        auto time = Transfer(ab, ba, 2000, 200, 120000000);
+        EXPECT_LT(0, a.Retransmissions());
+        EXPECT_EQ(a.Retransmissions(), metrics->Snapshot().retransmissions);
+        EXPECT_TRUE(a.Idle());
+        EXPECT_GT(30000000, time);
+    }
+    TEST_F(ReliableChannelTest, Congestion) {
+        // 500 KB/s with a small buffer at the bottleneck
+        SimulatedLink ab(5000, 0, 0, 500, 8000, 5), ba(5000, 0, 0, 500, 8000, 6);
+        auto time = Transfer(ab, ba, 5000, 1000, 120000000);
+        EXPECT_TRUE(a.Idle());
+        // the window adapts to the bottleneck instead of flooding it
+        EXPECT_LT(max_in_flight, 64 * 1200);
+        auto throughput = 5000 * 1000 * 1000.0 / time;
+        EXPECT_LT(250, throughput);
+    }
+    TEST_F(ReliableChannelTest, Wraparound) {
+        // the sequence numbers and the ids wrap around during the transfer
+        network::ReliableChannel c(1200, 0xFFFFFF00), d(1200, 0xFFFFFF00);
+        SimulatedLink ab(20000, 15000, 10, 1000, 100000, 7), ba(20000, 15000, 10, 1000, 100000, 8);
+        auto time = Transfer(c, d, ab, ba, 2000, 200, 120000000);
+        EXPECT_TRUE(c.Idle());
+        EXPECT_LT(0, c.Retransmissions());
+        EXPECT_LT(256, c.SentDatagrams());
+        EXPECT_GT(30000000, time);
+    }
+    TEST_F(ReliableChannelTest, Timeout) {
+        std::string message(1000, 'x');
+        for (auto i = 0; i < 100; ++i) {
+            a.Send(network::ReliableChannel::Mode::ORDERED, message.data(), message.size());
+        }
+        size_t sent = 0;
+        for (uint64_t now = 0; now < 100000; now += 1000) {
+            a.Update(now, [&sent](const char*, size_t) { ++sent; });
+        }
+        EXPECT_LT(0, sent);
+        // nothing is acknowledged: after the timeout, the window is a single datagram
+        a.Update(1000000, [](const char*, size_t) {});
+        EXPECT_EQ(1200, a.Window());
+        EXPECT_LT(0, a.LostDatagrams());
+    }
+    TEST_F(ReliableChannelTest, Malformed) {
+        EXPECT_FALSE(a.Receive(0, "abc", 3));
+        std::string big(a.MaxMessageSize() + 1, 'x');
+        EXPECT_FALSE(a.Send(network::ReliableChannel::Mode::ORDERED, big.data(), big.size()));
+        // a message beyond the window of the receiver, on each channel
+        for (uint8_t mode = 0; mode < 2; ++mode) {
+            network::ReliableChannel c;
+            std::string datagram(13, 0);
+            datagram[0] = static_cast<char>(mode + 1);
+            datagram += static_cast<char>(mode);
+            uint32_t id = network::ReliableChannel::MESSAGE_WINDOW;
+            datagram.append(reinterpret_cast<const char*>(&id), sizeof(id));
+            datagram.append(2, 0);
+            EXPECT_FALSE(c.Receive(0, datagram.data(), datagram.size()));
+            id = network::ReliableChannel::MESSAGE_WINDOW - 1;
+            datagram[0] = static_cast<char>(mode + 3);
+            std::memcpy(&datagram[14], &id, sizeof(id));
+            EXPECT_TRUE(c.Receive(0, datagram.data(), datagram.size()));
+        }
+    }
+}
+
+#endif // RELIABLE_CHANNEL_TEST_HPP_INCLUDED
@@ -144,6 +144,34 @@ namespace trillek {
             ASSERT_TRUE(rmap.Map().at(entry.first) == entry.second);
         }
     }
+    TEST_F(RewindableMapTest, UpdateTwice) {
+        rmap.Commit(0);
+        rmap.Update(1,std::string("two"));
+        rmap.Update(1,std::string("three"));
+        rmap.Insert(6,std::string("six"));
+        rmap.Remove(6);
+        rmap.Update(2,std::string("deux"));
+        rmap.Remove(2);
+        rmap.Commit(100);
+        EXPECT_EQ(std::string("one"), rmap.GetLastNegativeCommit().at(1));
+        EXPECT_EQ(std::string("three"), rmap.GetLastPositiveCommit().at(1));
+        EXPECT_EQ(0, rmap.GetLastNegativeCommit().count(6));
+        EXPECT_EQ(0, rmap.GetLastPositiveCommit().count(6));
+        EXPECT_FALSE(rmap.GetLastPositiveBitMap().at(6));
+        // the update cancelled by the removal leaves only the removal
+        EXPECT_EQ(std::string("two"), rmap.GetLastNegativeCommit().at(2));
+        EXPECT_EQ(0, rmap.GetLastPositiveCommit().count(2));
+        EXPECT_TRUE(rmap.GetLastNegativeBitMap().at(2));
+        EXPECT_FALSE(rmap.GetLastPositiveBitMap().at(2));
+        EXPECT_TRUE(rmap.GetLastPositiveBitMap().at(1));
+        EXPECT_EQ(0, rmap.Map().count(2));
+        rmap.Checkout(0);
+        EXPECT_EQ(std::string("one"), rmap.Map().at(1));
+        EXPECT_EQ(std::string("two"), rmap.Map().at(2));
+        rmap.Checkout(100);
+        EXPECT_EQ(std::string("three"), rmap.Map().at(1));
+        EXPECT_EQ(0, rmap.Map().count(2));
+    }
     TEST_F(RewindableMapTest, AddWhileRewind) {
         Commit();
         auto tp = rmap.Checkout(0);
@@ -0,0 +1,92 @@
+#ifndef SEND_QUEUE_TEST_HPP_INCLUDED
+#define SEND_QUEUE_TEST_HPP_INCLUDED
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include "controllers/network/send-queue.hpp"
+#include "gtest/gtest.h"
+
+class SendQueueTest : public ::testing::Test {
+public:
+    SendQueueTest() {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    }
+
+    ~SendQueueTest() {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    std::string ReadAll() {
+        std::string ret;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(fds[1], buffer, sizeof(buffer))) > 0) {
+            ret.append(buffer, n);
+        }
+        return ret;
+    }
+
+protected:
+    int fds[2];
+    trillek::network::SendQueue queue;
+};
+
+namespace trillek {
+    TEST_F(SendQueueTest, Gather) {
+        auto a = std::make_shared<std::string>("first payload");
+        auto b = std::make_shared<std::string>("second");
+        const uint8_t tag[] = { 't', 'a', 'g' };
+        auto metrics = std::make_shared<network::ConnectionMetrics>();
+        queue.SetMetrics(metrics.get());
+        queue.Push(a, a->data(), a->size(), tag, 3);
+        queue.Push(b, b->data(), b->size(), tag, 2);
+        EXPECT_EQ(2, queue.Frames());
+        EXPECT_EQ(a->size() + b->size() + 5, queue.Bytes());
+        EXPECT_EQ(static_cast<int>(a->size() + b->size() + 5), queue.Flush(fds[0]));
+        EXPECT_TRUE(queue.Empty());
+        EXPECT_EQ("first payloadtagsecondta", ReadAll());
+        EXPECT_EQ(2, metrics->Snapshot().packets_sent);
+        EXPECT_EQ(a->size() + b->size() + 5, metrics->Snapshot().bytes_sent);
+    }
+    TEST_F(SendQueueTest, Partial) {
+        int size = 4096;
+        setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        std::string expected;
+        for (auto i = 0; i < 200; ++i) {
+            auto payload = std::make_shared<std::string>(1000, static_cast<char>('a' + i % 26));
+            const uint8_t tag[] = { static_cast<uint8_t>(i) };
+            queue.Push(payload, payload->data(), payload->size(), tag, 1);
+            expected += *payload;
+            expected += static_cast<char>(i);
+        }
+        std::string received;
+        while (! queue.Empty()) {
+            ASSERT_LE(0, queue.Flush(fds[0]));
+            received += ReadAll();
+        }
+        received += ReadAll();
+        EXPECT_EQ(expected, received);
+        EXPECT_EQ(0, queue.Bytes());
+    }
+    TEST_F(SendQueueTest, RecycledBuffer) {
+        const void* first;
+        {
+            // a compressed bundle leaves its flags in the buffer
+            auto buffer = network::Message::NewBuffer(256);
+            first = buffer.data();
+            auto header = reinterpret_cast<network::Frame*>(buffer.data());
+            header->mheader.flags = MSG_FLAG_BUNDLE | MSG_FLAG_COMPRESSED;
+        }
+        auto buffer = network::Message::NewBuffer(256);
+        ASSERT_EQ(first, buffer.data());
+        auto header = reinterpret_cast<const network::Frame*>(buffer.data());
+        EXPECT_EQ(0, header->mheader.flags);
+        EXPECT_EQ(0, header->fheader.length);
+    }
+}
+
+#endif // SEND_QUEUE_TEST_HPP_INCLUDED
@@ -0,0 +1,205 @@
+#ifndef SNAPSHOT_REPLICATOR_TEST_HPP_INCLUDED
+#define SNAPSHOT_REPLICATOR_TEST_HPP_INCLUDED
+
+#include <random>
+#include "systems/rewindable-map.hpp"
+#include "systems/snapshot-replicator.hpp"
+#include "gtest/gtest.h"
+
+struct ReplicatedValue {
+    float position[3];
+    float orientation[4];
+    uint32_t flags;
+};
+
+/** \brief Loopback harness: a server map replicated to clients through a lossy channel
+ *
+ */
+class SnapshotReplicatorTest : public ::testing::Test {
+public:
+    SnapshotReplicatorTest() : replicator(history), rng(7), full_bytes(0), delta_bytes(0) {}
+
+    static ReplicatedValue Value(unsigned int id) {
+        return ReplicatedValue{{static_cast<float>(id), 10.0f, -3.5f}, {0.0f, 0.0f, 0.0f, 1.0f}, id};
+    }
+
+    void Commit(int64_t frame) {
+        rmap.Commit(frame);
+        history.Record(frame, rmap.GetLastNegativeCommit(), rmap.GetLastPositiveCommit(),
+            [](const ReplicatedValue& v) -> const ReplicatedValue& { return v; });
+        states[frame] = std::map<unsigned int,ReplicatedValue>(rmap.Map().cbegin(), rmap.Map().cend());
+    }
+
+    // move a few entities, with small steps
+    void Step(int64_t frame) {
+        for (unsigned int i = 0; i < 20; ++i) {
+            auto id = static_cast<unsigned int>(rng() % 1000);
+            if (rmap.Map().count(id)) {
+                auto v = rmap.Map().at(id);
+                v.position[0] += 0.125f;
+                v.position[2] -= 0.0625f;
+                rmap.Update(id, v);
+            }
+        }
+        if (frame % 4 == 0 && rmap.Map().count(static_cast<unsigned int>(frame % 1000))) {
+            rmap.Remove(static_cast<unsigned int>(frame % 1000));
+            rmap.Insert(static_cast<unsigned int>(1000 + frame), Value(static_cast<unsigned int>(frame)));
+        }
+        Commit(frame);
+    }
+
+    /** \brief Send the frame to the clients, losing some packets and acknowledgments
+     *
+     */
+    void Replicate(int64_t frame, std::vector<trillek::SnapshotReplica<unsigned int,ReplicatedValue>>& clients, unsigned int loss) {
+        for (trillek::id_t c = 0; c < clients.size(); ++c) {
+            trillek::util::BitWriter out;
+            replicator.Encode(c, frame, rmap.Map(), [](const ReplicatedValue& v) -> const ReplicatedValue& { return v; }, out);
+            const auto& bytes = out.Bytes();
+            delta_bytes += bytes.size();
+            full_bytes += rmap.Map().size() * (sizeof(unsigned int) + sizeof(ReplicatedValue));
+            if (rng() % 100 < loss) {
+                continue;
+            }
+            trillek::frame_tp received;
+            ASSERT_TRUE(clients[c].Apply(bytes.data(), bytes.size(), received));
+            ASSERT_EQ(frame, received);
+            ASSERT_EQ(states[frame].size(), clients[c].State().size());
+            for (const auto& entry : states[frame]) {
+                ASSERT_EQ(0, std::memcmp(&entry.second, &clients[c].State().at(entry.first), sizeof(ReplicatedValue)));
+            }
+            if (rng() % 100 >= loss) {
+                replicator.Acknowledge(c, received);
+            }
+        }
+    }
+
+protected:
+    trillek::RewindableMap<unsigned int,ReplicatedValue,int64_t,50> rmap;
+    trillek::DeltaHistory<unsigned int,ReplicatedValue> history;
+    trillek::SnapshotReplicator<unsigned int,ReplicatedValue> replicator;
+    std::map<int64_t,std::map<unsigned int,ReplicatedValue>> states;
+    std::mt19937 rng;
+    size_t full_bytes;
+    size_t delta_bytes;
+};
+
+namespace trillek {
+    TEST(SnapshotDeltaTest, BitStream) {
+        util::BitWriter out;
+        out.Write(5, 3);
+        out.WriteGamma(0);
+        out.WriteGamma(1000000);
+        out.Write64(0x123456789ABCDEF0ULL);
+        out.Write(0xFFFFFFFF, 32);
+        const auto& bytes = out.Bytes();
+        util::BitReader in(bytes.data(), bytes.size());
+        EXPECT_EQ(5, in.Read(3));
+        EXPECT_EQ(0, in.ReadGamma());
+        EXPECT_EQ(1000000, in.ReadGamma());
+        EXPECT_EQ(0x123456789ABCDEF0ULL, in.Read64());
+        EXPECT_EQ(0xFFFFFFFF, in.Read(32));
+        EXPECT_FALSE(in.Error());
+        in.Read(16);
+        EXPECT_TRUE(in.Error());
+    }
+    TEST(SnapshotDeltaTest, Encode) {
+        std::map<unsigned int,ReplicatedValue> base, current;
+        for (unsigned int i = 0; i < 10; ++i) {
+            base[i] = SnapshotReplicatorTest::Value(i);
+        }
+        current = base;
+        current.erase(3);
+        current[4].position[1] = 11.0f;
+        current[100] = SnapshotReplicatorTest::Value(100);
+        util::BitWriter out;
+        SnapshotDelta<unsigned int,ReplicatedValue>::Encode(&base, 5, current, 6, out);
+        const auto& bytes = out.Bytes();
+        util::BitReader in(bytes.data(), bytes.size());
+        frame_tp frame, baseline_frame;
+        bool has_baseline;
+        ASSERT_TRUE((SnapshotDelta<unsigned int,ReplicatedValue>::DecodeHeader(in, frame, has_baseline, baseline_frame)));
+        EXPECT_EQ(6, frame);
+        EXPECT_TRUE(has_baseline);
+        EXPECT_EQ(5, baseline_frame);
+        auto state = base;
+        ASSERT_TRUE((SnapshotDelta<unsigned int,ReplicatedValue>::DecodeEntries(in, state)));
+        ASSERT_EQ(current.size(), state.size());
+        for (const auto& entry : current) {
+            EXPECT_EQ(0, std::memcmp(&entry.second, &state.at(entry.first), sizeof(ReplicatedValue)));
+        }
+        // a delta applied on the wrong baseline is rejected
+        util::BitReader again(bytes.data(), bytes.size());
+        SnapshotDelta<unsigned int,ReplicatedValue>::DecodeHeader(again, frame, has_baseline, baseline_frame);
+        state.clear();
+        EXPECT_FALSE((SnapshotDelta<unsigned int,ReplicatedValue>::DecodeEntries(again, state)));
+    }
+    TEST_F(SnapshotReplicatorTest, Loopback) {
+        for (unsigned int i = 0; i < 1000; ++i) {
+            rmap.Insert(i, Value(i));
+        }
+        Commit(0);
+        std::vector<SnapshotReplica<unsigned int,ReplicatedValue>> clients(4);
+        Replicate(0, clients, 0);
+        for (int64_t f = 1; f <= 200; ++f) {
+            Step(f);
+            Replicate(f, clients, 10);
+        }
+        EXPECT_LT(delta_bytes * 50, full_bytes);
+    }
+    TEST_F(SnapshotReplicatorTest, OldBaseline) {
+        history.SetBudget(1024);
+        for (unsigned int i = 0; i < 100; ++i) {
+            rmap.Insert(i, Value(i));
+        }
+        Commit(0);
+        std::vector<SnapshotReplica<unsigned int,ReplicatedValue>> clients(1);
+        Replicate(0, clients, 0);
+        // the client does not acknowledge anything for a long time
+        util::BitWriter out;
+        for (int64_t f = 1; f < 100; ++f) {
+            Step(f);
+            out.Clear();
+            replicator.Encode(0, f, rmap.Map(), [](const ReplicatedValue& v) -> const ReplicatedValue& { return v; }, out);
+        }
+        Step(100);
+        EXPECT_LT(0, history.OldestFrame());
+        // the baseline is out of the history: a full state is sent
+        Replicate(100, clients, 0);
+        EXPECT_EQ(100, clients[0].Frame());
+    }
+    TEST_F(SnapshotReplicatorTest, Resync) {
+        for (unsigned int i = 0; i < 100; ++i) {
+            rmap.Insert(i, Value(i));
+        }
+        Commit(0);
+        // a client keeping fewer states than the frames the server keeps unacknowledged
+        std::vector<SnapshotReplica<unsigned int,ReplicatedValue>> clients;
+        clients.emplace_back(2);
+        Replicate(0, clients, 0);
+        util::BitWriter out;
+        frame_tp received;
+        for (int64_t f = 1; f < 3; ++f) {
+            Step(f);
+            out.Clear();
+            replicator.Encode(0, f, rmap.Map(), [](const ReplicatedValue& v) -> const ReplicatedValue& { return v; }, out);
+            ASSERT_TRUE(clients[0].Apply(out.Bytes().data(), out.Bytes().size(), received));
+        }
+        // the acknowledgments were lost and the baseline was forgotten by the client
+        Step(3);
+        out.Clear();
+        replicator.Encode(0, 3, rmap.Map(), [](const ReplicatedValue& v) -> const ReplicatedValue& { return v; }, out);
+        EXPECT_FALSE(clients[0].Apply(out.Bytes().data(), out.Bytes().size(), received));
+        EXPECT_EQ(2, clients[0].Frame());
+        replicator.Resync(0);
+        Step(4);
+        Replicate(4, clients, 0);
+        EXPECT_EQ(4, clients[0].Frame());
+        // the deltas resume from the full state
+        Step(5);
+        Replicate(5, clients, 0);
+        EXPECT_EQ(5, clients[0].Frame());
+    }
+}
+
+#endif // SNAPSHOT_REPLICATOR_TEST_HPP_INCLUDED
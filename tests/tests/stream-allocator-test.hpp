@@ -1,6 +1,7 @@
 #ifndef FIFO_CONTIGUOUS_DATA_ALLOCATOR_TEST_HPP_INCLUDED
 #define FIFO_CONTIGUOUS_DATA_ALLOCATOR_TEST_HPP_INCLUDED
 
+#include <deque>
 #include "memory/stream-allocator.hpp"
 #include "memory/trillek-allocator.hpp"
 
@@ -135,6 +136,65 @@ TEST_F(StreamAllocatorTest, CopyConstructor) {
     }
 }
 
+TEST_F(StreamAllocatorTest, RingWrapAround) {
+    memory::StreamAllocator<256,true> ring;
+    // 3 blocks of 64 + 8 bytes of header
+    auto a = ring.allocate(64);
+    auto b = ring.allocate(64);
+    auto c = ring.allocate(64);
+    EXPECT_THROW(ring.allocate(64), std::bad_alloc) << "the ring should be full";
+    ring.deallocate(a, 64);
+    // the space released by a is not enough for a block, b must be released too
+    EXPECT_THROW(ring.allocate(64), std::bad_alloc) << "the ring should be full";
+    ring.deallocate(b, 64);
+    auto d = ring.allocate(64);
+    EXPECT_EQ(a, d);
+    EXPECT_EQ(1, ring.WrapCount());
+    EXPECT_EQ(216, ring.HighWater());
+    ring.deallocate(c, 64);
+    ring.deallocate(d, 64);
+    EXPECT_EQ(a, ring.allocate(64));
+}
+
+TEST_F(StreamAllocatorTest, RingOutOfOrder) {
+    memory::StreamAllocator<256,true> ring;
+    auto a = ring.allocate(100);
+    auto b = ring.allocate(100);
+    ring.deallocate(b, 100);
+    EXPECT_THROW(ring.allocate(100), std::bad_alloc) << "b must not be reclaimed before a";
+    ring.deallocate(a, 100);
+    EXPECT_EQ(a, ring.allocate(100));
+}
+
+TEST_F(StreamAllocatorTest, RingStream) {
+    memory::StreamAllocator<256,true> ring;
+    // blocks filled with their index
+    std::deque<std::pair<char*,size_t>> live;
+    for (size_t i = 0; i < 1000; ++i) {
+        auto n = 1 + static_cast<size_t>(random() % 60);
+        while (true) {
+            try {
+                auto p = static_cast<char*>(ring.allocate(n));
+                std::memset(p, static_cast<char>(i), n);
+                live.emplace_back(p, n);
+                break;
+            }
+            catch (const std::bad_alloc&) {
+                ASSERT_FALSE(live.empty());
+                auto& oldest = live.front();
+                auto index = static_cast<char>(i - live.size());
+                for (size_t j = 0; j < oldest.second; ++j) {
+                    ASSERT_EQ(index, oldest.first[j]) << "a block has been overwritten";
+                }
+                ring.deallocate(oldest.first, oldest.second);
+                live.pop_front();
+            }
+        }
+    }
+    EXPECT_LT(0, ring.WrapCount());
+    EXPECT_GE(256, ring.HighWater());
+}
+
 }
 
 #endif // FIFO_CONTIGUOUS_DATA_ALLOCATOR_TEST_HPP_INCLUDED
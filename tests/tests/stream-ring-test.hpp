@@ -0,0 +1,109 @@
+#ifndef STREAM_RING_TEST_HPP_INCLUDED
+#define STREAM_RING_TEST_HPP_INCLUDED
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include "controllers/network/stream-ring.hpp"
+#include "gtest/gtest.h"
+
+class StreamRingTest : public ::testing::Test {
+public:
+    StreamRingTest() {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    }
+
+    ~StreamRingTest() {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    // build a frame with a body of size bytes filled with c
+    static std::string MakeFrame(size_t size, char c) {
+        std::string frame(sizeof(trillek::network::Frame) + size, c);
+        trillek::network::Frame_hdr length;
+        length.length = static_cast<uint32_t>(sizeof(trillek::network::msg_hdr) + size);
+        std::memcpy(&frame[0], &length, sizeof(length));
+        trillek::network::msg_hdr header{};
+        header.type_major = 1;
+        header.type_minor = static_cast<uint8_t>(c);
+        std::memcpy(&frame[sizeof(length)], &header, sizeof(header));
+        return frame;
+    }
+
+    void Write(const std::string& data) {
+        ASSERT_EQ(static_cast<ssize_t>(data.size()), write(fds[0], data.data(), data.size()));
+    }
+
+protected:
+    int fds[2];
+};
+
+namespace trillek {
+    TEST_F(StreamRingTest, Partial) {
+        network::StreamRing ring(4096);
+        auto metrics = std::make_shared<network::ConnectionMetrics>();
+        ring.SetMetrics(metrics.get());
+        network::FrameView view;
+        auto frame = MakeFrame(100, 'x');
+        Write(frame.substr(0, 3));
+        EXPECT_EQ(3, ring.Receive(fds[1]));
+        EXPECT_EQ(network::FrameStatus::INCOMPLETE, ring.NextFrame(view));
+        Write(frame.substr(3, 50));
+        ring.Receive(fds[1]);
+        EXPECT_EQ(network::FrameStatus::INCOMPLETE, ring.NextFrame(view));
+        Write(frame.substr(53) + MakeFrame(10, 'y'));
+        ring.Receive(fds[1]);
+        ASSERT_EQ(network::FrameStatus::COMPLETE, ring.NextFrame(view));
+        EXPECT_EQ(frame.size(), view.size);
+        EXPECT_EQ('x', view.Header()->type_minor);
+        EXPECT_EQ(std::string(98, 'x'), std::string(view.Body(), view.BodySize(2)));
+        network::FrameView second;
+        ASSERT_EQ(network::FrameStatus::COMPLETE, ring.NextFrame(second));
+        EXPECT_EQ('y', second.Header()->type_minor);
+        EXPECT_EQ(network::FrameStatus::INCOMPLETE, ring.NextFrame(view));
+        ring.Release(view);
+        ring.Release(second);
+        EXPECT_EQ(0, ring.Used());
+        auto snapshot = metrics->Snapshot();
+        EXPECT_EQ(2, snapshot.packets_received);
+        EXPECT_EQ(frame.size() + MakeFrame(10, 'y').size(), snapshot.bytes_received);
+        EXPECT_EQ(2, snapshot.reassembly_time.Count());
+        errno = 0;
+        EXPECT_EQ(-1, ring.Receive(fds[1]));
+        EXPECT_EQ(EAGAIN, errno);
+    }
+    TEST_F(StreamRingTest, WrapAround) {
+        network::StreamRing ring(4096);
+        std::string pending;
+        // frames of a size that does not divide the ring, always keeping a partial frame in it
+        for (auto i = 0; i < 500; ++i) {
+            auto frame = MakeFrame(300 + i % 7, static_cast<char>('a' + i % 26));
+            Write(frame.substr(0, frame.size() / 2));
+            ASSERT_LT(0, ring.Receive(fds[1]));
+            if (i) {
+                network::FrameView view;
+                ASSERT_EQ(network::FrameStatus::COMPLETE, ring.NextFrame(view));
+                ASSERT_EQ(pending, std::string(view.data, view.size));
+                ring.Release(view);
+            }
+            Write(frame.substr(frame.size() / 2));
+            ASSERT_LT(0, ring.Receive(fds[1]));
+            pending = frame;
+        }
+        network::FrameView view;
+        ASSERT_EQ(network::FrameStatus::COMPLETE, ring.NextFrame(view));
+        EXPECT_EQ(pending, std::string(view.data, view.size));
+    }
+    TEST_F(StreamRingTest, TooBig) {
+        network::StreamRing ring(4096);
+        Write(MakeFrame(ring.Capacity(), 'z').substr(0, 64));
+        ring.Receive(fds[1]);
+        network::FrameView view;
+        EXPECT_EQ(network::FrameStatus::TOO_BIG, ring.NextFrame(view));
+    }
+}
+
+#endif // STREAM_RING_TEST_HPP_INCLUDED
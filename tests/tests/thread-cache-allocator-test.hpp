@@ -0,0 +1,106 @@
+#ifndef THREAD_CACHE_ALLOCATOR_TEST_HPP_INCLUDED
+#define THREAD_CACHE_ALLOCATOR_TEST_HPP_INCLUDED
+
+#include <set>
+#include <thread>
+#include <vector>
+#include "memory/thread-cache-allocator.hpp"
+#include "memory/trillek-allocator.hpp"
+#include "gtest/gtest.h"
+
+class ThreadCacheAllocatorTest : public ::testing::Test {
+public:
+    template<class T> using CachedAllocator = trillek::TrillekAllocator<T,trillek::memory::ThreadCacheAllocator>;
+
+    ThreadCacheAllocatorTest() : alloc(trillek::memory::ThreadCacheAllocator::Instance()) {}
+protected:
+    trillek::memory::ThreadCacheAllocator& alloc;
+};
+
+namespace trillek {
+    TEST_F(ThreadCacheAllocatorTest, Reuse) {
+        auto a = alloc.allocate(24);
+        EXPECT_EQ(0, reinterpret_cast<size_t>(a) % 16);
+        alloc.deallocate(a, 24);
+        // same size class
+        EXPECT_EQ(a, alloc.allocate(32));
+        alloc.deallocate(a, 32);
+    }
+    TEST_F(ThreadCacheAllocatorTest, Large) {
+        auto a = alloc.allocate(100000);
+        alloc.deallocate(a, 100000);
+    }
+    TEST_F(ThreadCacheAllocatorTest, ReturnToOwner) {
+        void* first = nullptr;
+        void* second = nullptr;
+        std::thread owner([&]() {
+            // the depot may hold blocks of other threads: take them until a slab of this thread is carved
+            std::vector<void*> taken;
+            auto slabs = alloc.Slabs();
+            while (alloc.Slabs() == slabs) {
+                taken.push_back(alloc.allocate(3000));
+            }
+            first = taken.back();
+            taken.pop_back();
+            std::thread other([&]() { alloc.deallocate(first, 3000); });
+            other.join();
+            second = alloc.allocate(3000);
+            alloc.deallocate(second, 3000);
+            for (auto p : taken) {
+                alloc.deallocate(p, 3000);
+            }
+        });
+        owner.join();
+        EXPECT_EQ(first, second);
+    }
+    TEST_F(ThreadCacheAllocatorTest, Container) {
+        CachedAllocator<int> cached(&alloc);
+        std::vector<int,CachedAllocator<int>> v(cached);
+        for (auto i = 0; i < 1000; ++i) {
+            v.push_back(i);
+        }
+        EXPECT_EQ(999, v.back());
+    }
+    TEST_F(ThreadCacheAllocatorTest, ManyThreads) {
+        const size_t count = 5000;
+        std::vector<std::vector<int*>> produced(4);
+        std::vector<std::thread> threads;
+        auto transfers = alloc.DepotTransfers();
+        for (size_t t = 0; t < produced.size(); ++t) {
+            threads.emplace_back([&, t]() {
+                for (size_t i = 0; i < count; ++i) {
+                    auto p = static_cast<int*>(alloc.allocate(sizeof(int) * (1 + i % 8)));
+                    *p = static_cast<int>(t * count + i);
+                    produced[t].push_back(p);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        std::set<int*> unique;
+        for (size_t t = 0; t < produced.size(); ++t) {
+            for (size_t i = 0; i < count; ++i) {
+                EXPECT_EQ(static_cast<int>(t * count + i), *produced[t][i]);
+                unique.insert(produced[t][i]);
+            }
+        }
+        EXPECT_EQ(produced.size() * count, unique.size());
+        threads.clear();
+        // each thread frees the blocks of another thread
+        for (size_t t = 0; t < produced.size(); ++t) {
+            threads.emplace_back([&, t]() {
+                auto& blocks = produced[(t + 1) % produced.size()];
+                for (size_t i = 0; i < count; ++i) {
+                    alloc.deallocate(blocks[i], sizeof(int) * (1 + i % 8));
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        EXPECT_LT(transfers, alloc.DepotTransfers());
+    }
+}
+
+#endif // THREAD_CACHE_ALLOCATOR_TEST_HPP_INCLUDED
@@ -0,0 +1,163 @@
+#ifndef WIRE_FORMAT_TEST_HPP_INCLUDED
+#define WIRE_FORMAT_TEST_HPP_INCLUDED
+
+#include <limits>
+#include <string>
+#include <vector>
+#include "util/wire-format.hpp"
+#include "gtest/gtest.h"
+
+namespace wire_test {
+
+using namespace trillek::util;
+
+enum class Kind : uint8_t { NONE, MESH, TEXTURE };
+
+struct Position {
+    float x, y, z;
+    TRILLEK_WIRE_FIELDS(x, y, z)
+};
+
+struct Spawn {
+    uint32_t entity;
+    Kind kind;
+    bool visible;
+    wire::Varint<int32_t> delta;
+    wire::Varint<uint64_t> frame;
+    Position position;
+    wire::Bytes name;
+    wire::ArrayView<uint16_t> children;
+    double scale;
+    TRILLEK_WIRE_FIELDS(entity, kind, visible, delta, frame, position, name, children, scale)
+};
+
+// the first version of a message, and the next one with a field added
+struct LoginV1 {
+    uint16_t version;
+    wire::Bytes name;
+    TRILLEK_WIRE_FIELDS(version, name)
+};
+
+struct LoginV2 {
+    uint16_t version;
+    wire::Bytes name;
+    wire::Varint<uint32_t> flags;
+    TRILLEK_WIRE_FIELDS(version, name, flags)
+};
+
+template<class T>
+std::vector<char> EncodeToVector(const T& message) {
+    std::vector<char> ret(wire::EncodedSize(message));
+    EXPECT_EQ(ret.size(), wire::Encode(message, ret.data()));
+    return ret;
+}
+
+} // wire_test
+
+namespace trillek {
+    TEST(WireFormatTest, RoundTrip) {
+        using namespace wire_test;
+        std::string name = "tree_042";
+        std::vector<uint16_t> children = { 1, 2, 65535 };
+        Spawn spawn;
+        spawn.entity = 0x01020304;
+        spawn.kind = Kind::TEXTURE;
+        spawn.visible = true;
+        spawn.delta = -300;
+        spawn.frame = std::numeric_limits<uint64_t>::max();
+        spawn.position = Position{ 1.5f, -2.0f, 1e10f };
+        spawn.name = name;
+        spawn.children = util::wire::ArrayView<uint16_t>(children.data(), children.size());
+        spawn.scale = 0.125;
+        EXPECT_EQ(9, Spawn::WireFieldCount());
+        auto buffer = EncodeToVector(spawn);
+
+        Spawn back{};
+        ASSERT_TRUE(util::wire::Decode(back, buffer.data(), buffer.size()));
+        EXPECT_EQ(spawn.entity, back.entity);
+        EXPECT_EQ(Kind::TEXTURE, back.kind);
+        EXPECT_TRUE(back.visible);
+        EXPECT_EQ(-300, back.delta);
+        EXPECT_EQ(std::numeric_limits<uint64_t>::max(), back.frame);
+        EXPECT_EQ(1.5f, back.position.x);
+        EXPECT_EQ(-2.0f, back.position.y);
+        EXPECT_EQ(1e10f, back.position.z);
+        EXPECT_EQ(name, back.name.ToString());
+        ASSERT_EQ(3, back.children.size());
+        EXPECT_EQ(1, back.children[0]);
+        EXPECT_EQ(65535, back.children[2]);
+        EXPECT_EQ(0.125, back.scale);
+        // the views point in the buffer
+        EXPECT_GE(back.name.data, buffer.data());
+        EXPECT_LT(back.name.data, buffer.data() + buffer.size());
+        // encoding the decoded message gives the same bytes
+        EXPECT_EQ(buffer, EncodeToVector(back));
+    }
+    TEST(WireFormatTest, LittleEndian) {
+        using namespace wire_test;
+        LoginV2 login;
+        login.version = 0x0102;
+        login.name = util::wire::Bytes("ab", 2);
+        login.flags = 300;
+        auto buffer = EncodeToVector(login);
+        // size of the rest, field count, version, name, flags on 2 bytes
+        std::vector<char> expected = { 8, 3, 0x02, 0x01, 2, 'a', 'b', static_cast<char>(0xAC), 0x02 };
+        EXPECT_EQ(expected, buffer);
+        util::wire::Varint<int64_t> v(-1);
+        util::wire::Sizer sizer;
+        sizer.Add(v);
+        EXPECT_EQ(1, sizer.size);
+    }
+    TEST(WireFormatTest, Evolution) {
+        using namespace wire_test;
+        LoginV2 v2;
+        v2.version = 2;
+        v2.name = util::wire::Bytes("new", 3);
+        v2.flags = 7;
+        auto buffer = EncodeToVector(v2);
+        // an old decoder skips the new field
+        LoginV1 old{};
+        ASSERT_TRUE(util::wire::Decode(old, buffer.data(), buffer.size()));
+        EXPECT_EQ(2, old.version);
+        EXPECT_EQ("new", old.name.ToString());
+
+        LoginV1 v1;
+        v1.version = 1;
+        v1.name = util::wire::Bytes("old", 3);
+        buffer = EncodeToVector(v1);
+        // a new decoder keeps the default of the field not sent
+        LoginV2 current;
+        current.flags = 42;
+        ASSERT_TRUE(util::wire::Decode(current, buffer.data(), buffer.size()));
+        EXPECT_EQ(1, current.version);
+        EXPECT_EQ("old", current.name.ToString());
+        EXPECT_EQ(42, current.flags);
+    }
+    TEST(WireFormatTest, Malformed) {
+        using namespace wire_test;
+        std::string name(200, 'n');
+        Spawn spawn{};
+        spawn.name = name;
+        auto buffer = EncodeToVector(spawn);
+        // every truncation is detected
+        for (size_t size = 0; size < buffer.size(); ++size) {
+            Spawn back;
+            EXPECT_FALSE(util::wire::Decode(back, buffer.data(), size)) << size;
+        }
+        // a length bigger than the buffer
+        std::vector<char> lying = { 5, 2, 0x01, 0x00, 100, 'x' };
+        LoginV1 login;
+        EXPECT_FALSE(util::wire::Decode(login, lying.data(), lying.size()));
+        // a varint too long, or too big for its type
+        std::vector<char> overflow(12, static_cast<char>(0xFF));
+        overflow[0] = 11;
+        overflow[1] = 3;
+        LoginV2 v2;
+        EXPECT_FALSE(util::wire::Decode(v2, overflow.data(), overflow.size()));
+        std::vector<char> big = { 10, 3, 0, 0, 0, static_cast<char>(0xFF), static_cast<char>(0xFF),
+                                  static_cast<char>(0xFF), static_cast<char>(0xFF), 0x7F, 0 };
+        EXPECT_FALSE(util::wire::Decode(v2, big.data(), big.size()));
+    }
+}
+
+#endif // WIRE_FORMAT_TEST_HPP_INCLUDED